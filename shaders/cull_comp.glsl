@@ -0,0 +1,70 @@
+#version 450
+#pragma shader_stage(compute)
+
+// frustum and normal cone culling of objects, writing the indirect draws of the visible ones (see src/gpu_culling.hpp)
+
+layout(local_size_x = 64) in;
+
+struct Object {
+    vec4 sphere; // center, radius
+    vec4 cone; // axis, cutoff
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCmd {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(set = 0, binding = 0) readonly buffer Objects {
+    Object u_objects[];
+};
+layout(set = 0, binding = 1) writeonly buffer DrawCmds {
+    DrawCmd u_drawCmds[];
+};
+layout(set = 0, binding = 2) buffer DrawCount {
+    uint u_drawCount;
+    uint u_visibleIndexCount; // for the stats
+};
+
+layout(push_constant) uniform PushConstants {
+    vec4 planes[6]; // the normals point inside
+    vec4 cameraPos;
+    uint numObjects;
+    uint compact;
+} u_pc;
+
+void main()
+{
+    uint objectInd = gl_GlobalInvocationID.x;
+    if (objectInd >= u_pc.numObjects)
+        return;
+    Object object = u_objects[objectInd];
+
+    bool visible = true;
+    for (int i = 0; i < 6; i++)
+        visible = visible && dot(u_pc.planes[i].xyz, object.sphere.xyz) + u_pc.planes[i].w >= -object.sphere.w;
+    // all the triangles face away from the camera
+    vec3 toCenter = object.sphere.xyz - u_pc.cameraPos.xyz;
+    visible = visible && dot(toCenter, object.cone.xyz) < object.cone.w * length(toCenter) + object.sphere.w;
+
+    uint slot = objectInd;
+    if (visible) {
+        uint visibleInd = atomicAdd(u_drawCount, 1u);
+        atomicAdd(u_visibleIndexCount, object.indexCount);
+        if (u_pc.compact != 0u)
+            slot = visibleInd;
+    }
+    else if (u_pc.compact != 0u) {
+        return;
+    }
+    // without compaction every object has its draw, the culled ones with 0 instances
+    u_drawCmds[slot] = DrawCmd(object.indexCount, visible ? 1u : 0u, object.firstIndex, object.vertexOffset, object.firstInstance);
+}
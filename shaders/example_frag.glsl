@@ -1,13 +1,17 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 #pragma shader_stage(fragment)
 
 layout(location = 0) out vec4 o_color;
 
 layout(location = 0) in vec2 v_tc;
+layout(location = 1) flat in uint v_textureInd;
 
-layout(set = 0, binding = 0) uniform sampler2D u_colorTex; 
+// bindless texture table, indexed with the texture of each instance
+layout(set = 0, binding = 0) uniform sampler2D u_textures[];
 
 void main()
 {
-    o_color = texture(u_colorTex, v_tc);
-}
\ No newline at end of file
+    // the instances of a draw can use different textures
+    o_color = texture(u_textures[nonuniformEXT(v_textureInd)], v_tc);
+}
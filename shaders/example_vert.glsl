@@ -1,13 +1,23 @@
 #version 450
 #pragma shader_stage(vertex)
 
+// corner of the quad, in [-1, 1]
 layout(location = 0) in vec2 a_pos;
 layout(location = 1) in vec2 a_tc;
 
+// per instance (see src/sprite_batcher.hpp)
+layout(location = 2) in vec2 i_pos;
+layout(location = 3) in vec2 i_axisX;
+layout(location = 4) in vec2 i_axisY;
+layout(location = 5) in vec4 i_uvRect;
+layout(location = 6) in uint i_textureInd;
+
 layout(location = 0) out vec2 v_tc;
+layout(location = 1) flat out uint v_textureInd;
 
 void main()
 {
-    gl_Position = vec4(a_pos, 0, 1);
-    v_tc = a_tc;
+    gl_Position = vec4(i_pos + a_pos.x * i_axisX + a_pos.y * i_axisY, 0, 1);
+    v_tc = mix(i_uvRect.xy, i_uvRect.zw, a_tc);
+    v_textureInd = i_textureInd;
 }
\ No newline at end of file
@@ -0,0 +1,19 @@
+#version 450
+#pragma shader_stage(fragment)
+
+// diffuse lighting, with a checkerboard of the texture coordinates so the UV mapping can be inspected
+
+layout(location = 0) in vec3 v_normal;
+layout(location = 1) in vec2 v_tc;
+layout(location = 2) flat in vec3 v_lightDir;
+
+layout(location = 0) out vec4 o_color;
+
+void main()
+{
+    vec2 cell = floor(v_tc * 8);
+    float checker = mod(cell.x + cell.y, 2);
+    vec3 albedo = mix(vec3(0.55), vec3(0.8), checker);
+    float diffuse = max(dot(normalize(v_normal), v_lightDir), 0);
+    o_color = vec4(albedo * (0.15 + 0.85 * diffuse), 1);
+}
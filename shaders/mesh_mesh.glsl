@@ -0,0 +1,122 @@
+#version 450
+#extension GL_EXT_mesh_shader : require
+#pragma shader_stage(mesh)
+
+// a meshlet (see src/meshlets.hpp) launched by mesh_task.glsl. Produces the same outputs as mesh_vert.glsl
+// there is no vertex input: the vertices are fetched from the vertex buffer and decoded here, with the layout given by the
+// specialization constants (see src/vertex_format.hpp)
+
+layout(local_size_x = 64) in;
+layout(triangles, max_vertices = 64, max_primitives = 124) out;
+
+layout(constant_id = 0) const bool OCT_NORMALS = false;
+layout(constant_id = 1) const uint POS_FORMAT = 0; // vfmt::PosFormat: FLOAT32, HALF, SNORM16
+layout(constant_id = 2) const uint TC_FORMAT = 0; // vfmt::TcFormat: FLOAT32, HALF, UNORM16
+// in 32-bit words
+layout(constant_id = 3) const uint STRIDE = 8;
+layout(constant_id = 4) const uint NORMAL_OFFSET = 3;
+layout(constant_id = 5) const uint TC_OFFSET = 6;
+
+struct Meshlet {
+    uint vertexOffset;
+    uint triangleOffset; // in bytes
+    uint vertexCount;
+    uint triangleCount;
+};
+
+layout(set = 0, binding = 2) readonly buffer Meshlets {
+    Meshlet u_meshlets[];
+};
+layout(set = 0, binding = 3) readonly buffer MeshletVertices {
+    uint u_meshletVertices[];
+};
+layout(set = 0, binding = 4) readonly buffer MeshletTriangles {
+    uint u_meshletTriangles[]; // 3 bytes per triangle
+};
+layout(set = 0, binding = 5) readonly buffer Vertices {
+    uint u_vertices[];
+};
+layout(set = 0, binding = 6) readonly buffer MeshInfo {
+    vec4 posScale; // vfmt::Dequantize
+    vec4 posOffset;
+    vec4 tcScaleOffset;
+} u_mesh;
+
+layout(push_constant) uniform PushConstants {
+    mat4 modelViewProj;
+    vec4 lightDir; // in model space, pointing to the light
+    vec4 cameraPos;
+    uint numMeshlets;
+} u_pc;
+
+struct Payload {
+    uint meshletInds[32];
+};
+taskPayloadSharedEXT Payload payload;
+
+layout(location = 0) out vec3 v_normal[];
+layout(location = 1) out vec2 v_tc[];
+layout(location = 2) flat out vec3 v_lightDir[];
+
+// same as vfmt::octDecode
+vec3 octDecode(vec2 p)
+{
+    vec3 n = vec3(p, 1 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0)));
+    return normalize(n);
+}
+
+vec3 fetchPos(uint base)
+{
+    vec3 pos;
+    if (POS_FORMAT == 0)
+        pos = uintBitsToFloat(uvec3(u_vertices[base], u_vertices[base + 1], u_vertices[base + 2]));
+    else if (POS_FORMAT == 1)
+        pos = vec3(unpackHalf2x16(u_vertices[base]), unpackHalf2x16(u_vertices[base + 1]).x);
+    else
+        pos = vec3(unpackSnorm2x16(u_vertices[base]), unpackSnorm2x16(u_vertices[base + 1]).x);
+    return pos * u_mesh.posScale.xyz + u_mesh.posOffset.xyz;
+}
+
+vec3 fetchNormal(uint base)
+{
+    if (OCT_NORMALS)
+        return octDecode(unpackSnorm2x16(u_vertices[base]));
+    return uintBitsToFloat(uvec3(u_vertices[base], u_vertices[base + 1], u_vertices[base + 2]));
+}
+
+vec2 fetchTc(uint base)
+{
+    vec2 tc;
+    if (TC_FORMAT == 0)
+        tc = uintBitsToFloat(uvec2(u_vertices[base], u_vertices[base + 1]));
+    else if (TC_FORMAT == 1)
+        tc = unpackHalf2x16(u_vertices[base]);
+    else
+        tc = unpackUnorm2x16(u_vertices[base]);
+    return tc * u_mesh.tcScaleOffset.xy + u_mesh.tcScaleOffset.zw;
+}
+
+uint triangleByte(uint byteInd)
+{
+    return (u_meshletTriangles[byteInd >> 2] >> (8 * (byteInd & 3))) & 0xFF;
+}
+
+void main()
+{
+    Meshlet meshlet = u_meshlets[payload.meshletInds[gl_WorkGroupID.x]];
+    SetMeshOutputsEXT(meshlet.vertexCount, meshlet.triangleCount);
+
+    for (uint i = gl_LocalInvocationIndex; i < meshlet.vertexCount; i += gl_WorkGroupSize.x) {
+        uint base = u_meshletVertices[meshlet.vertexOffset + i] * STRIDE;
+        gl_MeshVerticesEXT[i].gl_Position = u_pc.modelViewProj * vec4(fetchPos(base), 1);
+        v_normal[i] = fetchNormal(base + NORMAL_OFFSET);
+        v_tc[i] = fetchTc(base + TC_OFFSET);
+        v_lightDir[i] = u_pc.lightDir.xyz;
+    }
+    for (uint i = gl_LocalInvocationIndex; i < meshlet.triangleCount; i += gl_WorkGroupSize.x) {
+        uint byteInd = meshlet.triangleOffset + 3 * i;
+        gl_PrimitiveTriangleIndicesEXT[i] = uvec3(triangleByte(byteInd), triangleByte(byteInd + 1), triangleByte(byteInd + 2));
+    }
+}
@@ -0,0 +1,71 @@
+#version 450
+#extension GL_EXT_mesh_shader : require
+#pragma shader_stage(task)
+
+// mesh shader path of src/mesh_viewer.hpp: each invocation culls a meshlet, like cull_comp.glsl, and the visible ones of the
+// workgroup are launched as mesh shader workgroups (mesh_mesh.glsl)
+
+layout(local_size_x = 32) in;
+
+struct Object {
+    vec4 sphere; // center, radius
+    vec4 cone; // axis, cutoff
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(set = 0, binding = 0) readonly buffer Objects {
+    Object u_objects[];
+};
+layout(set = 0, binding = 1) buffer Counts {
+    uint u_visibleCount;
+    uint u_visibleIndexCount;
+};
+
+layout(push_constant) uniform PushConstants {
+    mat4 modelViewProj; // the bounds of the meshlets are in model space
+    vec4 lightDir;
+    vec4 cameraPos; // in model space
+    uint numMeshlets;
+} u_pc;
+
+struct Payload {
+    uint meshletInds[32];
+};
+taskPayloadSharedEXT Payload payload;
+
+shared uint s_numVisible;
+
+bool isVisible(Object object)
+{
+    // the frustum planes, from the rows of the matrix (see gpu_cull::frustumPlanes)
+    mat4 m = transpose(u_pc.modelViewProj);
+    vec4 planes[6] = vec4[](m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[2], m[3] - m[2]);
+    bool visible = true;
+    for (int i = 0; i < 6; i++)
+        visible = visible && dot(planes[i].xyz, object.sphere.xyz) + planes[i].w >= -object.sphere.w * length(planes[i].xyz);
+    vec3 toCenter = object.sphere.xyz - u_pc.cameraPos.xyz;
+    return visible && dot(toCenter, object.cone.xyz) < object.cone.w * length(toCenter) + object.sphere.w;
+}
+
+void main()
+{
+    if (gl_LocalInvocationIndex == 0)
+        s_numVisible = 0;
+    barrier();
+
+    uint meshletInd = gl_GlobalInvocationID.x;
+    if (meshletInd < u_pc.numMeshlets) {
+        Object object = u_objects[meshletInd];
+        if (isVisible(object)) {
+            payload.meshletInds[atomicAdd(s_numVisible, 1u)] = meshletInd;
+            atomicAdd(u_visibleCount, 1u);
+            atomicAdd(u_visibleIndexCount, object.indexCount);
+        }
+    }
+    barrier();
+
+    EmitMeshTasksEXT(s_numVisible, 1, 1);
+}
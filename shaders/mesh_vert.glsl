@@ -0,0 +1,38 @@
+#version 450
+#pragma shader_stage(vertex)
+
+// indexed meshes (see src/mesh_viewer.hpp). The attributes can be quantized (see src/vertex_format.hpp)
+
+// the normals are octahedral encoded in 2 components
+layout(constant_id = 0) const bool OCT_NORMALS = false;
+
+layout(location = 0) in vec3 a_pos; // the dequantization of the positions is baked in modelViewProj
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in vec2 a_tc;
+
+layout(location = 0) out vec3 v_normal;
+layout(location = 1) out vec2 v_tc;
+layout(location = 2) flat out vec3 v_lightDir;
+
+layout(push_constant) uniform PushConstants {
+    mat4 modelViewProj;
+    vec4 lightDir; // in model space, pointing to the light
+    vec4 tcScaleOffset; // dequantization of the texture coordinates
+} u_pc;
+
+// same as vfmt::octDecode
+vec3 octDecode(vec2 p)
+{
+    vec3 n = vec3(p, 1 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0)));
+    return normalize(n);
+}
+
+void main()
+{
+    gl_Position = u_pc.modelViewProj * vec4(a_pos, 1);
+    v_normal = OCT_NORMALS ? octDecode(a_normal.xy) : a_normal;
+    v_tc = a_tc * u_pc.tcScaleOffset.xy + u_pc.tcScaleOffset.zw;
+    v_lightDir = u_pc.lightDir.xyz;
+}
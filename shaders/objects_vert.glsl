@@ -0,0 +1,31 @@
+#version 450
+#pragma shader_stage(vertex)
+
+// the objects drawn with GPU culling (see src/gpu_culling.hpp). Like example_vert.glsl, but the instances are in world space, seen through a 2D camera
+
+// corner of the quad, in [-1, 1]
+layout(location = 0) in vec2 a_pos;
+layout(location = 1) in vec2 a_tc;
+
+// the object, selected with the firstInstance of its indirect draw
+layout(location = 2) in vec2 i_pos;
+layout(location = 3) in vec2 i_axisX;
+layout(location = 4) in vec2 i_axisY;
+layout(location = 5) in vec4 i_uvRect;
+layout(location = 6) in uint i_textureInd;
+
+layout(location = 0) out vec2 v_tc;
+layout(location = 1) flat out uint v_textureInd;
+
+layout(push_constant) uniform PushConstants {
+    vec2 viewScale; // from world to clip space
+    vec2 viewOffset;
+} u_pc;
+
+void main()
+{
+    vec2 worldPos = i_pos + a_pos.x * i_axisX + a_pos.y * i_axisY;
+    gl_Position = vec4(worldPos * u_pc.viewScale + u_pc.viewOffset, 0, 1);
+    v_tc = mix(i_uvRect.xy, i_uvRect.zw, a_tc);
+    v_textureInd = i_textureInd;
+}
@@ -0,0 +1,76 @@
+#version 450
+#pragma shader_stage(fragment)
+
+// samples a virtual texture (see src/virtual_texture.hpp)
+
+layout(location = 0) out vec4 o_color;
+
+layout(location = 0) in vec2 v_tc;
+
+// a texel per virtual page, a mip per level: (slot x, slot y, level, resident)
+layout(set = 0, binding = 0) uniform usampler2D u_pageTable;
+// the physical cache, where the resident pages are
+layout(set = 0, binding = 1) uniform sampler2D u_cache;
+// the pages that this frame would like to sample, one per virtual page of all the levels
+layout(set = 0, binding = 2) writeonly buffer Feedback {
+    uint u_feedback[];
+};
+
+layout(push_constant) uniform PushConstants {
+    vec2 uvOffset;
+    vec2 uvScale;
+    uint pagesPerSide;
+    uint numLevels;
+    uint pageSize;
+    uint border;
+    uint feedbackPixel;
+} u_pc;
+
+uint firstPageOfLevel(uint level)
+{
+    uint first = 0;
+    for (uint l = 0; l < level; l++) {
+        uint side = u_pc.pagesPerSide >> l;
+        first += side * side;
+    }
+    return first;
+}
+
+void main()
+{
+    vec2 uv = u_pc.uvOffset + v_tc * u_pc.uvScale;
+    float payload = float(u_pc.pageSize - 2 * u_pc.border);
+
+    // the level, from the derivatives in texels of level 0. Rounded down, so we never sample a blurrier level than needed
+    vec2 texel = uv * (float(u_pc.pagesPerSide) * payload);
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    uint level = uint(clamp(lod, 0.0, float(u_pc.numLevels - 1)));
+
+    // one pixel of each 4x4 block asks for its page. The rest of the pixels of the block ask in the next frames
+    uvec2 blockPixel = uvec2(gl_FragCoord.xy) & 3u;
+    if (blockPixel.x + 4u * blockPixel.y == u_pc.feedbackPixel) {
+        uint side = u_pc.pagesPerSide >> level;
+        uvec2 page = uvec2(clamp(uv * float(side), vec2(0), vec2(side - 1u)));
+        u_feedback[firstPageOfLevel(level) + page.y * side + page.x] = 1u;
+    }
+
+    // the finest resident level. The last one is always resident
+    uvec4 entry = uvec4(0);
+    vec2 pageCoord = vec2(0);
+    for (uint l = level; l < u_pc.numLevels; l++) {
+        float side = float(u_pc.pagesPerSide >> l);
+        pageCoord = clamp(uv * side, vec2(0), vec2(side - 0.001));
+        entry = texelFetch(u_pageTable, ivec2(pageCoord), int(l));
+        if (entry.w != 0u)
+            break;
+    }
+    if (entry.w == 0u) { // nothing loaded yet
+        o_color = vec4(0.5, 0.5, 0.5, 1);
+        return;
+    }
+
+    vec2 cacheTexel = vec2(entry.xy) * float(u_pc.pageSize) + float(u_pc.border) + fract(pageCoord) * payload;
+    o_color = textureLod(u_cache, cacheTexel / vec2(textureSize(u_cache, 0)), 0.0);
+}
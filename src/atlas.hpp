@@ -0,0 +1,165 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <algorithm>
+#include "helpers.hpp"
+#include "uploader.hpp"
+
+// imgui_draw.cpp already compiles the rect packer, but as static functions, so we need our own copy
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <imstb_rectpack.h>
+
+namespace
+{
+
+// packs many small images (icons, sprites...) into the pages of an array texture. Each page has a 2D view, that the sprites sample like any other texture
+// each image is surrounded by PADDING texels that replicate its border, so bilinear filtering doesn't bleed in texels of its neighbours
+// the pages only have one mip level: lower levels would mix neighbouring images unless the padding grew with the level
+namespace atlas {
+
+static constexpr u32 PADDING = 2;
+static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+struct SourceImage {
+	u32 width, height;
+	const u8* pixels; // RGBA8, tightly packed
+};
+
+// where an image ended up. The uvs exclude the padding
+struct Entry {
+	u32 layer;
+	glm::vec2 uvMin, uvMax;
+};
+
+struct Atlas {
+	u32 pageSize = 0;
+	u32 numPages = 0;
+	VkImage img = VK_NULL_HANDLE;
+	VmaAllocation alloc;
+	std::vector<VkImageView> layerViews; // one 2D view per page
+	std::vector<Entry> entries; // same order as the source images
+};
+
+// assigns a page and a position to each image. Returns the number of pages
+u32 pack(u32 pageSize, std::span<const SourceImage> images, std::vector<stbrp_rect>& rects, std::vector<u32>& rectPages)
+{
+	rects.resize(images.size());
+	rectPages.assign(images.size(), ~0u);
+	for (size_t i = 0; i < images.size(); i++) {
+		assert(images[i].width + 2 * PADDING <= pageSize && images[i].height + 2 * PADDING <= pageSize);
+		rects[i] = {
+			.id = int(i),
+			.w = int(images[i].width + 2 * PADDING),
+			.h = int(images[i].height + 2 * PADDING),
+		};
+	}
+
+	std::vector<stbrp_node> nodes(pageSize);
+	std::vector<stbrp_rect> pending = rects;
+	u32 numPages = 0;
+	while (!pending.empty()) {
+		stbrp_context ctx;
+		stbrp_init_target(&ctx, int(pageSize), int(pageSize), nodes.data(), int(nodes.size()));
+		stbrp_pack_rects(&ctx, pending.data(), int(pending.size()));
+		size_t numLeft = 0;
+		for (const stbrp_rect& r : pending) {
+			if (r.was_packed) {
+				rects[r.id] = r;
+				rectPages[r.id] = numPages;
+			}
+			else {
+				pending[numLeft++] = r;
+			}
+		}
+		pending.resize(numLeft);
+		numPages++;
+	}
+	return numPages;
+}
+
+// copies the image into the page, replicating the border texels in the padding
+void blitWithPadding(u8* page, u32 pageSize, const SourceImage& src, const stbrp_rect& rect)
+{
+	for (u32 y = 0; y < u32(rect.h); y++) {
+		const u32 srcY = u32(glm::clamp(int(y) - int(PADDING), 0, int(src.height) - 1));
+		const u8* srcRow = src.pixels + size_t(srcY) * src.width * 4;
+		u8* dstRow = page + (size_t(rect.y + y) * pageSize + rect.x) * 4;
+		for (u32 x = 0; x < PADDING; x++) {
+			memcpy(dstRow + 4 * x, srcRow, 4);
+			memcpy(dstRow + 4 * (PADDING + src.width + x), srcRow + 4 * (src.width - 1), 4);
+		}
+		memcpy(dstRow + 4 * PADDING, srcRow, size_t(src.width) * 4);
+	}
+}
+
+// packs the images and records the upload of the pages: one copy per page, composed directly in staging memory
+// the source images can be freed when this returns
+void build(Atlas& atlas, upload::Uploader& up, std::span<const SourceImage> images, u32 pageSize)
+{
+	std::vector<stbrp_rect> rects;
+	std::vector<u32> rectPages;
+	atlas.pageSize = pageSize;
+	atlas.numPages = pack(pageSize, images, rects, rectPages);
+
+	vk::Img info = {
+		.width = pageSize,
+		.height = pageSize,
+		.layers = atlas.numPages,
+		.mipLevels = 1,
+		.format = FORMAT,
+	};
+	vk::createStaticImage(up.device, up.allocator, info, atlas.img, atlas.alloc);
+	const VkImageSubresourceRange range = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.baseMipLevel = 0,
+		.levelCount = 1,
+		.baseArrayLayer = 0,
+		.layerCount = atlas.numPages,
+	};
+	atlas.layerViews.resize(atlas.numPages);
+	for (u32 i = 0; i < atlas.numPages; i++) {
+		VkImageSubresourceRange layerRange = range;
+		layerRange.baseArrayLayer = i;
+		layerRange.layerCount = 1;
+		atlas.layerViews[i] = vk::createImageView(up.device, atlas.img, FORMAT, layerRange);
+	}
+
+	const float invPageSize = 1.f / float(pageSize);
+	atlas.entries.resize(images.size());
+	for (size_t i = 0; i < images.size(); i++) {
+		const glm::vec2 pos = glm::vec2(rects[i].x + PADDING, rects[i].y + PADDING);
+		atlas.entries[i] = {
+			.layer = rectPages[i],
+			.uvMin = pos * invPageSize,
+			.uvMax = (pos + glm::vec2(images[i].width, images[i].height)) * invPageSize,
+		};
+	}
+
+	upload::prepareImage(up, atlas.img, range);
+	const u64 pageBytes = u64(pageSize) * pageSize * 4;
+	for (u32 page = 0; page < atlas.numPages; page++) {
+		u8* stagingData = upload::copyToImage(up, atlas.img, 0, page, {0, 0}, {pageSize, pageSize}, pageBytes);
+		assert(stagingData); // a page must fit in the staging ring
+		memset(stagingData, 0, pageBytes);
+		for (size_t i = 0; i < images.size(); i++) {
+			if (rectPages[i] == page)
+				blitWithPadding(stagingData, pageSize, images[i], rects[i]);
+		}
+	}
+	upload::finishImage(up, atlas.img, range);
+}
+
+// the atlas must not be in use by the GPU
+void destroy(Atlas& atlas, VkDevice device, VmaAllocator allocator)
+{
+	for (VkImageView view : atlas.layerViews)
+		vkDestroyImageView(device, view, nullptr);
+	vmaDestroyImage(allocator, atlas.img, atlas.alloc);
+	atlas = {};
+}
+
+} // namespace atlas
+
+}
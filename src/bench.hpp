@@ -0,0 +1,145 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include "helpers.hpp"
+
+namespace
+{
+
+namespace bench {
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// the samples of one measured quantity (in milliseconds), one sample per frame
+struct Series {
+	CStr name;
+	std::vector<double> samples;
+};
+
+enum ESeries {
+	CPU_FRAME,
+	ACQUIRE, // blocked in vkAcquireNextImageKHR
+	FENCE_WAIT, // blocked waiting for the frame slot to be free (the timeline value of its previous use)
+	SUBMIT,
+	PRESENT,
+	LATENCY, // from the start of the CPU frame until we see that the GPU has finished it (polled a few times per frame)
+	SPRITES_CPU, // writing the sprite instances
+	SPRITES_GPU, // the sprite batch draw, from the GPU timestamps (of an earlier frame, they are read back when its slot is reused)
+	COUNT
+};
+
+struct FrameStats {
+	Series series[ESeries::COUNT] = {
+		{"cpuFrameMs"},
+		{"acquireMs"},
+		{"fenceWaitMs"},
+		{"submitMs"},
+		{"presentMs"},
+		{"frameLatencyMs"},
+		{"spritesCpuMs"},
+		{"spritesGpuMs"},
+	};
+	double frameSamples[ESeries::COUNT] = {}; // samples of the frame currently being measured
+	u32 warmupFrames = 0; // the first frames are usually much slower (pipeline compilation, uploads), so we discard them
+	u32 numFrames = 0;
+	bool keepSamples = true; // only if a report will be written: an interactive session would grow them for as long as it runs
+
+	void add(ESeries s, double ms) { frameSamples[s] += ms; }
+	void endFrame()
+	{
+		if (keepSamples && numFrames >= warmupFrames) {
+			for (u32 i = 0; i < ESeries::COUNT; i++)
+				series[i].samples.push_back(frameSamples[i]);
+		}
+		discardFrame();
+		numFrames++;
+	}
+	// for the iterations that don't produce a frame (minimized window, out of date swapchain): their samples must not be added to the next frame's
+	void discardFrame()
+	{
+		for (u32 i = 0; i < ESeries::COUNT; i++)
+			frameSamples[i] = 0;
+	}
+};
+
+// nearest-rank percentile. The samples must be sorted
+double percentile(std::span<const double> sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	const size_t rank = size_t(glm::ceil(p / 100.0 * sorted.size()));
+	return sorted[glm::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+double median(const Series& series)
+{
+	std::vector<double> sorted = series.samples;
+	std::sort(sorted.begin(), sorted.end());
+	return percentile(sorted, 50);
+}
+
+void writeSeriesJson(FILE* file, const Series& series, bool last)
+{
+	std::vector<double> sorted = series.samples;
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0;
+	for (double x : sorted)
+		sum += x;
+	const double mean = sorted.empty() ? 0 : sum / sorted.size();
+	fprintf(file, "    \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+		series.name, mean, percentile(sorted, 50), percentile(sorted, 95), percentile(sorted, 99),
+		sorted.empty() ? 0.0 : sorted.back(), last ? "" : ",");
+}
+
+struct RunInfo {
+	CStr deviceName;
+	bool headless;
+	u32 framesInFlight;
+	CStr latencyProfile;
+	CStr presentMode;
+	u32 swapchainImages;
+	u32 spritesPerFrame;
+	u32 gpuObjects; // drawn with GPU culling: the CPU frame time shouldn't depend on it
+	double totalSeconds;
+};
+
+void writeJson(FILE* file, const FrameStats& stats, const RunInfo& info)
+{
+	const u32 measuredFrames = u32(stats.series[CPU_FRAME].samples.size());
+	fprintf(file, "{\n");
+	fprintf(file, "  \"device\": \"%s\",\n", info.deviceName);
+	fprintf(file, "  \"headless\": %s,\n", info.headless ? "true" : "false");
+	fprintf(file, "  \"framesInFlight\": %u,\n", info.framesInFlight);
+	fprintf(file, "  \"latencyProfile\": \"%s\",\n", info.latencyProfile);
+	fprintf(file, "  \"presentMode\": \"%s\",\n", info.presentMode);
+	fprintf(file, "  \"swapchainImages\": %u,\n", info.swapchainImages);
+	fprintf(file, "  \"frames\": %u,\n", stats.numFrames);
+	fprintf(file, "  \"warmupFrames\": %u,\n", stats.numFrames - measuredFrames);
+	fprintf(file, "  \"totalSeconds\": %.4f,\n", info.totalSeconds);
+	fprintf(file, "  \"fps\": %.2f,\n", info.totalSeconds > 0 ? stats.numFrames / info.totalSeconds : 0.0);
+	fprintf(file, "  \"gpuObjects\": %u,\n", info.gpuObjects);
+	fprintf(file, "  \"spritesPerFrame\": %u,\n", info.spritesPerFrame);
+	if (info.spritesPerFrame) { // throughput of the sprite batcher, from the median frame
+		const double cpuMs = median(stats.series[SPRITES_CPU]);
+		const double gpuMs = median(stats.series[SPRITES_GPU]);
+		fprintf(file, "  \"spritesPerMs\": {\"cpu\": %.1f, \"gpu\": %.1f},\n",
+			cpuMs > 0 ? info.spritesPerFrame / cpuMs : 0.0, gpuMs > 0 ? info.spritesPerFrame / gpuMs : 0.0);
+	}
+	fprintf(file, "  \"timings\": {\n");
+	for (u32 i = 0; i < ESeries::COUNT; i++)
+		writeSeriesJson(file, stats.series[i], i + 1 == ESeries::COUNT);
+	fprintf(file, "  }\n");
+	fprintf(file, "}\n");
+}
+
+} // namespace bench
+
+}
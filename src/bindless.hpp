@@ -0,0 +1,161 @@
+#pragma once
+
+#include "helpers.hpp"
+
+namespace
+{
+
+// bindless texture table: a single descriptor set with a big array of combined image samplers (descriptor indexing, Vulkan 1.2)
+// the set is bound once per frame, and the shaders address the textures with an index (in push constants or instance data)
+// the array is partially bound, so only the slots in use need valid descriptors, and it's UPDATE_AFTER_BIND, so slots can be
+// written while the set is bound in pending cmd buffers, as long as those cmd buffers don't use the slots being written
+namespace bindless {
+
+static constexpr u32 MAX_TEXTURES = 1 << 16;
+static constexpr u32 BINDING = 0;
+
+struct Table {
+	VkDevice device;
+	VkDescriptorSetLayout layout;
+	VkDescriptorPool pool;
+	VkDescriptorSet set;
+	u32 capacity;
+	u32 numUsed = 0; // slots [0, numUsed) have been handed out at some point
+	std::vector<u32> freeSlots; // released slots, reused before growing numUsed
+};
+
+// the device features required by the table. They must be enabled in the VkPhysicalDeviceVulkan12Features passed to createDevice()
+bool featuresAreSupported(const VkPhysicalDeviceVulkan12Features& supported)
+{
+	return supported.runtimeDescriptorArray &&
+		supported.descriptorBindingPartiallyBound &&
+		supported.descriptorBindingSampledImageUpdateAfterBind &&
+		supported.descriptorBindingUpdateUnusedWhilePending &&
+		supported.shaderSampledImageArrayNonUniformIndexing;
+}
+
+void enableFeatures(VkPhysicalDeviceVulkan12Features& features)
+{
+	features.runtimeDescriptorArray = VK_TRUE;
+	features.descriptorBindingPartiallyBound = VK_TRUE;
+	features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+}
+
+// the capacity is clamped to the update-after-bind limits of the device
+// immutableSampler: optional, if all the textures use the same sampler it can be baked in the layout. Then the sampler passed to add() and write() is ignored
+void init(Table& table, VkDevice device, VkPhysicalDevice physicalDevice, VkShaderStageFlags stages,
+	VkSampler immutableSampler = VK_NULL_HANDLE, u32 capacity = MAX_TEXTURES)
+{
+	VkPhysicalDeviceVulkan12Properties props12 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
+	VkPhysicalDeviceProperties2 props = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &props12,
+	};
+	vkGetPhysicalDeviceProperties2(physicalDevice, &props);
+	// a combined image sampler counts both as a sampled image and as a sampler
+	capacity = glm::min(capacity, props12.maxDescriptorSetUpdateAfterBindSampledImages);
+	capacity = glm::min(capacity, props12.maxDescriptorSetUpdateAfterBindSamplers);
+	capacity = glm::min(capacity, props12.maxPerStageDescriptorUpdateAfterBindSampledImages);
+	capacity = glm::min(capacity, props12.maxPerStageDescriptorUpdateAfterBindSamplers);
+	table.device = device;
+	table.capacity = capacity;
+
+	std::vector<VkSampler> immutableSamplers;
+	if (immutableSampler != VK_NULL_HANDLE)
+		immutableSamplers.assign(capacity, immutableSampler); // only needs to live until the layout is created
+	const VkDescriptorSetLayoutBinding binding = {
+		.binding = BINDING,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = capacity,
+		.stageFlags = stages,
+		.pImmutableSamplers = immutableSamplers.empty() ? nullptr : immutableSamplers.data(),
+	};
+	const VkDescriptorBindingFlags bindingFlags =
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	const VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+		.bindingCount = 1,
+		.pBindingFlags = &bindingFlags,
+	};
+	const VkDescriptorSetLayoutCreateInfo layoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = &bindingFlagsInfo,
+		.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+		.bindingCount = 1,
+		.pBindings = &binding,
+	};
+	VkResult vkRes = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &table.layout);
+	vk::assertRes(vkRes);
+
+	const VkDescriptorPoolSize poolSize = {
+		.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = capacity,
+	};
+	const VkDescriptorPoolCreateInfo poolInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+		.maxSets = 1,
+		.poolSizeCount = 1,
+		.pPoolSizes = &poolSize,
+	};
+	vkRes = vkCreateDescriptorPool(device, &poolInfo, nullptr, &table.pool);
+	vk::assertRes(vkRes);
+
+	vk::allocDescSets(device, table.pool, { &table.layout, 1 }, { &table.set, 1 });
+}
+
+void destroy(Table& table)
+{
+	vkDestroyDescriptorPool(table.device, table.pool, nullptr);
+	vkDestroyDescriptorSetLayout(table.device, table.layout, nullptr);
+	table = {};
+}
+
+// the slot can be written again while the set is bound, but not while it's being used by the GPU
+void write(Table& table, u32 slot, VkImageView view, VkSampler sampler)
+{
+	assert(slot < table.numUsed);
+	vk::writeTextureDescriptor(table.device, table.set, BINDING, view, sampler, slot);
+}
+
+// returns the index of the texture in the shader array
+[[nodiscard]]
+u32 add(Table& table, VkImageView view, VkSampler sampler)
+{
+	u32 slot;
+	if (!table.freeSlots.empty()) {
+		slot = table.freeSlots.back();
+		table.freeSlots.pop_back();
+	}
+	else {
+		assert(table.numUsed < table.capacity);
+		slot = table.numUsed++;
+	}
+	write(table, slot, view, sampler);
+	return slot;
+}
+
+// the slot must not be in use by the GPU anymore (defer it with the deletion queue), as it can be handed out again right away
+// its descriptor is left as it is: the array is partially bound, and nothing will access it until it's written again
+void release(Table& table, u32 slot)
+{
+	assert(slot < table.numUsed);
+	table.freeSlots.push_back(slot);
+}
+
+void cmdBind(const Table& table, VkCommandBuffer cmdBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, u32 setInd = 0)
+{
+	vkCmdBindDescriptorSets(cmdBuffer, bindPoint, pipelineLayout,
+		setInd, 1, // firstSet, setCount
+		&table.set,
+		0, nullptr // dynamic offset
+	);
+}
+
+} // namespace bindless
+
+}
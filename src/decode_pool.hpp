@@ -0,0 +1,132 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <stb_image.h>
+#include "helpers.hpp"
+
+namespace
+{
+
+// pool of worker threads that decode images (with stb_image) in parallel
+// the main thread requests images and, every frame, takes the finished ones and hands them to the upload path
+namespace decode {
+
+struct Image {
+	u32 id; // returned by request()
+	u32 width, height;
+	u32 numChannels; // 3 (RGB8) or 4 (RGBA8)
+	u8* pixels; // null if the decoding failed. Must be freed with freePixels(), as soon as it has been copied to staging memory
+};
+
+struct Job {
+	u32 id;
+	std::string fileName;
+};
+
+struct Pool {
+	std::vector<std::thread> threads;
+	std::mutex mutex; // protects everything below
+	std::condition_variable cv;
+	std::deque<Job> jobs;
+	std::vector<Image> finished;
+	u32 nextId = 0;
+	u32 numInProgress = 0;
+	bool quit = false;
+};
+
+void freePixels(Image& img)
+{
+	if (img.pixels)
+		stbi_image_free(img.pixels);
+	img.pixels = nullptr;
+}
+
+void workerLoop(Pool& pool)
+{
+	std::unique_lock lock(pool.mutex);
+	for (;;) {
+		pool.cv.wait(lock, [&] { return pool.quit || !pool.jobs.empty(); });
+		if (pool.quit)
+			return;
+		const Job job = std::move(pool.jobs.front());
+		pool.jobs.pop_front();
+		pool.numInProgress++;
+
+		lock.unlock();
+		// RGB images are kept as they are, and expanded to RGBA with the SIMD kernels while they are copied to staging memory
+		// the rest are expanded by stb_image
+		int w = 0, h = 0, nc = 0;
+		stbi_info(job.fileName.c_str(), &w, &h, &nc);
+		const int numChannels = nc == 3 ? 3 : 4;
+		u8* pixels = stbi_load(job.fileName.c_str(), &w, &h, &nc, numChannels);
+		if (!pixels)
+			fprintf(stderr, "could not decode %s\n", job.fileName.c_str());
+		lock.lock();
+
+		pool.finished.push_back({ job.id, u32(w), u32(h), u32(numChannels), pixels });
+		pool.numInProgress--;
+	}
+}
+
+// numThreads = 0 means one per core, leaving one for the main thread
+void init(Pool& pool, u32 numThreads = 0)
+{
+	if (numThreads == 0)
+		numThreads = glm::max(std::thread::hardware_concurrency(), 2u) - 1;
+	pool.threads.reserve(numThreads);
+	for (u32 i = 0; i < numThreads; i++)
+		pool.threads.emplace_back(workerLoop, std::ref(pool));
+}
+
+// the jobs that haven't started are discarded, the ones in progress are waited for
+void destroy(Pool& pool)
+{
+	{
+		std::lock_guard lock(pool.mutex);
+		pool.quit = true;
+		pool.jobs.clear();
+	}
+	pool.cv.notify_all();
+	for (auto& thread : pool.threads)
+		thread.join();
+	pool.threads.clear();
+	for (Image& img : pool.finished)
+		freePixels(img);
+	pool.finished.clear();
+}
+
+// returns an id that identifies the image in takeFinished()
+u32 request(Pool& pool, CStr fileName)
+{
+	u32 id;
+	{
+		std::lock_guard lock(pool.mutex);
+		id = pool.nextId++;
+		pool.jobs.push_back({ id, fileName });
+	}
+	pool.cv.notify_one();
+	return id;
+}
+
+// appends the images that have been decoded since the last call. Doesn't block
+void takeFinished(Pool& pool, std::vector<Image>& images)
+{
+	std::lock_guard lock(pool.mutex);
+	images.insert(images.end(), pool.finished.begin(), pool.finished.end());
+	pool.finished.clear();
+}
+
+// number of requested images that haven't been taken yet
+u32 numPending(Pool& pool)
+{
+	std::lock_guard lock(pool.mutex);
+	return u32(pool.jobs.size() + pool.finished.size()) + pool.numInProgress;
+}
+
+} // namespace decode
+
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include "helpers.hpp"
+#include "uploader.hpp"
+
+namespace
+{
+
+// GPU-driven rendering: the bounds and the draw parameters of the objects live in a GPU buffer, and a compute pass does the
+// frustum culling and writes the draws of the visible objects in a VkDrawIndexedIndirectCommand buffer. The CPU records the
+// same few commands every frame (a dispatch and an indirect draw), no matter how many objects there are
+// with drawIndirectCount (Vulkan 1.2) the draws are compacted and their count is read by vkCmdDrawIndexedIndirectCount
+// otherwise there is a draw per object, with instanceCount 0 if it's culled, submitted with a single multi-draw indirect
+// a multi-draw can't have more than maxDrawIndirectCount draws: past that the draws are not compacted, and are split in several multi-draws
+// the order of the compacted draws is not deterministic, so the objects shouldn't depend on the order they are blended in
+// besides the frustum, the objects can have a normal cone: they are culled if the camera sees all their triangles from the back
+// (for clusters of triangles, see meshlets.hpp)
+namespace gpu_cull {
+
+static constexpr u32 LOCAL_SIZE = 64; // must match cull_comp.glsl
+
+// must match the Object struct of cull_comp.glsl (std430)
+struct Object {
+	glm::vec4 sphere; // center and radius of the bounding sphere
+	glm::vec4 cone; // axis and cutoff of the normal cone, culled if dot(center - camera, axis) >= cutoff * |center - camera| + radius. Cutoff 1 disables it
+	u32 indexCount;
+	u32 firstIndex;
+	i32 vertexOffset;
+	u32 firstInstance; // the shaders of the draw can use it to find the data of the object (per-instance attributes or gl_InstanceIndex)
+};
+
+// must match the push_constant block of cull_comp.glsl
+struct PushConstants {
+	glm::vec4 planes[6]; // the normals point inside: a point p is inside if dot(plane.xyz, p) + plane.w >= 0
+	glm::vec4 cameraPos; // for the normal cones
+	u32 numObjects;
+	u32 compact; // write the visible draws contiguously, and their count (needs drawIndirectCount)
+};
+
+// must match the DrawCount block of cull_comp.glsl. Cleared and written by the culling every frame
+struct Counts {
+	u32 numDraws; // visible objects. The count of vkCmdDrawIndexedIndirectCount
+	u32 numIndices; // of the visible objects
+};
+
+enum class DrawPath {
+	INDIRECT_COUNT, // vkCmdDrawIndexedIndirectCount
+	MULTI_DRAW_INDIRECT, // vkCmdDrawIndexedIndirect with a draw per object
+	INDIRECT_LOOP, // without multiDrawIndirect: a vkCmdDrawIndexedIndirect per object, so the CPU cost is not constant anymore
+};
+static ConstStr DRAW_PATH_NAMES[] = { "vkCmdDrawIndexedIndirectCount", "multi-draw indirect", "indirect draw per object" };
+
+struct Culler {
+	VkDevice device = VK_NULL_HANDLE;
+	VmaAllocator allocator;
+	DrawPath bestDrawPath; // of the enabled features
+	DrawPath drawPath; // used for the current objects
+	u32 capacity;
+	u32 maxDrawCount; // VkPhysicalDeviceLimits::maxDrawIndirectCount
+	bool multiDrawIndirect; // the feature is enabled
+	u32 numObjects = 0;
+	VkBuffer objectsBuffer;
+	VmaAllocation objectsAlloc;
+	VkBuffer drawCmdsBuffer; // a VkDrawIndexedIndirectCommand per object
+	VmaAllocation drawCmdsAlloc;
+	VkBuffer countBuffer; // Counts
+	VmaAllocation countAlloc;
+	VkBuffer readbackBuffer; // the counts of each frame in flight, read back for the stats
+	VmaAllocation readbackAlloc;
+	const Counts* readbackData;
+	VkDescriptorSetLayout setLayout;
+	VkDescriptorPool descPool;
+	VkDescriptorSet descSet;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+	u64 numIndices = 0; // of all the objects
+	// stats of the last frame that has been read back
+	u32 numVisible = 0;
+	u64 numVisibleIndices = 0;
+};
+
+// drawIndirectFirstInstance is required: the draws find the data of their objects with firstInstance
+bool featuresAreSupported(const VkPhysicalDeviceFeatures& supported)
+{
+	return supported.drawIndirectFirstInstance;
+}
+
+// enables the required features, and the optional ones that are supported
+void enableFeatures(const VkPhysicalDeviceFeatures& supported, const VkPhysicalDeviceVulkan12Features& supported12,
+	VkPhysicalDeviceFeatures& features, VkPhysicalDeviceVulkan12Features& features12)
+{
+	features.drawIndirectFirstInstance = VK_TRUE;
+	features.multiDrawIndirect = supported.multiDrawIndirect;
+	features12.drawIndirectCount = supported12.drawIndirectCount;
+}
+
+// enabledFeatures and drawIndirectCount: the features enabled in the device
+void init(Culler& c, VkDevice device, VmaAllocator allocator, const VkPhysicalDeviceProperties& props,
+	const VkPhysicalDeviceFeatures& enabledFeatures, bool drawIndirectCount, VkPipelineCache pipelineCache, u32 capacity, u32 numFrames)
+{
+	assert(enabledFeatures.drawIndirectFirstInstance);
+	c.device = device;
+	c.allocator = allocator;
+	if (drawIndirectCount)
+		c.bestDrawPath = DrawPath::INDIRECT_COUNT;
+	else if (enabledFeatures.multiDrawIndirect)
+		c.bestDrawPath = DrawPath::MULTI_DRAW_INDIRECT;
+	else
+		c.bestDrawPath = DrawPath::INDIRECT_LOOP;
+	c.drawPath = c.bestDrawPath;
+	c.capacity = glm::max(capacity, 1u);
+	c.maxDrawCount = glm::max(props.limits.maxDrawIndirectCount, 1u);
+	c.multiDrawIndirect = enabledFeatures.multiDrawIndirect;
+
+	vk::createDeviceBuffer(allocator, VkDeviceSize(c.capacity) * sizeof(Object), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		c.objectsBuffer, c.objectsAlloc);
+	vk::createDeviceBuffer(allocator, VkDeviceSize(c.capacity) * sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, c.drawCmdsBuffer, c.drawCmdsAlloc);
+	vk::createDeviceBuffer(allocator, sizeof(Counts),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, c.countBuffer, c.countAlloc);
+
+	const VkBufferCreateInfo readbackBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = numFrames * sizeof(Counts),
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	};
+	const VmaAllocationCreateInfo readbackAllocInfo = {
+		.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		.usage = VMA_MEMORY_USAGE_AUTO,
+	};
+	VmaAllocationInfo allocInfo;
+	VkResult vkRes = vmaCreateBuffer(allocator, &readbackBufferInfo, &readbackAllocInfo, &c.readbackBuffer, &c.readbackAlloc, &allocInfo);
+	vk::assertRes(vkRes);
+	memset(allocInfo.pMappedData, 0, readbackBufferInfo.size);
+	vmaFlushAllocation(allocator, c.readbackAlloc, 0, VK_WHOLE_SIZE);
+	c.readbackData = (const Counts*)allocInfo.pMappedData;
+
+	VkDescriptorSetLayoutBinding bindings[3];
+	for (u32 i = 0; i < 3; i++) {
+		bindings[i] = {
+			.binding = i,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		};
+	}
+	const VkDescriptorSetLayoutCreateInfo layoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = u32(std::size(bindings)),
+		.pBindings = bindings,
+	};
+	vkRes = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &c.setLayout);
+	vk::assertRes(vkRes);
+
+	const VkDescriptorPoolSize poolSize = { .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 3 };
+	c.descPool = vk::createDescriptorPool(device, 1, { &poolSize, 1 });
+	vk::allocDescSets(device, c.descPool, { &c.setLayout, 1 }, { &c.descSet, 1 });
+	const VkDescriptorBufferInfo bufferInfos[] = {
+		{ .buffer = c.objectsBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = c.drawCmdsBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = c.countBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+	};
+	const VkWriteDescriptorSet write = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = c.descSet,
+		.dstBinding = 0,
+		.descriptorCount = u32(std::size(bufferInfos)), // consecutive bindings
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = bufferInfos,
+	};
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+	const VkPushConstantRange pushConstantRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(PushConstants),
+	};
+	c.pipelineLayout = vk::createPipelineLayout(device, { &c.setLayout, 1 }, { &pushConstantRange, 1 });
+	const VkShaderModule shader = vk::loadShaderModule(device, "shaders/cull_comp.spirv");
+	c.pipeline = vk::createComputePipeline(device, { shader }, c.pipelineLayout, pipelineCache);
+	vkDestroyShaderModule(device, shader, nullptr);
+}
+
+// the GPU must not be using it
+void destroy(Culler& c)
+{
+	if (c.device == VK_NULL_HANDLE)
+		return;
+	vkDestroyPipeline(c.device, c.pipeline, nullptr);
+	vkDestroyPipelineLayout(c.device, c.pipelineLayout, nullptr);
+	vkDestroyDescriptorPool(c.device, c.descPool, nullptr);
+	vkDestroyDescriptorSetLayout(c.device, c.setLayout, nullptr);
+	vmaDestroyBuffer(c.allocator, c.readbackBuffer, c.readbackAlloc);
+	vmaDestroyBuffer(c.allocator, c.countBuffer, c.countAlloc);
+	vmaDestroyBuffer(c.allocator, c.drawCmdsBuffer, c.drawCmdsAlloc);
+	vmaDestroyBuffer(c.allocator, c.objectsBuffer, c.objectsAlloc);
+	c = {};
+}
+
+// uploads the objects. The GPU must not be using the objects buffer (e.g. call it once, before the first frame)
+void setObjects(Culler& c, upload::Uploader& up, std::span<const Object> objects)
+{
+	assert(objects.size() <= c.capacity);
+	c.numObjects = u32(objects.size());
+	// vkCmdDrawIndexedIndirectCount can't be split, because the count of the compacted draws is only known by the GPU
+	c.drawPath = c.bestDrawPath;
+	if (c.drawPath == DrawPath::INDIRECT_COUNT && c.numObjects > c.maxDrawCount)
+		c.drawPath = c.multiDrawIndirect ? DrawPath::MULTI_DRAW_INDIRECT : DrawPath::INDIRECT_LOOP;
+	c.numIndices = 0;
+	for (const Object& object : objects)
+		c.numIndices += object.indexCount;
+	upload::copyToBuffer(up, c.objectsBuffer, 0, objects.data(), objects.size_bytes());
+}
+
+// the planes of the frustum of an orthographic 2D view, showing the rectangle [center - halfSize, center + halfSize] of the z = 0 plane
+void orthoFrustumPlanes(glm::vec2 center, glm::vec2 halfSize, glm::vec4 planes[6])
+{
+	planes[0] = { 1, 0, 0, -(center.x - halfSize.x) };
+	planes[1] = { -1, 0, 0, center.x + halfSize.x };
+	planes[2] = { 0, 1, 0, -(center.y - halfSize.y) };
+	planes[3] = { 0, -1, 0, center.y + halfSize.y };
+	planes[4] = { 0, 0, 1, 1 }; // near and far: everything close to the plane
+	planes[5] = { 0, 0, -1, 1 };
+}
+
+// the planes of the frustum of a viewProj matrix with Vulkan's clip space (z in [0, 1]), in the space the matrix transforms from
+// (Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix")
+void frustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6])
+{
+	const glm::mat4 m = glm::transpose(viewProj); // the rows
+	planes[0] = m[3] + m[0];
+	planes[1] = m[3] - m[0];
+	planes[2] = m[3] + m[1];
+	planes[3] = m[3] - m[1];
+	planes[4] = m[2];
+	planes[5] = m[3] - m[2];
+	for (u32 i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+// clears the counts before a culling pass that runs in cullStages: the compute pass of cmdCull, or any other shader that writes
+// the counts (e.g. a task shader). Must be recorded outside of a render pass
+void cmdResetCounts(Culler& c, VkCommandBuffer cmdBuffer, VkPipelineStageFlags cullStages)
+{
+	// the draws and the copies of the previous frame must have read the buffers before we overwrite them. An execution dependency is enough
+	vkCmdPipelineBarrier(cmdBuffer,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | cullStages, VK_PIPELINE_STAGE_TRANSFER_BIT | cullStages,
+		0, 0, nullptr, 0, nullptr, 0, nullptr);
+	vkCmdFillBuffer(cmdBuffer, c.countBuffer, 0, sizeof(Counts), 0);
+	const VkMemoryBarrier clearBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, cullStages,
+		0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+}
+
+// copies the counts to the readback slot of the frame, for the stats. The writes of the culling must be visible to transfer reads
+void cmdReadbackCounts(Culler& c, VkCommandBuffer cmdBuffer, u32 frameInd)
+{
+	const VkBufferCopy region = { .srcOffset = 0, .dstOffset = frameInd * sizeof(Counts), .size = sizeof(Counts) };
+	vkCmdCopyBuffer(cmdBuffer, c.countBuffer, c.readbackBuffer, 1, &region);
+	const VkMemoryBarrier readbackBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+	};
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &readbackBarrier, 0, nullptr, 0, nullptr);
+}
+
+// records the culling pass, which writes the draws of this frame. Must be recorded outside of a render pass
+// cameraPos is only used by the objects with a normal cone
+void cmdCull(Culler& c, VkCommandBuffer cmdBuffer, u32 frameInd, const glm::vec4 planes[6], glm::vec3 cameraPos = glm::vec3(0))
+{
+	if (c.numObjects == 0)
+		return;
+	cmdResetCounts(c, cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, c.pipeline);
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, c.pipelineLayout, 0, 1, &c.descSet, 0, nullptr);
+	PushConstants pushConstants = {
+		.cameraPos = glm::vec4(cameraPos, 1),
+		.numObjects = c.numObjects,
+		.compact = c.drawPath == DrawPath::INDIRECT_COUNT,
+	};
+	for (u32 i = 0; i < 6; i++)
+		pushConstants.planes[i] = planes[i];
+	vkCmdPushConstants(cmdBuffer, c.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+	vkCmdDispatch(cmdBuffer, (c.numObjects + LOCAL_SIZE - 1) / LOCAL_SIZE, 1, 1);
+
+	const VkMemoryBarrier drawBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+	};
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+	cmdReadbackCounts(c, cmdBuffer, frameInd);
+}
+
+// draws the visible objects. The bound pipeline must have the vertex and index buffers of the objects, and the data that they
+// find with firstInstance, already bound
+void cmdDraw(const Culler& c, VkCommandBuffer cmdBuffer)
+{
+	if (c.numObjects == 0)
+		return;
+	const u32 stride = sizeof(VkDrawIndexedIndirectCommand);
+	switch (c.drawPath) {
+	case DrawPath::INDIRECT_COUNT:
+		vkCmdDrawIndexedIndirectCount(cmdBuffer, c.drawCmdsBuffer, 0, c.countBuffer, 0, c.numObjects, stride);
+		break;
+	case DrawPath::MULTI_DRAW_INDIRECT:
+		for (u32 first = 0; first < c.numObjects; ) { // maxDrawCount is often ~0u, so first += maxDrawCount could wrap
+			const u32 count = glm::min(c.numObjects - first, c.maxDrawCount);
+			vkCmdDrawIndexedIndirect(cmdBuffer, c.drawCmdsBuffer, VkDeviceSize(first) * stride, count, stride);
+			first += count;
+		}
+		break;
+	case DrawPath::INDIRECT_LOOP:
+		for (u32 i = 0; i < c.numObjects; i++)
+			vkCmdDrawIndexedIndirect(cmdBuffer, c.drawCmdsBuffer, VkDeviceSize(i) * stride, 1, stride);
+		break;
+	}
+}
+
+// reads the counts of the last use of the frame slot. Must be called after waiting for the frame to finish
+void readStats(Culler& c, u32 frameInd)
+{
+	if (c.numObjects == 0)
+		return;
+	vmaInvalidateAllocation(c.allocator, c.readbackAlloc, frameInd * sizeof(Counts), sizeof(Counts));
+	c.numVisible = c.readbackData[frameInd].numDraws;
+	c.numVisibleIndices = c.readbackData[frameInd].numIndices;
+}
+
+} // namespace gpu_cull
+
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <imgui.h>
+#include <stdio.h>
+#include <string.h>
+#include "helpers.hpp"
+
+namespace
+{
+
+// GPU profiler based on timestamp queries
+// Each frame in flight has its own query pool. The results of a frame are read back when its slot is reused, at that point the frame has already been waited for so we never stall
+namespace gpu_prof {
+
+static constexpr u32 MAX_FRAMES = 4;
+static constexpr u32 MAX_SCOPES = 32;
+static constexpr u32 HISTORY_LEN = 128;
+
+struct Scope {
+	CStr name;
+	u32 depth;
+};
+
+struct FrameQueries {
+	VkQueryPool pool = VK_NULL_HANDLE;
+	Scope scopes[MAX_SCOPES];
+	u32 numScopes = 0;
+	bool pending = false; // true if the queries have been recorded and not read back yet
+};
+
+// rolling history of the durations of a named scope
+struct ScopeHistory {
+	CStr name;
+	u32 depth;
+	float ms[HISTORY_LEN];
+};
+
+struct Profiler {
+	bool enabled = false;
+	VkDevice device;
+	double timestampPeriodNs;
+	u64 timestampMask;
+	FrameQueries frames[MAX_FRAMES];
+	u32 numFrames = 0;
+	u32 curFrame = 0;
+	u32 scopeStack[MAX_SCOPES];
+	u32 scopeStackSize = 0;
+	std::vector<ScopeHistory> history;
+	u32 historyPos = 0;
+	FILE* traceFile = nullptr; // chrome://tracing format
+	u64 traceFirstTimestamp = 0;
+	u32 numTraceEvents = 0;
+};
+
+void init(Profiler& prof, VkDevice device, VkPhysicalDevice physicalDevice, const VkPhysicalDeviceProperties& props, u32 queueFamily, u32 numFrames, CStr traceFileName)
+{
+	assert(numFrames <= MAX_FRAMES);
+	VkQueueFamilyProperties familyProps[32];
+	u32 numFamilies = std::size(familyProps);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &numFamilies, familyProps);
+	const u32 validBits = familyProps[queueFamily].timestampValidBits;
+	if (validBits == 0) {
+		fprintf(stderr, "GPU profiler disabled: the queue doesn't support timestamps\n");
+		return;
+	}
+
+	prof.enabled = true;
+	prof.device = device;
+	prof.timestampPeriodNs = props.limits.timestampPeriod;
+	prof.timestampMask = validBits >= 64 ? ~u64(0) : (u64(1) << validBits) - 1;
+	prof.numFrames = numFrames;
+
+	const VkQueryPoolCreateInfo poolInfo = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = 2 * MAX_SCOPES,
+	};
+	for (u32 i = 0; i < numFrames; i++) {
+		VkResult vkRes = vkCreateQueryPool(device, &poolInfo, nullptr, &prof.frames[i].pool);
+		vk::assertRes(vkRes);
+	}
+
+	if (traceFileName) {
+		prof.traceFile = fopen(traceFileName, "w");
+		if (prof.traceFile)
+			fprintf(prof.traceFile, "{\"traceEvents\": [\n");
+		else
+			fprintf(stderr, "could not open the GPU trace file: %s\n", traceFileName);
+	}
+}
+
+void destroy(Profiler& prof)
+{
+	if (!prof.enabled)
+		return;
+	for (u32 i = 0; i < prof.numFrames; i++)
+		vkDestroyQueryPool(prof.device, prof.frames[i].pool, nullptr);
+	if (prof.traceFile) {
+		fprintf(prof.traceFile, "\n]}\n");
+		fclose(prof.traceFile);
+	}
+	prof = {};
+}
+
+ScopeHistory& findOrAddHistory(Profiler& prof, const Scope& scope)
+{
+	for (auto& h : prof.history) {
+		if (h.name == scope.name || strcmp(h.name, scope.name) == 0)
+			return h;
+	}
+	ScopeHistory& h = prof.history.emplace_back();
+	h.name = scope.name;
+	h.depth = scope.depth;
+	for (float& x : h.ms)
+		x = 0;
+	return h;
+}
+
+// read back the results of the last time this frame slot was used. Must be called after waiting for the frame to finish
+void readback(Profiler& prof, FrameQueries& frame)
+{
+	if (!frame.pending || frame.numScopes == 0)
+		return;
+
+	u64 timestamps[2 * MAX_SCOPES];
+	VkResult vkRes = vkGetQueryPoolResults(prof.device, frame.pool, 0, 2 * frame.numScopes,
+		sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT);
+	if (vkRes == VK_NOT_READY)
+		return; // shouldn't happen because the frame has finished, but we never want to stall
+	vk::assertRes(vkRes);
+	frame.pending = false;
+
+	if (prof.traceFirstTimestamp == 0)
+		prof.traceFirstTimestamp = timestamps[0] & prof.timestampMask;
+
+	// the scopes that weren't recorded in this frame must show 0, not what was there HISTORY_LEN frames ago
+	for (auto& h : prof.history)
+		h.ms[prof.historyPos] = 0;
+	for (u32 i = 0; i < frame.numScopes; i++) {
+		const Scope& scope = frame.scopes[i];
+		const u64 begin = timestamps[2 * i] & prof.timestampMask;
+		const u64 end = timestamps[2 * i + 1] & prof.timestampMask;
+		const double durationNs = double((end - begin) & prof.timestampMask) * prof.timestampPeriodNs;
+		findOrAddHistory(prof, scope).ms[prof.historyPos] += float(durationNs * 1e-6);
+
+		if (prof.traceFile) {
+			const double startUs = double((begin - prof.traceFirstTimestamp) & prof.timestampMask) * prof.timestampPeriodNs * 1e-3;
+			fprintf(prof.traceFile, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f}",
+				prof.numTraceEvents ? ",\n" : "", scope.name, startUs, durationNs * 1e-3);
+			prof.numTraceEvents++;
+		}
+	}
+	prof.historyPos = (prof.historyPos + 1) % HISTORY_LEN;
+}
+
+// the duration of the named scope in the last frame that has been read back, 0 if the scope hasn't been recorded yet
+float lastScopeMs(const Profiler& prof, CStr name)
+{
+	const u32 lastPos = (prof.historyPos + HISTORY_LEN - 1) % HISTORY_LEN;
+	for (const auto& h : prof.history) {
+		if (strcmp(h.name, name) == 0)
+			return h.ms[lastPos];
+	}
+	return 0;
+}
+
+// reads back the results of this frame slot and resets its queries. Must be called outside of a render pass
+void beginFrame(Profiler& prof, u32 frameInd, VkCommandBuffer cmdBuffer)
+{
+	if (!prof.enabled)
+		return;
+	prof.curFrame = frameInd;
+	FrameQueries& frame = prof.frames[frameInd];
+	readback(prof, frame);
+
+	vkCmdResetQueryPool(cmdBuffer, frame.pool, 0, 2 * MAX_SCOPES);
+	frame.numScopes = 0;
+	frame.pending = true;
+	prof.scopeStackSize = 0;
+}
+
+void beginScope(Profiler& prof, VkCommandBuffer cmdBuffer, CStr name)
+{
+	if (!prof.enabled)
+		return;
+	FrameQueries& frame = prof.frames[prof.curFrame];
+	assert(frame.numScopes < MAX_SCOPES);
+	const u32 scopeInd = frame.numScopes++;
+	frame.scopes[scopeInd] = { .name = name, .depth = prof.scopeStackSize };
+	prof.scopeStack[prof.scopeStackSize++] = scopeInd;
+	vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.pool, 2 * scopeInd);
+}
+
+void endScope(Profiler& prof, VkCommandBuffer cmdBuffer)
+{
+	if (!prof.enabled)
+		return;
+	FrameQueries& frame = prof.frames[prof.curFrame];
+	assert(prof.scopeStackSize > 0);
+	const u32 scopeInd = prof.scopeStack[--prof.scopeStackSize];
+	vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.pool, 2 * scopeInd + 1);
+}
+
+void drawImGuiWindow(const Profiler& prof)
+{
+	if (!ImGui::Begin("GPU profiler")) {
+		ImGui::End();
+		return;
+	}
+	if (!prof.enabled) {
+		ImGui::TextUnformatted("timestamp queries not supported");
+	}
+	for (const auto& h : prof.history) {
+		float avg = 0, maxMs = 0;
+		for (float x : h.ms) {
+			avg += x;
+			maxMs = glm::max(maxMs, x);
+		}
+		avg /= HISTORY_LEN;
+		const float indent = 16.f * h.depth;
+		if (indent > 0)
+			ImGui::Indent(indent);
+		ImGui::PushID(&h);
+		ImGui::Text("%s: %.3f ms (max %.3f)", h.name, avg, maxMs);
+		ImGui::PlotLines("##history", h.ms, HISTORY_LEN, prof.historyPos, nullptr, 0, maxMs * 1.2f, ImVec2(0, 32));
+		ImGui::PopID();
+		if (indent > 0)
+			ImGui::Unindent(indent);
+	}
+	ImGui::End();
+}
+
+} // namespace gpu_prof
+
+}
@@ -4,12 +4,19 @@
 #include <vma.h>
 #include <span>
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <functional>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <glm/glm.hpp>
 
 typedef uint8_t u8;
+typedef uint16_t u16;
+typedef int16_t i16;
 typedef uint32_t u32;
+typedef int32_t i32;
 typedef uint64_t u64;
 typedef const char* CStr;
 typedef const char* const ConstStr;
@@ -43,6 +50,15 @@ void assertRes(VkResult r)
 	assert(r == VK_SUCCESS);
 }
 
+void createSemaphores(VkDevice device, std::span<VkSemaphore> semaphores)
+{
+	const VkSemaphoreCreateInfo info = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, };
+	for (size_t i = 0; i < semaphores.size(); i++) {
+		VkResult vkRes = vkCreateSemaphore(device, &info, nullptr, &semaphores[i]);
+		assertRes(vkRes);
+	}
+}
+
 void createFences(VkDevice device, bool signaled, std::span<VkFence> fences)
 {
 	const VkFenceCreateInfo info = {
@@ -55,6 +71,38 @@ void createFences(VkDevice device, bool signaled, std::span<VkFence> fences)
 	}
 }
 
+// destroys resources once the GPU is done with them
+// each entry is tagged with a value (for example, the timeline value of the last submit that uses the resource) and is destroyed when that value has been completed
+struct DeletionQueue {
+	struct Entry {
+		u64 value;
+		std::function<void()> destroy;
+	};
+	std::deque<Entry> entries; // sorted by value
+
+	// the values don't need to be pushed in order: e.g. a resource used by the next submit can be queued before an older one
+	// entries with the same value are destroyed in the order they were pushed
+	void push(u64 value, std::function<void()> destroy)
+	{
+		const auto pos = std::upper_bound(entries.begin(), entries.end(), value,
+			[](u64 v, const Entry& entry) { return v < entry.value; });
+		entries.insert(pos, { value, std::move(destroy) });
+	}
+
+	void flush(u64 completedValue)
+	{
+		while (!entries.empty() && entries.front().value <= completedValue) {
+			entries.front().destroy();
+			entries.pop_front();
+		}
+	}
+
+	void flushAll()
+	{
+		flush(~u64(0));
+	}
+};
+
 [[nodiscard]]
 bool fenceIsSignaled(VkDevice device, VkFence fence)
 {
@@ -63,6 +111,71 @@ bool fenceIsSignaled(VkDevice device, VkFence fence)
 	return vkRes == VK_SUCCESS;
 }
 
+[[nodiscard]]
+VkSemaphore createTimelineSemaphore(VkDevice device, u64 initialValue = 0)
+{
+	const VkSemaphoreTypeCreateInfo typeInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = initialValue,
+	};
+	const VkSemaphoreCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &typeInfo,
+	};
+	VkSemaphore semaphore;
+	VkResult vkRes = vkCreateSemaphore(device, &info, nullptr, &semaphore);
+	assertRes(vkRes);
+	return semaphore;
+}
+
+// a timeline semaphore that is signaled by the submits of one queue, with monotonically increasing values
+// checking whether some work has finished is just comparing its value against the last completed one
+struct Timeline {
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	u64 lastSubmittedValue = 0;
+	u64 lastCompletedValue = 0; // cached, refreshed by updateCompletedValue()
+};
+
+// returns the value that the next submit must signal
+u64 nextTimelineValue(Timeline& timeline)
+{
+	return ++timeline.lastSubmittedValue;
+}
+
+u64 updateCompletedValue(VkDevice device, Timeline& timeline)
+{
+	u64 value;
+	VkResult vkRes = vkGetSemaphoreCounterValue(device, timeline.semaphore, &value);
+	assertRes(vkRes);
+	timeline.lastCompletedValue = glm::max(timeline.lastCompletedValue, value);
+	return timeline.lastCompletedValue;
+}
+
+// doesn't block. Only queries the semaphore if the cached value is not enough
+[[nodiscard]]
+bool timelineReached(VkDevice device, Timeline& timeline, u64 value)
+{
+	if (value <= timeline.lastCompletedValue)
+		return true;
+	return value <= updateCompletedValue(device, timeline);
+}
+
+void waitTimeline(VkDevice device, Timeline& timeline, u64 value)
+{
+	if (value <= timeline.lastCompletedValue)
+		return;
+	const VkSemaphoreWaitInfo waitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &timeline.semaphore,
+		.pValues = &value,
+	};
+	VkResult vkRes = vkWaitSemaphores(device, &waitInfo, -1);
+	assertRes(vkRes);
+	timeline.lastCompletedValue = value;
+}
+
 [[nodiscard]]
 VkInstance createInstance(u32 apiVersion, std::span<ConstStr> layerNames, std::span<ConstStr> extensionNames, CStr appName)
 {
@@ -81,7 +194,7 @@ VkInstance createInstance(u32 apiVersion, std::span<ConstStr> layerNames, std::s
 		.enabledLayerCount = u32(layerNames.size()),
 		.ppEnabledLayerNames = layerNames.data(),
 		.enabledExtensionCount = u32(extensionNames.size()),
-		.ppEnabledExtensionNames = &extensionNames[0],
+		.ppEnabledExtensionNames = extensionNames.data(),
 	};
 	VkInstance instance;
 	VkResult vkRes = vkCreateInstance(&info, nullptr, &instance);
@@ -158,9 +271,11 @@ u32 findGraphicsQueueFamily(VkPhysicalDevice physicalDevice, VkSurfaceKHR surfac
 
 	for (u32 i = 0; i < numQueueFamilies; i++) {
 		const bool supportsGraphics = props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT;
-		VkBool32 supportsSurface;
-		VkResult vkRes = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsSurface);
-		assertRes(vkRes);
+		VkBool32 supportsSurface = VK_TRUE; // when rendering headless (no surface) we only care about graphics
+		if (surface != VK_NULL_HANDLE) {
+			VkResult vkRes = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsSurface);
+			assertRes(vkRes);
+		}
 		if (supportsGraphics && supportsSurface)
 			return i;
 	}
@@ -168,12 +283,49 @@ u32 findGraphicsQueueFamily(VkPhysicalDevice physicalDevice, VkSurfaceKHR surfac
 	return 0;
 }
 
+// returns a family that only supports transfers (usually a DMA engine), so copies can run in parallel with rendering
+// if there isn't one, returns a family without graphics, or the graphics family as a fallback
+[[nodiscard]]
+u32 findTransferQueueFamily(VkPhysicalDevice physicalDevice, u32 graphicsFamily)
+{
+	VkQueueFamilyProperties props[32];
+	u32 numQueueFamilies = std::size(props);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &numQueueFamilies, props);
+
+	u32 bestFamily = graphicsFamily;
+	for (u32 i = 0; i < numQueueFamilies; i++) {
+		const VkQueueFlags flags = props[i].queueFlags;
+		if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+			continue;
+		if (!(flags & VK_QUEUE_COMPUTE_BIT))
+			return i;
+		bestFamily = i;
+	}
+	return bestFamily;
+}
+
+[[nodiscard]]
+bool deviceSupportsExtension(VkPhysicalDevice physicalDevice, CStr extensionName)
+{
+	u32 numExtensions = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &numExtensions, nullptr);
+	std::vector<VkExtensionProperties> extensions(numExtensions);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &numExtensions, extensions.data());
+	for (const VkExtensionProperties& ext : extensions) {
+		if (strcmp(ext.extensionName, extensionName) == 0)
+			return true;
+	}
+	return false;
+}
+
 struct CreateQueues {
 	u32 familyIndex;
 	std::span<const float> priorities;
 };
 [[nodiscard]]
-VkDevice createDevice(VkPhysicalDevice physicalDevice, std::span<const CreateQueues> createQueues, std::span<ConstStr> extensionNames)
+// features: optional pNext chain of feature structs (VkPhysicalDeviceFeatures2, VkPhysicalDeviceVulkan12Features, ...)
+VkDevice createDevice(VkPhysicalDevice physicalDevice, std::span<const CreateQueues> createQueues, std::span<ConstStr> extensionNames,
+	const void* features = nullptr)
 {
 	const float queuePriority = 0;
 	VkDeviceQueueCreateInfo queueCreateInfos[16];
@@ -190,12 +342,13 @@ VkDevice createDevice(VkPhysicalDevice physicalDevice, std::span<const CreateQue
 	
 	VkDeviceCreateInfo deviceCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+		.pNext = features,
 		.queueCreateInfoCount = u32(createQueues.size()),
 		.pQueueCreateInfos = queueCreateInfos,
 		.enabledLayerCount = 0,
 		.ppEnabledLayerNames = nullptr,
 		.enabledExtensionCount = u32(extensionNames.size()),
-		.ppEnabledExtensionNames = &extensionNames[0],
+		.ppEnabledExtensionNames = extensionNames.data(),
 	};
 	VkDevice device;
 	VkResult vkRes = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device);
@@ -207,12 +360,11 @@ struct Swapchain {
 	static constexpr u32 MAX_IMAGES = 16;
 	u32 numImages = 0;
 	u32 w, h;
+	VkPresentModeKHR presentMode;
 	VkSwapchainKHR swapchain = nullptr;
 	VkSurfaceFormatKHR format;
 	VkImageView imageViews[MAX_IMAGES];
-	VkSemaphore semaphore_swapchainImgAvailable[MAX_IMAGES];
-	VkSemaphore semaphore_drawFinished[MAX_IMAGES];
-	VkFence fence_queueWorkFinished[MAX_IMAGES];
+	VkSemaphore semaphore_drawFinished[MAX_IMAGES]; // per image, because the presentation engine holds it until the image is presented again
 };
 
 void create_swapChain(Swapchain& o, VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, u32 minImages, VkPresentModeKHR presentMode)
@@ -221,8 +373,13 @@ void create_swapChain(Swapchain& o, VkPhysicalDevice physicalDevice, VkDevice de
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps);
 	o.w = surfaceCaps.currentExtent.width;
 	o.h = surfaceCaps.currentExtent.height;
+	o.presentMode = presentMode;
 	const VkSwapchainKHR oldSwapchain = o.swapchain;
 
+	minImages = glm::max(minImages, surfaceCaps.minImageCount);
+	if (surfaceCaps.maxImageCount) // 0 means there is no limit
+		minImages = glm::min(minImages, surfaceCaps.maxImageCount);
+
 	VkSurfaceFormatKHR supportedFormats[64];
 	u32 numSupportedFormats = std::size(supportedFormats);
 	vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &numSupportedFormats, supportedFormats);
@@ -258,17 +415,8 @@ void create_swapChain(Swapchain& o, VkPhysicalDevice physicalDevice, VkDevice de
 	VkResult vkRes = vkCreateSwapchainKHR(device, &swapchainInfo, nullptr, &o.swapchain);
 	assertRes(vkRes);
 
-	// destroy old swapchain stuff
-	if (oldSwapchain != VK_NULL_HANDLE) {
-		//vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
-		for (u32 i = 0; i < o.numImages; i++) {
-			vkDestroySemaphore(device, o.semaphore_swapchainImgAvailable[i], nullptr);
-			vkDestroySemaphore(device, o.semaphore_drawFinished[i], nullptr);
-			vkDestroyFence(device, o.fence_queueWorkFinished[i], nullptr);
-
-			vkDestroyImageView(device, o.imageViews[i], nullptr);
-		}
-	}
+	// the old swapchain stuff is not destroyed here, because it could still be in use by the GPU
+	// the caller should keep a copy of the old Swapchain and call destroySwapchain() once the frames that use it have finished
 
 	// create image views
 	VkImage images[Swapchain::MAX_IMAGES];
@@ -299,20 +447,45 @@ void create_swapChain(Swapchain& o, VkPhysicalDevice physicalDevice, VkDevice de
 	}
 
 	// create semaphores
-	const VkSemaphoreCreateInfo semaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, };
-	for (u32 i = 0; i < o.numImages; i++) {
-		vkRes = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &o.semaphore_swapchainImgAvailable[i]);
-		assertRes(vkRes);
-		vkRes = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &o.semaphore_drawFinished[i]);
-		assertRes(vkRes);
+	createSemaphores(device, { o.semaphore_drawFinished, o.numImages });
+}
+
+[[nodiscard]]
+bool presentModeIsSupported(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPresentModeKHR presentMode)
+{
+	VkPresentModeKHR modes[16];
+	u32 numModes = std::size(modes);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &numModes, modes);
+	for (u32 i = 0; i < numModes; i++) {
+		if (modes[i] == presentMode)
+			return true;
 	}
+	return false;
+}
+
+CStr presentModeName(VkPresentModeKHR presentMode)
+{
+	switch (presentMode) {
+		case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+		case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+		case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+		default: return "OTHER";
+	}
+}
 
-	// create fences
-	createFences(device, true, { o.fence_queueWorkFinished, o.numImages });
+void destroySwapchain(VkDevice device, const Swapchain& o)
+{
+	for (u32 i = 0; i < o.numImages; i++) {
+		vkDestroySemaphore(device, o.semaphore_drawFinished[i], nullptr);
+		vkDestroyImageView(device, o.imageViews[i], nullptr);
+	}
+	vkDestroySwapchainKHR(device, o.swapchain, nullptr);
 }
 
 [[nodiscard]]
-VkRenderPass createSimpleRenderPass(VkDevice device, VkFormat colorAttachmentFormat)
+VkRenderPass createSimpleRenderPass(VkDevice device, VkFormat colorAttachmentFormat,
+	VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
 {
 	const VkAttachmentDescription attachment = {
 		.flags = 0,
@@ -323,7 +496,7 @@ VkRenderPass createSimpleRenderPass(VkDevice device, VkFormat colorAttachmentFor
 		//.stencilLoadOp = ,
 		//.stencilStoreOp = ,
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		.finalLayout = finalLayout,
 	};
 	const VkAttachmentReference attachmentRef = {
 			.attachment = 0,
@@ -359,6 +532,8 @@ struct ShaderStageInfo {
 };
 struct ShaderStages {
 	ShaderStageInfo vertex = {};
+	ShaderStageInfo task = {}; // task and mesh (VK_EXT_mesh_shader) replace the vertex shader and the vertex input
+	ShaderStageInfo mesh = {};
 	ShaderStageInfo fragment = {};
 };
 
@@ -412,12 +587,14 @@ struct CreateGraphicsPipeline {
 	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
 	VkCullModeFlagBits cullMode = VK_CULL_MODE_BACK_BIT;
 	bool faceClockwise = false;
+	bool depthTest = false; // depth test (LESS) and write. The renderPass must have a depth attachment
 	std::span<const VkPipelineColorBlendAttachmentState> attachmentsBlendInfos;
 	glm::vec4 blendConstants;
 	std::span<const VkDynamicState> dynamicStates;
 	VkPipelineLayout pipelineLayout;
 	VkRenderPass renderPass; // pipeline will be compatible with similar renderPassses
 	u32 subpass; // subpass index in the previous renderPass
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
 };
 
 [[nodiscard]]
@@ -443,6 +620,8 @@ VkPipeline createGraphicsPipeline(VkDevice device, const CreateGraphicsPipeline&
 	};
 		
 	appendShaderStageCreateInfo(params.shaderStages.vertex, VK_SHADER_STAGE_VERTEX_BIT);
+	appendShaderStageCreateInfo(params.shaderStages.task, VK_SHADER_STAGE_TASK_BIT_EXT);
+	appendShaderStageCreateInfo(params.shaderStages.mesh, VK_SHADER_STAGE_MESH_BIT_EXT);
 	appendShaderStageCreateInfo(params.shaderStages.fragment, VK_SHADER_STAGE_FRAGMENT_BIT);
 
 	const VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
@@ -481,6 +660,17 @@ VkPipeline createGraphicsPipeline(VkDevice device, const CreateGraphicsPipeline&
 		.lineWidth = 1,
 	};
 
+	const VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable = VK_TRUE,
+		.depthWriteEnable = VK_TRUE,
+		.depthCompareOp = VK_COMPARE_OP_LESS,
+		.depthBoundsTestEnable = VK_FALSE,
+		.stencilTestEnable = VK_FALSE,
+		.minDepthBounds = 0,
+		.maxDepthBounds = 1,
+	};
+
 	const auto& c = params.blendConstants;
 	const VkPipelineColorBlendStateCreateInfo colorBlendInfo = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
@@ -502,12 +692,12 @@ VkPipeline createGraphicsPipeline(VkDevice device, const CreateGraphicsPipeline&
 		.flags = 0,
 		.stageCount = numStages,
 		.pStages = shaderStageCreateInfos,
-		.pVertexInputState = &vertexInputInfo,
-		.pInputAssemblyState = &inputAssemplyInfo,
+		.pVertexInputState = params.shaderStages.mesh.module ? nullptr : &vertexInputInfo, // mesh shaders don't have vertex input
+		.pInputAssemblyState = params.shaderStages.mesh.module ? nullptr : &inputAssemplyInfo,
 		.pViewportState = &viewportInfo,
 		.pRasterizationState = &rasterizationInfo,
 		.pMultisampleState = nullptr,
-		.pDepthStencilState = nullptr,
+		.pDepthStencilState = params.depthTest ? &depthStencilInfo : nullptr,
 		.pColorBlendState = &colorBlendInfo,
 		.pDynamicState = &dynamicStateInfo,
 		.layout = params.pipelineLayout,
@@ -518,11 +708,119 @@ VkPipeline createGraphicsPipeline(VkDevice device, const CreateGraphicsPipeline&
 	};
 
 	VkPipeline pipeline;
-	VkResult vkRes = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+	VkResult vkRes = vkCreateGraphicsPipelines(device, params.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
 	assertRes(vkRes);
 	return pipeline;
 }
 
+[[nodiscard]]
+VkPipeline createComputePipeline(VkDevice device, const ShaderStageInfo& shader, VkPipelineLayout pipelineLayout, VkPipelineCache pipelineCache = VK_NULL_HANDLE)
+{
+	const VkComputePipelineCreateInfo pipelineInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shader.module,
+			.pName = "main",
+			.pSpecializationInfo = shader.specialization,
+		},
+		.layout = pipelineLayout,
+	};
+	VkPipeline pipeline;
+	VkResult vkRes = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+	assertRes(vkRes);
+	return pipeline;
+}
+
+// we prepend this header to the pipeline cache data saved to disk
+// the driver version is not part of the Vulkan cache header, but a driver update can make the cache useless, so we check it too
+struct PipelineCacheFileHeader {
+	u32 magic;
+	u32 vendorID;
+	u32 deviceID;
+	u32 driverVersion;
+	u8 pipelineCacheUUID[VK_UUID_SIZE];
+	u64 dataSize;
+};
+static constexpr u32 PIPELINE_CACHE_FILE_MAGIC = 0x50434B56; // "VKCP"
+
+bool pipelineCacheIsCompatible(const VkPhysicalDeviceProperties& props, std::span<const u8> fileData)
+{
+	if (fileData.size() < sizeof(PipelineCacheFileHeader))
+		return false;
+	PipelineCacheFileHeader header;
+	memcpy(&header, fileData.data(), sizeof(header));
+	if (header.magic != PIPELINE_CACHE_FILE_MAGIC ||
+		header.vendorID != props.vendorID ||
+		header.deviceID != props.deviceID ||
+		header.driverVersion != props.driverVersion ||
+		memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0 ||
+		header.dataSize != fileData.size() - sizeof(header))
+	{
+		return false;
+	}
+
+	// also validate the header that the driver writes at the beginning of the data
+	VkPipelineCacheHeaderVersionOne vkHeader;
+	if (header.dataSize < sizeof(vkHeader))
+		return false;
+	memcpy(&vkHeader, fileData.data() + sizeof(header), sizeof(vkHeader));
+	return vkHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		vkHeader.vendorID == props.vendorID &&
+		vkHeader.deviceID == props.deviceID &&
+		memcmp(vkHeader.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// creates a pipeline cache initialized with the data of the file, if it exists and is compatible with the device
+[[nodiscard]]
+VkPipelineCache loadPipelineCache(VkDevice device, const VkPhysicalDeviceProperties& props, CStr fileName)
+{
+	std::vector<u8> fileData;
+	const bool fileOk = loadBinaryFile(fileName, fileData) && pipelineCacheIsCompatible(props, fileData);
+	if (!fileOk)
+		fprintf(stderr, "no compatible pipeline cache found in \"%s\", starting with an empty cache\n", fileName);
+
+	const VkPipelineCacheCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = fileOk ? fileData.size() - sizeof(PipelineCacheFileHeader) : 0,
+		.pInitialData = fileOk ? fileData.data() + sizeof(PipelineCacheFileHeader) : nullptr,
+	};
+	VkPipelineCache cache;
+	VkResult vkRes = vkCreatePipelineCache(device, &info, nullptr, &cache);
+	assertRes(vkRes);
+	return cache;
+}
+
+void savePipelineCache(VkDevice device, VkPipelineCache cache, const VkPhysicalDeviceProperties& props, CStr fileName)
+{
+	size_t dataSize;
+	VkResult vkRes = vkGetPipelineCacheData(device, cache, &dataSize, nullptr);
+	assertRes(vkRes);
+	std::vector<u8> fileData(sizeof(PipelineCacheFileHeader) + dataSize);
+	vkRes = vkGetPipelineCacheData(device, cache, &dataSize, fileData.data() + sizeof(PipelineCacheFileHeader));
+	assertRes(vkRes);
+	fileData.resize(sizeof(PipelineCacheFileHeader) + dataSize);
+
+	PipelineCacheFileHeader header = {
+		.magic = PIPELINE_CACHE_FILE_MAGIC,
+		.vendorID = props.vendorID,
+		.deviceID = props.deviceID,
+		.driverVersion = props.driverVersion,
+		.dataSize = dataSize,
+	};
+	memcpy(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+	memcpy(fileData.data(), &header, sizeof(header));
+
+	FILE* file = fopen(fileName, "wb");
+	if (!file) {
+		fprintf(stderr, "could not save the pipeline cache to \"%s\"\n", fileName);
+		return;
+	}
+	fwrite(fileData.data(), 1, fileData.size(), file);
+	fclose(file);
+}
+
 VkCommandPool createCmdPool(VkDevice device, u32 queueFamilyInd, VkCommandPoolCreateFlags flags)
 {
 	const VkCommandPoolCreateInfo info = {
@@ -628,12 +926,29 @@ void createStaticVertexBuffer(VkDevice device, VmaAllocator allocator, size_t si
 	}
 }
 
+// a buffer in device local memory (when possible), that is filled through transfers (e.g. upload::copyToBuffer)
+void createDeviceBuffer(VmaAllocator allocator, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VmaAllocation& allocation)
+{
+	const VkBufferCreateInfo bufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	};
+	const VmaAllocationCreateInfo allocCreateInfo = {
+		.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+	};
+	VkResult vkRes = vmaCreateBuffer(allocator, &bufferInfo, &allocCreateInfo, &buffer, &allocation, nullptr);
+	assertRes(vkRes);
+}
+
 struct Img {
 	u32 width = 1;
 	u32 height = 1;
 	u32 layers = 1;
 	u32 mipLevels = -1;
 	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	bool generateMips = false; // the mip chain will be generated on the GPU from the level 0 (see cmdGenerateMips), so it needs TRANSFER_SRC usage
 };
 
 u32 getMaxMipLevels(u32 width, u32 height)
@@ -663,12 +978,48 @@ VkImageCreateInfo toImgCreateInfo(const Img& info)
 		.arrayLayers = info.layers,
 		.samples = VK_SAMPLE_COUNT_1_BIT,
 		.tiling = VK_IMAGE_TILING_OPTIMAL,
-		.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		.usage = info.usage,
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 	};
 	return imgInfo;
 }
 
+[[nodiscard]]
+VkImageView createImageView(VkDevice device, VkImage img, VkFormat format, const VkImageSubresourceRange& range,
+	VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D)
+{
+	const VkImageViewCreateInfo imgViewInfo = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = img,
+		.viewType = viewType,
+		.format = format,
+		.components = {VK_COMPONENT_SWIZZLE_IDENTITY},
+		.subresourceRange = range,
+	};
+	VkImageView view;
+	VkResult vkRes = vkCreateImageView(device, &imgViewInfo, nullptr, &view);
+	assertRes(vkRes);
+	return view;
+}
+
+VkImageAspectFlags formatAspects(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT;
+	case VK_FORMAT_S8_UINT:
+		return VK_IMAGE_ASPECT_STENCIL_BIT;
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	default:
+		return VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
+
 void createStaticImage(VkDevice device, VmaAllocator allocator, Img& info, VkImage& img, VmaAllocation& allocation, VmaAllocationInfo* allocInfo = nullptr, VkImageView* view = nullptr)
 {
 	VmaAllocationInfo allocInfoTmp;
@@ -676,6 +1027,8 @@ void createStaticImage(VkDevice device, VmaAllocator allocator, Img& info, VkIma
 		allocInfo = &allocInfoTmp;
 
 	clampMipLevels(info.mipLevels, info.width, info.height);
+	if (info.generateMips && info.mipLevels > 1)
+		info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
 	const VkImageCreateInfo createInfo = toImgCreateInfo(info);
 	const VmaAllocationCreateInfo allocCreateInfo = {
@@ -685,22 +1038,13 @@ void createStaticImage(VkDevice device, VmaAllocator allocator, Img& info, VkIma
 	assertRes(vkRes);
 
 	if (view) {
-		const VkImageViewCreateInfo imgViewInfo = {
-			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-			.image = img,
-			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.format = info.format,
-			.components = {VK_COMPONENT_SWIZZLE_IDENTITY},
-			.subresourceRange = {
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.baseMipLevel = 0,
-				.levelCount = info.mipLevels,
-				.baseArrayLayer = 0,
-				.layerCount = 1,
-			},
-		};
-		vkRes = vkCreateImageView(device, &imgViewInfo, nullptr, view);
-		vk::assertRes(vkRes);
+		*view = createImageView(device, img, info.format, {
+			.aspectMask = formatAspects(info.format),
+			.baseMipLevel = 0,
+			.levelCount = info.mipLevels,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		});
 	}
 }
 
@@ -720,6 +1064,99 @@ void createStagingBuffer(VkDevice device, VmaAllocator allocator, size_t size, V
 	assertRes(vkRes);
 }
 
+void cmdImageBarrier(VkCommandBuffer cmdBuffer, VkImage img, const VkImageSubresourceRange& range,
+	VkImageLayout oldLayout, VkImageLayout newLayout,
+	VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	const VkImageMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = srcAccess,
+		.dstAccessMask = dstAccess,
+		.oldLayout = oldLayout,
+		.newLayout = newLayout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = img,
+		.subresourceRange = range,
+	};
+	vkCmdPipelineBarrier(cmdBuffer,
+		srcStage, dstStage,
+		0, // VkDependencyFlags
+		0, nullptr, // memory barriers
+		0, nullptr, // buffer barriers
+		1, &barrier // img barriers
+	);
+}
+
+// true if the format can be used for generating mips with linear blits
+bool formatSupportsLinearBlit(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+	const VkFormatFeatureFlags required =
+		VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (props.optimalTilingFeatures & required) == required;
+}
+
+// generates the mip levels after range.baseMipLevel by blitting each level to the next one, with linear filtering
+// the cmd buffer must belong to a graphics queue. All the levels of the range must be in TRANSFER_DST_OPTIMAL, with the base level already written
+// at the end, all of them are in SHADER_READ_ONLY_OPTIMAL
+void cmdGenerateMips(VkCommandBuffer cmdBuffer, VkImage img, const VkImageSubresourceRange& range, u32 baseWidth, u32 baseHeight)
+{
+	VkImageSubresourceRange levelRange = range;
+	levelRange.levelCount = 1;
+	i32 w = i32(baseWidth), h = i32(baseHeight);
+	for (u32 i = 1; i < range.levelCount; i++) {
+		levelRange.baseMipLevel = range.baseMipLevel + i - 1;
+		cmdImageBarrier(cmdBuffer, img, levelRange,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+		const i32 nextW = glm::max(w / 2, 1);
+		const i32 nextH = glm::max(h / 2, 1);
+		const VkImageBlit blit = {
+			.srcSubresource = {
+				.aspectMask = range.aspectMask,
+				.mipLevel = range.baseMipLevel + i - 1,
+				.baseArrayLayer = range.baseArrayLayer,
+				.layerCount = range.layerCount,
+			},
+			.srcOffsets = {{0, 0, 0}, {w, h, 1}},
+			.dstSubresource = {
+				.aspectMask = range.aspectMask,
+				.mipLevel = range.baseMipLevel + i,
+				.baseArrayLayer = range.baseArrayLayer,
+				.layerCount = range.layerCount,
+			},
+			.dstOffsets = {{0, 0, 0}, {nextW, nextH, 1}},
+		};
+		vkCmdBlitImage(cmdBuffer,
+			img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+		w = nextW;
+		h = nextH;
+	}
+
+	// all the levels but the last one have been read from, so they are in TRANSFER_SRC_OPTIMAL
+	if (range.levelCount > 1) {
+		levelRange.baseMipLevel = range.baseMipLevel;
+		levelRange.levelCount = range.levelCount - 1;
+		cmdImageBarrier(cmdBuffer, img, levelRange,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+	levelRange.baseMipLevel = range.baseMipLevel + range.levelCount - 1;
+	levelRange.levelCount = 1;
+	cmdImageBarrier(cmdBuffer, img, levelRange,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
 VkDescriptorPool createDescriptorPool(VkDevice device, u32 maxSets, std::span<const VkDescriptorPoolSize> typeSizes)
 {
 	const VkDescriptorPoolCreateInfo descPoolInfo = {
@@ -753,7 +1190,7 @@ struct DescSetWriteTexture {
 	u32 binding = 0;
 };
 
-void writeTextureDescriptor(VkDevice device, VkDescriptorSet descSet, u32 binding, VkImageView imgView, VkSampler sampler)
+void writeTextureDescriptor(VkDevice device, VkDescriptorSet descSet, u32 binding, VkImageView imgView, VkSampler sampler, u32 arrayElement = 0)
 {
 	const VkDescriptorImageInfo descImgInfo = {
 		.sampler = sampler,
@@ -764,7 +1201,7 @@ void writeTextureDescriptor(VkDevice device, VkDescriptorSet descSet, u32 bindin
 		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 		.dstSet = descSet,
 		.dstBinding = binding,
-		.dstArrayElement = 0,
+		.dstArrayElement = arrayElement,
 		.descriptorCount = 1,
 		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 		.pImageInfo = &descImgInfo,
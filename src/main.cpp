@@ -2,21 +2,95 @@
 #define GLFW_INCLUDE_NONE // don't include OpenGL stuff
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
 #include "helpers.hpp"
-#include <stb_image.h>
+#include "bench.hpp"
+#include "gpu_profiler.hpp"
+#include "uploader.hpp"
+#include "texture_loader.hpp"
+#include "decode_pool.hpp"
+#include "texture_streamer.hpp"
+#include "atlas.hpp"
+#include "sprite_batcher.hpp"
+#include "gpu_culling.hpp"
+#include "mesh_viewer.hpp"
+#include "bindless.hpp"
+#include "pixel_convert.hpp"
+#include "sampler_cache.hpp"
+#include "residency.hpp"
+#include "virtual_texture.hpp"
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_vulkan.h>
 
-#define MY_VULKAN_VERSION VK_API_VERSION_1_1
+#define MY_VULKAN_VERSION VK_API_VERSION_1_2
 
 static constexpr u32 MIN_SWAPCHAIN_IMAGES = 2;
+static constexpr u32 MAX_FRAMES_IN_FLIGHT = 4;
+static constexpr u32 DEFAULT_SCREEN_W = 800;
+static constexpr u32 DEFAULT_SCREEN_H = 600;
+static constexpr VkFormat HEADLESS_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+static constexpr u32 DEFAULT_HEADLESS_FRAMES = 1000;
+static constexpr u32 BENCH_WARMUP_FRAMES = 30;
+static ConstStr PIPELINE_CACHE_FILE_NAME = "pipeline_cache.bin";
+static constexpr u64 STAGING_RING_SIZE = 32 << 20;
+static constexpr u32 NUM_DEMO_SPRITES = 1000;
+static constexpr u32 ATLAS_PAGE_SIZE = 1024;
+static constexpr u32 MAX_DEMO_SPRITE_SIZE = 40; // in pixels
+static constexpr float GPU_OBJECTS_SPACING = 0.25f; // the objects are in a grid, with this distance (in world units) between them
+static constexpr u32 MESH_VIEW_SIZE = 512; // of the offscreen target of the mesh viewer
+
+#ifdef VK_EXAMPLE_BENCH
+static constexpr bool BENCH_BUILD = true; // the benchmark target runs a fixed number of frames and reports timings as JSON
+#else
+static constexpr bool BENCH_BUILD = false;
+#endif
+
+// how many frames the CPU can record ahead of the GPU. More frames means more throughput, but also more latency
+static u32 numFramesInFlight = 2;
+// in headless mode there is no window nor swapchain: we render to offscreen images. Useful for benchmarking in machines without display
+static bool headless = false;
+static u32 maxFrames = 0; // 0 means no limit
+// latency profiles: they select the present mode and the number of swapchain images
+enum class LatencyProfile {
+	LOW_LATENCY, // MAILBOX or IMMEDIATE, with the minimum number of images
+	THROUGHPUT, // FIFO with triple buffering
+	POWER_SAVE, // FIFO with double buffering
+	COUNT
+};
+static ConstStr LATENCY_PROFILE_NAMES[] = { "low-latency", "throughput", "power-save" };
+static LatencyProfile latencyProfile = LatencyProfile::POWER_SAVE;
+
+static CStr gpuTraceFileName = nullptr; // GPU timestamps are exported to this file in chrome://tracing format
+static CStr benchOutputFileName = nullptr; // where to write the JSON timings report. If null, it's printed to stdout in bench builds
+// cooked textures are streamed progressively, uploading at most this many bytes per frame. 0 loads them all at once
+static u64 streamingBytesPerFrame = 64 << 10;
+static u64 vramBudgetOverride = 0; // if not 0, textures are evicted to stay under this many bytes of VRAM (if the real budget is not lower)
+static bool drawTentQuad = true;
+static CStr virtualTextureFileName = nullptr; // a virtual texture (cooked with texture_cooker --vt), drawn in the quad instead of the tent image
+static bool drawVirtualTexture = true;
+static float virtualTextureZoom = 1;
+static glm::vec2 virtualTextureCenter = { 0.5f, 0.5f }; // relative to the image
+static u32 numDemoSprites = 0; // sprites from the atlas drawn every frame, to measure the throughput of the sprite batcher
+static u32 numGpuObjects = 0; // objects drawn with GPU culling and indirect draws. 0 disables it
+static bool drawGpuObjects = true;
+static float gpuObjectsZoom = 1; // of the camera that flies over the objects
+static CStr meshFileName = nullptr; // an OBJ, optimized for the vertex cache and overdraw at load time, and shown in the "mesh" window
+static float meshRotationSpeed = 0.5f; // radians per second
+// the vertex layout of the mesh: float (32-bit floats, 32 bytes per vertex), half (half float positions and uvs, octahedral normals,
+// 16 bytes) or compact (16-bit SNORM/UNORM positions and uvs relative to their bounds, octahedral normals, 16 bytes)
+enum class MeshVertexFormat { FLOAT, HALF, COMPACT, COUNT };
+static ConstStr MESH_VERTEX_FORMAT_NAMES[] = { "float", "half", "compact" };
+static MeshVertexFormat meshVertexFormat = MeshVertexFormat::COMPACT;
 
 using glm::vec2;
 using glm::vec3;
 using glm::vec4;
 
 GLFWwindow* window;
+static decode::Pool decodePool;
 
 struct Buffer {
 	VkBuffer buffer;
@@ -24,10 +98,20 @@ struct Buffer {
 	VmaAllocationInfo allocInfo;
 };
 
-struct StagingProcess {
-	Buffer bufferInfo;
+// resources that are used by one frame in flight
+struct Frame {
 	VkCommandBuffer cmdBuffer;
-	VkFence fence; // this fence will be sigaled once the transfer has finished, so we can delete the buffer
+	u64 timelineValue = 0; // value of the graphics timeline signaled when the GPU finishes the frame
+	VkSemaphore semaphore_swapchainImgAvailable;
+	bench::Clock::time_point cpuStartTime; // used for measuring the latency until the GPU finishes the frame
+	bool submitted = false; // and the GPU hasn't been seen finishing it yet
+	double latencyMs = -1; // from cpuStartTime until the GPU was seen finishing the frame. Negative if not measured
+};
+
+// must match the push_constant block of objects_vert.glsl
+struct ObjectsPushConstants {
+	vec2 viewScale; // from world to clip space
+	vec2 viewOffset;
 };
 
 struct Img {
@@ -43,39 +127,540 @@ struct {
 	VkPhysicalDevice physicalDevice;
 	VkPhysicalDeviceProperties physicalDeviceProps;
 	VkPhysicalDeviceMemoryProperties physicalDeviceMemProps;
+	VkPhysicalDeviceFeatures enabledFeatures;
 	u32 queueFamily;
+	u32 transferQueueFamily; // same as queueFamily if the device doesn't have a dedicated transfer queue
 	VkDevice device;
 	VkQueue queue;
+	VkQueue transferQueue;
+	vk::Timeline timeline; // signaled by the graphics queue submits
+	vk::Timeline transferTimeline; // signaled by the transfer queue submits, only if it's a different queue
 	VmaAllocator allocator;
+	VkPipelineCache pipelineCache; // shared by all the pipelines, including imgui's. Saved to disk on exit
 	vk::Swapchain swapchain;
+	Img offscreenImgs[MAX_FRAMES_IN_FLIGHT]; // render targets used instead of the swapchain in headless mode
 	VkRenderPass renderPass;
 	VkPipelineLayout pipelineLayout;
 	VkPipeline pipeline;
 	VkCommandPool cmdPool;
-	std::vector<VkCommandBuffer> cmdBuffers;
+	Frame frames[MAX_FRAMES_IN_FLIGHT];
 	VkFramebuffer framebuffers[vk::Swapchain::MAX_IMAGES];
 	Buffer vertexBuffer;
-	std::vector<StagingProcess> stagingProcs;
+	upload::Uploader uploader;
 	Img tentImg;
-	VkSampler bilinearSampler;
-	VkDescriptorPool descPool;
-	VkDescriptorSetLayout descriptorSetLayout;
-	VkDescriptorSet descSet;
+	vk::Img tentImgInfo;
+	stream::Streamer streamer;
+	stream::Texture tentStream; // used instead of tentImg when the tent image is streamed
+	bool tentImgStreamed = false;
+	bool tentImgReady = false; // the image is loaded asynchronously, we don't draw it until it's ready
+	bool tentImgFailed = false; // neither the cooked image nor the decoded one could be loaded
+	// the view of the tent image changes while it's being streamed, so each frame in flight has its own slot in the texture table
+	// (and its own imgui descriptor set) which is updated once the frame's previous use has finished
+	u32 tentTexInds[MAX_FRAMES_IN_FLIGHT];
+	VkDescriptorSet imguiTentTex[MAX_FRAMES_IN_FLIGHT];
+	VkImageView frameTentViews[MAX_FRAMES_IN_FLIGHT]; // the view written in the slots of each frame
+	atlas::Atlas spriteAtlas;
+	std::vector<VkDescriptorSet> imguiAtlasPages;
+	std::vector<u32> atlasTexInds; // of the pages, in the texture table
+	sprites::Batcher spriteBatcher; // the tent quad and the demo sprites
+	double spritesCpuMs = 0; // time spent writing the sprite instances in the last frame
+	// the objects drawn with GPU culling: a grid of sprites from the atlas, each one an indexed quad
+	gpu_cull::Culler culler;
+	Buffer objectsIndexBuffer;
+	Buffer objectsInstanceBuffer; // a sprites::Instance per object, selected with the firstInstance of its draw
+	VkPipelineLayout objectsPipelineLayout;
+	VkPipeline objectsPipeline;
+	mesh_view::Viewer meshViewer;
+	mesh::OptimizeStats meshStats;
+	VkDescriptorSet imguiMeshTex;
+	float meshAngle = 0;
+	bool meshVisible = false; // the mesh window is open, so the mesh is rendered this frame
+	residency::Manager residency;
+	residency::Texture tentResidency;
+	residency::Texture atlasResidency;
+	vt::VirtualTexture virtualTexture;
+	VkPipelineLayout vtPipelineLayout;
+	VkPipeline vtPipeline;
+	samplers::Cache samplers;
+	VkSampler trilinearSampler; // from the cache. Also baked in the texture table as immutable sampler
+	VkDescriptorPool descPool; // for imgui
+	bindless::Table textures; // all the textures used by our shaders, bound once per frame
+	gpu_prof::Profiler gpuProfiler;
+	vk::DeletionQueue deletionQueue; // values are graphics timeline values
+	bool swapchainNeedsRecreate = false;
 } vkd;
 
 static void onWindowResized(GLFWwindow* window, int w, int h)
 {
-	vkDeviceWaitIdle(vkd.device);
-	vk::create_swapChain(vkd.swapchain, vkd.physicalDevice, vkd.device, vkd.surface, 2, VK_PRESENT_MODE_FIFO_KHR);
-	for (u32 i = 0; i < vkd.swapchain.numImages; i++) {
-		vkDestroyFramebuffer(vkd.device, vkd.framebuffers[i], nullptr);
+	// we don't recreate the swapchain here, because this can be called many times per frame while resizing
+	// the frame loop will recreate it once
+	vkd.swapchainNeedsRecreate = true;
+}
+
+static void chooseSwapchainConfig(LatencyProfile profile, VkPresentModeKHR& presentMode, u32& minImages)
+{
+	switch (profile) {
+	case LatencyProfile::LOW_LATENCY:
+		minImages = 0; // will be clamped to the minimum supported
+		if (vk::presentModeIsSupported(vkd.physicalDevice, vkd.surface, VK_PRESENT_MODE_MAILBOX_KHR))
+			presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+		else if (vk::presentModeIsSupported(vkd.physicalDevice, vkd.surface, VK_PRESENT_MODE_IMMEDIATE_KHR))
+			presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+		else
+			presentMode = VK_PRESENT_MODE_FIFO_KHR;
+		break;
+	case LatencyProfile::THROUGHPUT:
+		minImages = 3;
+		presentMode = VK_PRESENT_MODE_FIFO_KHR; // FIFO is always supported
+		break;
+	default:
+		minImages = MIN_SWAPCHAIN_IMAGES;
+		presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	}
+}
+
+static void createSwapchain()
+{
+	VkPresentModeKHR presentMode;
+	u32 minImages;
+	chooseSwapchainConfig(latencyProfile, presentMode, minImages);
+	vk::create_swapChain(vkd.swapchain, vkd.physicalDevice, vkd.device, vkd.surface, minImages, presentMode);
+}
+
+// recreates the swapchain without waiting for the GPU
+// the old swapchain and its framebuffers are destroyed once the frames that could be using them have finished
+static void recreateSwapchain()
+{
+	const vk::Swapchain oldSwapchain = vkd.swapchain;
+	VkFramebuffer oldFramebuffers[vk::Swapchain::MAX_IMAGES];
+	for (u32 i = 0; i < oldSwapchain.numImages; i++) {
+		oldFramebuffers[i] = vkd.framebuffers[i];
 		vkd.framebuffers[i] = VK_NULL_HANDLE;
 	}
+
+	createSwapchain();
+	vkd.swapchainNeedsRecreate = false;
+
+	const VkDevice device = vkd.device;
+	vkd.deletionQueue.push(vkd.timeline.lastSubmittedValue, [device, oldSwapchain, oldFramebuffers]() {
+		for (u32 i = 0; i < oldSwapchain.numImages; i++) {
+			if (oldFramebuffers[i] != VK_NULL_HANDLE)
+				vkDestroyFramebuffer(device, oldFramebuffers[i], nullptr);
+		}
+		vk::destroySwapchain(device, oldSwapchain);
+	});
+}
+
+static VkImageView tentImgView()
+{
+	return vkd.tentImgStreamed ? stream::currentView(vkd.tentStream) : vkd.tentImg.view;
+}
+
+// makes the tent image visible, once its upload has been recorded
+static void onTentImgCreated()
+{
+	const VkImageView view = tentImgView();
+	if (vkd.imguiTentTex[0] == VK_NULL_HANDLE) {
+		for (u32 i = 0; i < numFramesInFlight; i++) {
+			vkd.imguiTentTex[i] = ImGui_ImplVulkan_AddTexture(vkd.trilinearSampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			vkd.tentTexInds[i] = bindless::add(vkd.textures, view, vkd.trilinearSampler);
+			vkd.frameTentViews[i] = view;
+		}
+	}
+	else { // reloaded after an eviction: the descriptors of each frame are rewritten when the frame comes around
+		for (u32 i = 0; i < numFramesInFlight; i++)
+			vkd.frameTentViews[i] = VK_NULL_HANDLE;
+	}
+	vkd.tentImgReady = true;
+}
+
+// (re)loads the cooked tent image, streamed unless the streaming budget is 0. Returns false if there is no usable cooked image
+static bool loadCookedTentImg()
+{
+	if (streamingBytesPerFrame &&
+		stream::open(vkd.streamer, vkd.tentStream, vkd.physicalDevice, vkd.enabledFeatures, "data/tent.tex"))
+	{
+		vkd.tentImgStreamed = true;
+		vkd.tentImgInfo = vkd.tentStream.info;
+	}
+	else if (tex::loadCookedTexture(vkd.uploader, vkd.physicalDevice, vkd.enabledFeatures, "data/tent.tex",
+		vkd.tentImgInfo, vkd.tentImg.img, vkd.tentImg.alloc, &vkd.tentImg.allocInfo, &vkd.tentImg.view))
+	{
+		vkd.tentImgStreamed = false;
+	}
+	else {
+		return false;
+	}
+	onTentImgCreated();
+	return true;
+}
+
+static u64 tentImgBytes()
+{
+	return residency::allocationSize(vkd.allocator, vkd.tentImgStreamed ? vkd.tentStream.alloc : vkd.tentImg.alloc);
 }
 
-static void recordDrawCmdBuffer(u32 cmdBufferInd, u32 screenW, u32 screenH)
+// the image is destroyed once the frames that could use it have finished
+// that includes the frame being prepared: its upload batch and acquire barriers could still reference the image
+static void evictTentImg()
+{
+	vkd.tentImgReady = false;
+	const u64 lastUseValue = vkd.timeline.lastSubmittedValue + 1;
+	if (vkd.tentImgStreamed) {
+		stream::stopStreaming(vkd.streamer, vkd.tentStream);
+		vkd.deletionQueue.push(lastUseValue, [tex = vkd.tentStream]() mutable {
+			stream::destroy(vkd.streamer, tex);
+		});
+		vkd.tentStream = {};
+	}
+	else {
+		vkd.deletionQueue.push(lastUseValue, [img = vkd.tentImg]() {
+			vkDestroyImageView(vkd.device, img.view, nullptr);
+			vmaDestroyImage(vkd.allocator, img.img, img.alloc);
+		});
+		vkd.tentImg = {};
+	}
+}
+
+// the descriptors of a frame can only be updated once the GPU has finished its previous use
+static void updateFrameDescriptors(u32 frameInd)
+{
+	const VkImageView view = tentImgView();
+	if (!vkd.tentImgReady || vkd.frameTentViews[frameInd] == view)
+		return;
+	vk::writeTextureDescriptor(vkd.device, vkd.imguiTentTex[frameInd], 0, view, vkd.trilinearSampler);
+	bindless::write(vkd.textures, vkd.tentTexInds[frameInd], view, vkd.trilinearSampler);
+	vkd.frameTentViews[frameInd] = view;
+}
+
+// creates the tent image from the decoded pixels, generating the mip chain on the GPU
+// timestamps the frames that the GPU has finished since the last poll. It's polled a few times per frame, so the latency is
+// not rounded up to the time the frame slot is reused (about numFramesInFlight frames later)
+static void pollFrameLatencies()
+{
+	const u64 completedValue = vk::updateCompletedValue(vkd.device, vkd.timeline);
+	for (u32 i = 0; i < numFramesInFlight; i++) {
+		Frame& frame = vkd.frames[i];
+		if (frame.submitted && frame.timelineValue <= completedValue) {
+			frame.latencyMs = bench::elapsedMs(frame.cpuStartTime);
+			frame.submitted = false;
+		}
+	}
+}
+
+// the pixels are converted to RGBA straight into staging memory, and freed right after
+// returns false if the upload queue can't copy an image that big, in that case nothing is created
+static bool createTentImgFromPixels(decode::Image& decoded)
+{
+	const u32 w = decoded.width, h = decoded.height;
+	const size_t dataSize = size_t(w) * size_t(h) * 4;
+	if (!upload::canCopyToImage(vkd.uploader, h, dataSize))
+		return false;
+	// full mip chain, generated on the GPU. Without it, minifying the image aliases and thrashes the texture cache
+	const bool canGenerateMips = vk::formatSupportsLinearBlit(vkd.physicalDevice, VK_FORMAT_R8G8B8A8_SRGB);
+	vk::Img& imgInfo = vkd.tentImgInfo;
+	imgInfo = {
+		.width = w,
+		.height = h,
+		.mipLevels = canGenerateMips ? vk::getMaxMipLevels(w, h) : 1,
+		.generateMips = canGenerateMips,
+	};
+	vk::createStaticImage(vkd.device, vkd.allocator, imgInfo, vkd.tentImg.img, vkd.tentImg.alloc, &vkd.tentImg.allocInfo, &vkd.tentImg.view);
+
+	const VkImageSubresourceRange imgSubresRange = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.baseMipLevel = 0,
+		.levelCount = imgInfo.mipLevels,
+		.baseArrayLayer = 0,
+		.layerCount = 1,
+	};
+	upload::prepareImage(vkd.uploader, vkd.tentImg.img, imgSubresRange);
+	// in pieces of rows: the image can be bigger than the staging ring
+	const u32 srcChannels = decoded.numChannels;
+	upload::copyToImage(vkd.uploader, vkd.tentImg.img, 0, 0, {0, 0}, {w, h}, dataSize, 1,
+		[&](u8* dst, u32 firstRow, u32 numRows) {
+			const u8* src = decoded.pixels + size_t(firstRow) * w * srcChannels;
+			if (srcChannels == 3)
+				pixconv::convertRows(pixconv::kernels().rgbToRgba, dst, 4 * w, src, 3 * w, w, numRows, 4, 3);
+			else
+				memcpy(dst, src, size_t(numRows) * w * 4);
+		});
+	decode::freePixels(decoded);
+	upload::finishImageWithMips(vkd.uploader, vkd.tentImg.img, imgSubresRange, {w, h});
+	return true;
+}
+
+// procedural sprites (discs of random sizes and colors), standing in for lots of small icons, packed in an atlas
+static void buildDemoAtlas()
+{
+	u32 seed = 1;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	};
+	std::vector<std::vector<u8>> pixels(NUM_DEMO_SPRITES);
+	std::vector<atlas::SourceImage> images(NUM_DEMO_SPRITES);
+	for (u32 i = 0; i < NUM_DEMO_SPRITES; i++) {
+		const u32 w = 8 + random() % (MAX_DEMO_SPRITE_SIZE - 7);
+		const u32 h = 8 + random() % (MAX_DEMO_SPRITE_SIZE - 7);
+		const u8 color[3] = { u8(random()), u8(random()), u8(random()) };
+		pixels[i].resize(size_t(w) * h * 4);
+		for (u32 y = 0; y < h; y++)
+		for (u32 x = 0; x < w; x++) {
+			const vec2 p = (vec2(x, y) + 0.5f) / vec2(w, h) * 2.f - 1.f;
+			u8* texel = &pixels[i][(size_t(y) * w + x) * 4];
+			texel[0] = color[0];
+			texel[1] = color[1];
+			texel[2] = color[2];
+			texel[3] = glm::dot(p, p) <= 1.f ? 255 : 0;
+		}
+		images[i] = { w, h, pixels[i].data() };
+	}
+	atlas::build(vkd.spriteAtlas, vkd.uploader, images, ATLAS_PAGE_SIZE);
+
+	for (VkImageView view : vkd.spriteAtlas.layerViews) {
+		vkd.imguiAtlasPages.push_back(ImGui_ImplVulkan_AddTexture(vkd.trilinearSampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+		vkd.atlasTexInds.push_back(bindless::add(vkd.textures, view, vkd.trilinearSampler));
+	}
+}
+
+static u64 loadDemoAtlas()
+{
+	buildDemoAtlas();
+	return residency::allocationSize(vkd.allocator, vkd.spriteAtlas.alloc);
+}
+
+static void evictDemoAtlas()
+{
+	const u64 lastUseValue = vkd.timeline.lastSubmittedValue + 1; // see evictTentImg()
+	vkd.deletionQueue.push(lastUseValue, [atlas = vkd.spriteAtlas, imguiPages = vkd.imguiAtlasPages, texInds = vkd.atlasTexInds]() mutable {
+		for (VkDescriptorSet set : imguiPages)
+			ImGui_ImplVulkan_RemoveTexture(set);
+		for (u32 texInd : texInds)
+			bindless::release(vkd.textures, texInd);
+		atlas::destroy(atlas, vkd.device, vkd.allocator);
+	});
+	vkd.spriteAtlas = {};
+	vkd.imguiAtlasPages.clear();
+	vkd.atlasTexInds.clear();
+}
+
+static void drawAtlasImGuiWindow()
+{
+	static int pageInd = 0;
+	const auto& atlas = vkd.spriteAtlas;
+	if (!ImGui::Begin("atlas")) { // collapsed: the atlas is not used, so it can be evicted
+		ImGui::End();
+		return;
+	}
+	residency::touch(vkd.residency, vkd.atlasResidency);
+	ImGui::Text("%zu images in %u pages of %ux%u", atlas.entries.size(), atlas.numPages, atlas.pageSize, atlas.pageSize);
+	ImGui::Text("sprite batcher: %u instances in %u draws", vkd.spriteBatcher.numDrawnInstances, vkd.spriteBatcher.numDraws);
+	if (atlas.numPages > 1)
+		ImGui::SliderInt("page", &pageInd, 0, int(atlas.numPages) - 1);
+	ImGui::Image(ImTextureID(vkd.imguiAtlasPages[pageInd]), { 256, 256 });
+	// some of the images, drawn from the atlas with their remapped uvs
+	for (u32 i = 0; i < 32 && i < atlas.entries.size(); i++) {
+		const atlas::Entry& e = atlas.entries[i];
+		if (i % 8)
+			ImGui::SameLine();
+		ImGui::Image(ImTextureID(vkd.imguiAtlasPages[e.layer]), { 24, 24 }, { e.uvMin.x, e.uvMin.y }, { e.uvMax.x, e.uvMax.y });
+	}
+	ImGui::End();
+}
+
+// a grid of sprites from the atlas. The atlas must be resident
+static void createGpuObjects()
+{
+	const auto& atlas = vkd.spriteAtlas;
+	const u32 numObjects = glm::min(numGpuObjects, vkd.culler.capacity);
+	const u32 side = u32(glm::ceil(glm::sqrt(double(numObjects))));
+	const float pixelSize = 0.9f * GPU_OBJECTS_SPACING / MAX_DEMO_SPRITE_SIZE; // the biggest images almost fill their cell
+	std::vector<sprites::Instance> instances(numObjects);
+	std::vector<gpu_cull::Object> objects(numObjects);
+	for (u32 i = 0; i < numObjects; i++) {
+		const atlas::Entry& e = atlas.entries[i % atlas.entries.size()];
+		const vec2 center = (vec2(i % side, i / side) - 0.5f * float(side - 1)) * GPU_OBJECTS_SPACING;
+		const vec2 halfSize = 0.5f * (e.uvMax - e.uvMin) * float(atlas.pageSize) * pixelSize;
+		instances[i] = {
+			.pos = center,
+			.axisX = { halfSize.x, 0 },
+			.axisY = { 0, halfSize.y },
+			.uvRect = vec4(e.uvMin, e.uvMax),
+			.textureInd = vkd.atlasTexInds[e.layer],
+		};
+		objects[i] = {
+			.sphere = vec4(center, 0, glm::length(halfSize)),
+			.cone = { 0, 0, 0, 1 }, // the sprites don't have a back side
+			.indexCount = 6,
+			.firstIndex = 0,
+			.vertexOffset = 0,
+			.firstInstance = i,
+		};
+	}
+	// the quad of sprite_batcher.hpp, as an indexed triangle list with the same winding as the strip
+	const u16 indices[] = { 0, 1, 2, 2, 1, 3 };
+	vk::createDeviceBuffer(vkd.allocator, sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		vkd.objectsIndexBuffer.buffer, vkd.objectsIndexBuffer.alloc);
+	upload::copyToBuffer(vkd.uploader, vkd.objectsIndexBuffer.buffer, 0, indices, sizeof(indices));
+	const u64 instancesSize = instances.size() * sizeof(sprites::Instance);
+	vk::createDeviceBuffer(vkd.allocator, glm::max<u64>(instancesSize, 1), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		vkd.objectsInstanceBuffer.buffer, vkd.objectsInstanceBuffer.alloc);
+	upload::copyToBuffer(vkd.uploader, vkd.objectsInstanceBuffer.buffer, 0, instances.data(), instancesSize);
+	gpu_cull::setObjects(vkd.culler, vkd.uploader, objects);
+}
+
+// the camera flies over the grid of objects
+static void gpuObjectsView(u32 screenW, u32 screenH, vec2& center, vec2& halfSize)
+{
+	static const auto animStartTime = bench::Clock::now();
+	const float time = float(bench::elapsedMs(animStartTime) * 1e-3);
+	const float gridSize = glm::ceil(glm::sqrt(float(vkd.culler.numObjects))) * GPU_OBJECTS_SPACING;
+	center = 0.4f * gridSize * vec2(glm::sin(0.05f * time), glm::sin(0.07f * time));
+	halfSize = vec2(float(screenW) / float(screenH), 1) / gpuObjectsZoom;
+}
+
+static void drawGpuCullingImGuiWindow()
+{
+	const gpu_cull::Culler& culler = vkd.culler;
+	if (culler.numObjects == 0)
+		return;
+	ImGui::Begin("GPU culling");
+	ImGui::Checkbox("draw", &drawGpuObjects);
+	ImGui::SliderFloat("zoom", &gpuObjectsZoom, 0.01f, 4, "%.2f", ImGuiSliderFlags_Logarithmic);
+	ImGui::Text("objects: %u visible / %u", culler.numVisible, culler.numObjects);
+	ImGui::Text("draw path: %s", gpu_cull::DRAW_PATH_NAMES[u32(culler.drawPath)]);
+	ImGui::End();
+}
+
+// the triangles and the vertices are reordered for the GPU, and the ACMR (vertex shader invocations per triangle) is reported
+// then the mesh is split in meshlets, for culling it by clusters
+static bool loadMesh(CStr fileName, mesh::Mesh& m, meshlets::Meshlets& ml)
+{
+	const auto startTime = bench::Clock::now();
+	if (!mesh::loadObj(m, fileName))
+		return false;
+	const double loadMs = bench::elapsedMs(startTime);
+	const auto optimizeStartTime = bench::Clock::now();
+	vkd.meshStats = mesh::optimize(m);
+	fprintf(stderr, "mesh %s: %zu triangles, %zu vertices, loaded in %.2f ms; ACMR %.3f -> %.3f (FIFO of %u), %u overdraw clusters, optimized in %.2f ms\n",
+		fileName, m.indices.size() / 3, m.vertices.size(), loadMs, vkd.meshStats.acmrBefore, vkd.meshStats.acmrAfter, mesh::ACMR_CACHE_SIZE,
+		vkd.meshStats.numClusters, bench::elapsedMs(optimizeStartTime));
+	const auto meshletsStartTime = bench::Clock::now();
+	ml = meshlets::build(m);
+	fprintf(stderr, "mesh meshlets: %zu (up to %u vertices and %u triangles), %.1f triangles and %.1f vertices per meshlet, built in %.2f ms\n",
+		ml.meshlets.size(), meshlets::MAX_VERTICES, meshlets::MAX_TRIANGLES, m.indices.size() / 3.0 / ml.meshlets.size(),
+		double(ml.vertices.size()) / ml.meshlets.size(), bench::elapsedMs(meshletsStartTime));
+	return true;
+}
+
+static void drawMeshImGuiWindow()
+{
+	vkd.meshVisible = false;
+	const mesh_view::Viewer& viewer = vkd.meshViewer;
+	if (viewer.numIndices == 0)
+		return;
+	if (ImGui::Begin("mesh")) {
+		vkd.meshVisible = true; // rendered before the main pass of this frame, which draws the window
+		vkd.meshAngle += meshRotationSpeed * ImGui::GetIO().DeltaTime;
+		ImGui::Image(ImTextureID(vkd.imguiMeshTex), { 256, 256 });
+		ImGui::SliderFloat("rotation speed", &meshRotationSpeed, 0, 4);
+		ImGui::Text("%u triangles, %u vertices, %s indices", viewer.numIndices / 3, viewer.numVertices,
+			viewer.indexType == VK_INDEX_TYPE_UINT16 ? "16-bit" : "32-bit");
+		ImGui::Text("ACMR: %.3f -> %.3f, %u overdraw clusters", vkd.meshStats.acmrBefore, vkd.meshStats.acmrAfter, vkd.meshStats.numClusters);
+		ImGui::Text("vertex format: %s, %u bytes per vertex, %.1f KB", MESH_VERTEX_FORMAT_NAMES[u32(meshVertexFormat)], viewer.layout.stride,
+			viewer.vertexBufferSize / 1024.0);
+		if (ImGui::BeginCombo("render path", mesh_view::RENDER_PATH_NAMES[u32(viewer.renderPath)])) {
+			for (u32 i = 0; i < u32(mesh_view::RenderPath::COUNT); i++) {
+				const auto path = mesh_view::RenderPath(i);
+				if (mesh_view::renderPathIsSupported(viewer, path) && ImGui::Selectable(mesh_view::RENDER_PATH_NAMES[i], path == viewer.renderPath))
+					vkd.meshViewer.renderPath = path;
+			}
+			ImGui::EndCombo();
+		}
+		if (viewer.renderPath != mesh_view::RenderPath::INDEXED) {
+			// the counts of the culling are read back a few frames late
+			const gpu_cull::Culler& culler = viewer.culler;
+			ImGui::Text("meshlets: %u visible / %u", culler.numVisible, culler.numObjects);
+			ImGui::Text("triangles: %llu drawn / %llu, %llu culled", (unsigned long long)(culler.numVisibleIndices / 3),
+				(unsigned long long)(culler.numIndices / 3), (unsigned long long)((culler.numIndices - culler.numVisibleIndices) / 3));
+			if (viewer.renderPath == mesh_view::RenderPath::CLUSTER_CULLING)
+				ImGui::Text("draw path: %s", gpu_cull::DRAW_PATH_NAMES[u32(culler.drawPath)]);
+		}
+	}
+	ImGui::End();
+}
+
+static void drawVirtualTextureImGuiWindow()
+{
+	const vt::VirtualTexture& virtualTex = vkd.virtualTexture;
+	if (!virtualTex.file)
+		return;
+	ImGui::Begin("virtual texture");
+	ImGui::Checkbox("draw", &drawVirtualTexture);
+	ImGui::SliderFloat("zoom", &virtualTextureZoom, 1, float(virtualTex.header.pagesPerSide * 4), "%.1f", ImGuiSliderFlags_Logarithmic);
+	ImGui::SliderFloat2("center", &virtualTextureCenter.x, 0, 1);
+	ImGui::Text("%ux%u, %s, %u levels of %ux%u pages", virtualTex.header.width, virtualTex.header.height, texc::formatName(VkFormat(virtualTex.header.format)),
+		virtualTex.header.numLevels, virtualTex.header.pageSize, virtualTex.header.pageSize);
+	ImGui::Text("pages: %u requested, %u/%zu resident, %u loaded in the last frame", virtualTex.numRequestedPages, virtualTex.numResidentPages,
+		virtualTex.slots.size(), virtualTex.numPagesLoaded);
+	ImGui::Text("read from disk: %.1f MB", virtualTex.bytesRead / (1024.0 * 1024.0));
+	ImGui::End();
+}
+
+// the quad in the middle of the screen, where the tent image or the virtual texture are drawn
+static const sprites::Instance QUAD_INSTANCE = {
+	.pos = { 0, 0 },
+	.axisX = { 0.8f, 0 },
+	.axisY = { 0, 0.8f },
+	.uvRect = { 0, 0, 1, 1 },
+	.textureInd = 0,
+};
+
+// the demo sprites bounce around the screen, spinning. Their sizes are the sizes of their images in the atlas, in pixels
+static void writeDemoSprites(u32 screenW, u32 screenH)
+{
+	static const auto animStartTime = bench::Clock::now();
+	const auto startTime = bench::Clock::now();
+	const auto& atlas = vkd.spriteAtlas;
+	vkd.spritesCpuMs = 0;
+	if (numDemoSprites == 0 || !vkd.atlasResidency.resident)
+		return;
+	sprites::Instance* instances = sprites::allocInstances(vkd.spriteBatcher, numDemoSprites);
+	if (!instances)
+		return;
+
+	const float time = float(bench::elapsedMs(animStartTime) * 1e-3);
+	const vec2 pixelToClip = vec2(2.f / screenW, 2.f / screenH);
+	u32 seed = 1;
+	auto random = [&seed]() { // in [0, 1)
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) / float(1 << 24);
+	};
+	for (u32 i = 0; i < numDemoSprites; i++) {
+		const atlas::Entry& e = atlas.entries[i % atlas.entries.size()];
+		const vec2 start = vec2(random(), random());
+		const vec2 velocity = vec2(random(), random()) * 0.2f - 0.1f;
+		const float spin = random() * 4.f - 2.f;
+		// bounce: a triangle wave in [-1, 1] of the unbounded position
+		const vec2 p = glm::abs(glm::fract(start + velocity * time) * 2.f - 1.f) * 2.f - 1.f;
+		const vec2 halfSize = 0.5f * (e.uvMax - e.uvMin) * float(atlas.pageSize);
+		const float angle = spin * time;
+		const vec2 dir = vec2(glm::cos(angle), glm::sin(angle));
+		// write the whole instance at once, the memory is write-combined
+		instances[i] = {
+			.pos = p,
+			.axisX = dir * halfSize.x * pixelToClip,
+			.axisY = vec2(-dir.y, dir.x) * halfSize.y * pixelToClip,
+			.uvRect = vec4(e.uvMin, e.uvMax),
+			.textureInd = vkd.atlasTexInds[e.layer],
+		};
+	}
+	vkd.spritesCpuMs = bench::elapsedMs(startTime);
+}
+
+static void recordDrawCmdBuffer(u32 frameInd, VkCommandBuffer cmdBuffer, VkFramebuffer framebuffer, u32 screenW, u32 screenH)
 {
-	VkCommandBuffer& cmdBuffer = vkd.cmdBuffers[cmdBufferInd];
 	const VkCommandBufferBeginInfo beginInfo = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
@@ -83,77 +668,275 @@ static void recordDrawCmdBuffer(u32 cmdBufferInd, u32 screenW, u32 screenH)
 	VkResult vkRes = vkBeginCommandBuffer(cmdBuffer, &beginInfo);
 	vk::assertRes(vkRes);
 
+	// take ownership of the resources uploaded in the transfer queue
+	upload::recordAcquireBarriers(vkd.uploader, cmdBuffer);
+	// the pages loaded for this frame
+	vt::cmdUpdate(vkd.virtualTexture, cmdBuffer, frameInd);
+
+	auto& prof = vkd.gpuProfiler;
+	gpu_prof::beginFrame(prof, frameInd, cmdBuffer);
+	gpu_prof::beginScope(prof, cmdBuffer, "frame");
+
+	const bool gpuObjectsVisible = vkd.culler.numObjects && drawGpuObjects;
+	vec2 viewCenter, viewHalfSize;
+	if (gpuObjectsVisible) {
+		gpu_prof::beginScope(prof, cmdBuffer, "gpu culling");
+		gpuObjectsView(screenW, screenH, viewCenter, viewHalfSize);
+		vec4 frustumPlanes[6];
+		gpu_cull::orthoFrustumPlanes(viewCenter, viewHalfSize, frustumPlanes);
+		gpu_cull::cmdCull(vkd.culler, cmdBuffer, frameInd, frustumPlanes);
+		gpu_prof::endScope(prof, cmdBuffer);
+	}
+
+	if (vkd.meshVisible) {
+		gpu_prof::beginScope(prof, cmdBuffer, "mesh");
+		mesh_view::cmdRender(vkd.meshViewer, cmdBuffer, frameInd, vkd.meshAngle);
+		gpu_prof::endScope(prof, cmdBuffer);
+	}
+
 	const VkClearValue clearVal = { .color = {0.5f, 0.5f, 0.5f, 1.f} };
 	const VkRenderPassBeginInfo rpBeginInfo = {
 		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 		.renderPass = vkd.renderPass,
-		.framebuffer = vkd.framebuffers[cmdBufferInd],
+		.framebuffer = framebuffer,
 		.renderArea = {{0, 0}, {screenW, screenH}},
 		.clearValueCount = 1,
 		.pClearValues = &clearVal,
 	};
 
 	vkCmdBeginRenderPass(cmdBuffer, &rpBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	{
-		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkd.pipeline);
 
-		const VkViewport viewport = {
-			.x = 0, .y = 0,
-			.width = float(screenW), .height = float(screenH),
-			.minDepth = 0, .maxDepth = 1,
+	const VkViewport viewport = {
+		.x = 0, .y = 0,
+		.width = float(screenW), .height = float(screenH),
+		.minDepth = 0, .maxDepth = 1,
+	};
+	vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+
+	const VkRect2D scissor = { {0, 0}, {screenW, screenH} };
+	vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+	// the objects are in the background. The number of draws was decided by the culling pass
+	if (gpuObjectsVisible) {
+		gpu_prof::beginScope(prof, cmdBuffer, "gpu objects");
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkd.objectsPipeline);
+		bindless::cmdBind(vkd.textures, cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkd.objectsPipelineLayout);
+		const ObjectsPushConstants pushConstants = {
+			.viewScale = 1.f / viewHalfSize,
+			.viewOffset = -viewCenter / viewHalfSize,
 		};
-		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
-
-		const VkRect2D scissor = { {0, 0}, {screenW, screenH} };
-		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
-
+		vkCmdPushConstants(cmdBuffer, vkd.objectsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
+		const VkBuffer vertexBuffers[] = { vkd.vertexBuffer.buffer, vkd.objectsInstanceBuffer.buffer };
+		const VkDeviceSize offsets[] = { 0, 0 };
+		vkCmdBindVertexBuffers(cmdBuffer, sprites::QUAD_BINDING, 2, vertexBuffers, offsets);
+		vkCmdBindIndexBuffer(cmdBuffer, vkd.objectsIndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		gpu_cull::cmdDraw(vkd.culler, cmdBuffer);
+		gpu_prof::endScope(prof, cmdBuffer);
+	}
 
-		size_t offset = 0;
-		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkd.pipelineLayout,
-			0, 1, // firstSet, setCount
-			&vkd.descSet,
-			0, nullptr // dynamic offset
-		);
-		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vkd.vertexBuffer.buffer, &offset);
-		vkCmdDraw(cmdBuffer, 6, 1, 0, 0);
+	if (vkd.virtualTexture.file && drawVirtualTexture) {
+		gpu_prof::beginScope(prof, cmdBuffer, "virtual texture quad");
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkd.vtPipeline);
+		// the quad shows a square region, as big as the biggest side of the image when the zoom is 1
+		const vec2 imageUvSize = vt::imageUvSize(vkd.virtualTexture);
+		const vec2 uvScale = vec2(glm::max(imageUvSize.x, imageUvSize.y) / virtualTextureZoom);
+		const vec2 uvOffset = virtualTextureCenter * imageUvSize - 0.5f * uvScale;
+		vt::cmdBind(vkd.virtualTexture, cmdBuffer, vkd.vtPipelineLayout, frameInd, uvOffset, uvScale);
+		sprites::add(vkd.spriteBatcher, QUAD_INSTANCE);
+		sprites::cmdDraw(vkd.spriteBatcher, cmdBuffer, vkd.vertexBuffer.buffer);
+		gpu_prof::endScope(prof, cmdBuffer);
+	}
+	else if (vkd.tentImgReady && drawTentQuad) {
+		sprites::Instance tentInstance = QUAD_INSTANCE;
+		tentInstance.textureInd = vkd.tentTexInds[frameInd];
+		sprites::add(vkd.spriteBatcher, tentInstance);
+	}
+	// the tent quad and the sprites on top. All of them are a single instanced draw: the instances select their textures with an index
+	writeDemoSprites(screenW, screenH);
+	if (sprites::batchSize(vkd.spriteBatcher)) {
+		gpu_prof::beginScope(prof, cmdBuffer, "sprite batch");
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkd.pipeline);
+		// the only descriptor set bind of the batch
+		bindless::cmdBind(vkd.textures, cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkd.pipelineLayout);
+		sprites::cmdDraw(vkd.spriteBatcher, cmdBuffer, vkd.vertexBuffer.buffer);
+		gpu_prof::endScope(prof, cmdBuffer);
 	}
 	{
+		gpu_prof::beginScope(prof, cmdBuffer, "imgui");
 		ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmdBuffer);
+		gpu_prof::endScope(prof, cmdBuffer);
 	}
 	vkCmdEndRenderPass(cmdBuffer);
+	vt::cmdFeedbackBarrier(vkd.virtualTexture, cmdBuffer, frameInd);
+	gpu_prof::endScope(prof, cmdBuffer); // frame
 
 	vkEndCommandBuffer(cmdBuffer);
 }
 
-int main()
+static void parseCmdLineArgs(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+			numFramesInFlight = glm::clamp(u32(atoi(argv[++i])), 1u, MAX_FRAMES_IN_FLIGHT);
+		}
+		else if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			maxFrames = u32(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--present-profile") == 0 && i + 1 < argc) {
+			i++;
+			u32 profileInd = 0;
+			while (profileInd < u32(LatencyProfile::COUNT) && strcmp(argv[i], LATENCY_PROFILE_NAMES[profileInd]) != 0)
+				profileInd++;
+			if (profileInd < u32(LatencyProfile::COUNT))
+				latencyProfile = LatencyProfile(profileInd);
+			else
+				fprintf(stderr, "unknown present profile: %s\n", argv[i]);
+		}
+		else if (strcmp(argv[i], "--gpu-trace") == 0 && i + 1 < argc) {
+			gpuTraceFileName = argv[++i];
+		}
+		else if (strcmp(argv[i], "--bench-output") == 0 && i + 1 < argc) {
+			benchOutputFileName = argv[++i];
+		}
+		else if (strcmp(argv[i], "--stream-budget") == 0 && i + 1 < argc) {
+			streamingBytesPerFrame = u64(atoi(argv[++i])) << 10;
+		}
+		else if (strcmp(argv[i], "--vram-budget") == 0 && i + 1 < argc) {
+			vramBudgetOverride = u64(atoi(argv[++i])) << 20;
+		}
+		else if (strcmp(argv[i], "--virtual-texture") == 0 && i + 1 < argc) {
+			virtualTextureFileName = argv[++i];
+		}
+		else if (strcmp(argv[i], "--sprites") == 0 && i + 1 < argc) {
+			numDemoSprites = u32(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--gpu-objects") == 0 && i + 1 < argc) {
+			numGpuObjects = u32(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+			meshFileName = argv[++i];
+		}
+		else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc) {
+			i++;
+			u32 formatInd = 0;
+			while (formatInd < u32(MeshVertexFormat::COUNT) && strcmp(argv[i], MESH_VERTEX_FORMAT_NAMES[formatInd]) != 0)
+				formatInd++;
+			if (formatInd < u32(MeshVertexFormat::COUNT))
+				meshVertexFormat = MeshVertexFormat(formatInd);
+			else
+				fprintf(stderr, "unknown vertex format: %s\n", argv[i]);
+		}
+		else {
+			fprintf(stderr, "unknown argument: %s\n", argv[i]);
+		}
+	}
+}
+
+int main(int argc, char** argv)
 {
-	int ok = glfwInit();
-	assert(ok);
+	parseCmdLineArgs(argc, argv);
+	if ((headless || BENCH_BUILD) && maxFrames == 0)
+		maxFrames = DEFAULT_HEADLESS_FRAMES;
 
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	window = glfwCreateWindow(800, 600, "example", nullptr, nullptr);
+	u32 numRequiredExtensions = 0;
+	const CStr* requiredExtensions = nullptr;
+	if (!headless) {
+		int ok = glfwInit();
+		assert(ok);
 
-	glfwSetFramebufferSizeCallback(window, onWindowResized);
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		window = glfwCreateWindow(DEFAULT_SCREEN_W, DEFAULT_SCREEN_H, "example", nullptr, nullptr);
 
-	u32 numRequiredExtensions;
-	const CStr* requiredExtensions = glfwGetRequiredInstanceExtensions(&numRequiredExtensions);
+		glfwSetFramebufferSizeCallback(window, onWindowResized);
+
+		requiredExtensions = glfwGetRequiredInstanceExtensions(&numRequiredExtensions);
+	}
 
 	vkd.instance = vk::createInstance(MY_VULKAN_VERSION, {}, { requiredExtensions, numRequiredExtensions }, "example");
-	
-	VkResult vkRes = glfwCreateWindowSurface(vkd.instance, window, nullptr, &vkd.surface);
-	vk::assertRes(vkRes);
+
+	VkResult vkRes;
+	vkd.surface = VK_NULL_HANDLE;
+	if (!headless) {
+		vkRes = glfwCreateWindowSurface(vkd.instance, window, nullptr, &vkd.surface);
+		vk::assertRes(vkRes);
+	}
 
 	vk::findBestPhysicalDevice(vkd.instance, vkd.physicalDevice, vkd.physicalDeviceProps, vkd.physicalDeviceMemProps);
 
 	vkd.queueFamily = vk::findGraphicsQueueFamily(vkd.physicalDevice, vkd.surface);
+	vkd.transferQueueFamily = vk::findTransferQueueFamily(vkd.physicalDevice, vkd.queueFamily);
 	const float queuePriorities[] = { 0.f };
-	const vk::CreateQueues createQueues[] = { {vkd.queueFamily, queuePriorities} };
-	ConstStr deviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-	vkd.device = vk::createDevice(vkd.physicalDevice, createQueues, deviceExtensions);
+	const vk::CreateQueues createQueues[] = { {vkd.queueFamily, queuePriorities}, {vkd.transferQueueFamily, queuePriorities} };
+	const u32 numCreateQueues = vkd.transferQueueFamily != vkd.queueFamily ? 2 : 1;
+	std::vector<CStr> deviceExtensions;
+	if (!headless)
+		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	// lets VMA query the real budget and usage of each heap, including the memory used by other processes
+	const bool hasMemoryBudget = vk::deviceSupportsExtension(vkd.physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (hasMemoryBudget)
+		deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	assert(vkd.physicalDeviceProps.apiVersion >= MY_VULKAN_VERSION);
+	// the mesh viewer can cull and draw its meshlets with task and mesh shaders
+	const bool hasMeshShaderExt = meshFileName && vk::deviceSupportsExtension(vkd.physicalDevice, VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	VkPhysicalDeviceMeshShaderFeaturesEXT supportedMeshShaderFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+	VkPhysicalDeviceVulkan12Features supportedFeatures12 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+		.pNext = hasMeshShaderExt ? &supportedMeshShaderFeatures : nullptr,
+	};
+	VkPhysicalDeviceFeatures2 supportedFeatures = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &supportedFeatures12,
+	};
+	vkGetPhysicalDeviceFeatures2(vkd.physicalDevice, &supportedFeatures);
+	assert(supportedFeatures12.timelineSemaphore);
+	assert(bindless::featuresAreSupported(supportedFeatures12));
+	// the virtual texture feedback is written from the fragment shader
+	if (virtualTextureFileName && !supportedFeatures.features.fragmentStoresAndAtomics) {
+		fprintf(stderr, "virtual textures need the fragmentStoresAndAtomics feature\n");
+		virtualTextureFileName = nullptr;
+	}
+	if (numGpuObjects && !gpu_cull::featuresAreSupported(supportedFeatures.features)) {
+		fprintf(stderr, "GPU culling needs the drawIndirectFirstInstance feature\n");
+		numGpuObjects = 0;
+	}
+	// the meshlets are culled like the GPU culling objects
+	const bool meshletCulling = meshFileName && gpu_cull::featuresAreSupported(supportedFeatures.features);
+	if (meshFileName && !meshletCulling)
+		fprintf(stderr, "the meshlets of the mesh can't be culled on the GPU without the drawIndirectFirstInstance feature\n");
+	const bool meshShaders = meshletCulling && hasMeshShaderExt && mesh_view::meshShaderFeaturesAreSupported(supportedMeshShaderFeatures);
+	if (meshShaders)
+		deviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+	if (meshShaders)
+		mesh_view::enableMeshShaderFeatures(meshShaderFeatures);
+
+	VkPhysicalDeviceVulkan12Features features12 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+		.pNext = meshShaders ? &meshShaderFeatures : nullptr,
+		.timelineSemaphore = VK_TRUE,
+	};
+	bindless::enableFeatures(features12);
+	VkPhysicalDeviceFeatures2 features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &features12,
+		.features = {
+			.textureCompressionBC = supportedFeatures.features.textureCompressionBC, // for cooked textures
+			.fragmentStoresAndAtomics = virtualTextureFileName != nullptr,
+		},
+	};
+	if (numGpuObjects || meshletCulling)
+		gpu_cull::enableFeatures(supportedFeatures.features, supportedFeatures12, features.features, features12);
+	vkd.enabledFeatures = features.features;
+	vkd.device = vk::createDevice(vkd.physicalDevice, { createQueues, numCreateQueues }, deviceExtensions, &features);
 	vkGetDeviceQueue(vkd.device, vkd.queueFamily, 0, &vkd.queue);
+	vkGetDeviceQueue(vkd.device, vkd.transferQueueFamily, 0, &vkd.transferQueue);
 
 	const VmaAllocatorCreateInfo allocatorInfo = {
-		.flags = 0,
+		.flags = hasMemoryBudget ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0u,
 		.physicalDevice = vkd.physicalDevice,
 		.device = vkd.device,
 		.instance = vkd.instance,
@@ -162,11 +945,30 @@ int main()
 	vkRes = vmaCreateAllocator(&allocatorInfo, &vkd.allocator);
 	vk::assertRes(vkRes);
 
-	vk::create_swapChain(vkd.swapchain, vkd.physicalDevice, vkd.device, vkd.surface, MIN_SWAPCHAIN_IMAGES, VK_PRESENT_MODE_FIFO_KHR);
-	for (u32 i = 0; i < vkd.swapchain.numImages; i++)
+	for (u32 i = 0; i < vk::Swapchain::MAX_IMAGES; i++)
 		vkd.framebuffers[i] = VK_NULL_HANDLE;
 
-	vkd.renderPass = vk::createSimpleRenderPass(vkd.device, vkd.swapchain.format.format);
+	if (headless) {
+		vkd.renderPass = vk::createSimpleRenderPass(vkd.device, HEADLESS_FORMAT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		for (u32 i = 0; i < numFramesInFlight; i++) {
+			Img& img = vkd.offscreenImgs[i];
+			vk::Img imgInfo = {
+				.width = DEFAULT_SCREEN_W,
+				.height = DEFAULT_SCREEN_H,
+				.mipLevels = 1,
+				.format = HEADLESS_FORMAT,
+				.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			};
+			vk::createStaticImage(vkd.device, vkd.allocator, imgInfo, img.img, img.alloc, &img.allocInfo, &img.view);
+			vkd.framebuffers[i] = vk::createFramebuffer(vkd.device, vkd.renderPass, { &img.view, 1 }, DEFAULT_SCREEN_W, DEFAULT_SCREEN_H);
+		}
+	}
+	else {
+		createSwapchain();
+		vkd.renderPass = vk::createSimpleRenderPass(vkd.device, vkd.swapchain.format.format);
+	}
+
+	vkd.pipelineCache = vk::loadPipelineCache(vkd.device, vkd.physicalDeviceProps, PIPELINE_CACHE_FILE_NAME);
 
 	vk::ShaderStages shaderStages = {
 		.vertex = {vk::loadShaderModule(vkd.device, "shaders/example_vert.spirv")},
@@ -178,53 +980,54 @@ int main()
 		vec2 tc;
 	};
 
-	const VkVertexInputBindingDescription vertexInputBinding = {
-		.binding = 0,
-		.stride = sizeof(Vert),
-		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	// the quad vertices, and the sprite instances that place them
+	const VkVertexInputBindingDescription vertexInputBindings[] = {
+		{
+			.binding = sprites::QUAD_BINDING,
+			.stride = sizeof(Vert),
+			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+		},
+		sprites::instanceBinding(),
 	};
+	const auto instanceAttribs = sprites::instanceAttribs(2);
 	const VkVertexInputAttributeDescription vertexInputAttribs[] = {
 		{
 			.location = 0,
-			.binding = 0,
+			.binding = sprites::QUAD_BINDING,
 			.format = VK_FORMAT_R32G32_SFLOAT,
 			.offset = offsetof(Vert, pos),
 		},
 		{
 			.location = 1,
-			.binding = 0,
+			.binding = sprites::QUAD_BINDING,
 			.format = VK_FORMAT_R32G32_SFLOAT,
 			.offset = offsetof(Vert, tc),
-		}
+		},
+		instanceAttribs[0], instanceAttribs[1], instanceAttribs[2], instanceAttribs[3], instanceAttribs[4],
 	};
 
+	// the sprites have transparent texels
 	const VkPipelineColorBlendAttachmentState attachmentBlendInfos[] = { {
-		.blendEnable = VK_FALSE,
+		.blendEnable = VK_TRUE,
+		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+		.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.colorBlendOp = VK_BLEND_OP_ADD,
+		.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.alphaBlendOp = VK_BLEND_OP_ADD,
 		.colorWriteMask = VK_COLOR_COMPONENT_RGBA_BITS,
 	} };
 
 	const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 
-	const VkDescriptorSetLayoutBinding descSetBinding = {
-		.binding = 0,
-		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.pImmutableSamplers = nullptr,
-	};
-	const VkDescriptorSetLayoutCreateInfo descSetInfo = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 1,
-		.pBindings = &descSetBinding,
-	};
-	vkRes = vkCreateDescriptorSetLayout(vkd.device, &descSetInfo, nullptr, &vkd.descriptorSetLayout);
-	vk::assertRes(vkRes);
-
-	vkd.pipelineLayout = vk::createPipelineLayout(vkd.device, {&vkd.descriptorSetLayout, 1}, {});
+	samplers::init(vkd.samplers, vkd.device, vkd.physicalDeviceProps);
+	vkd.trilinearSampler = samplers::get(vkd.samplers, samplers::linearInfo());
+	bindless::init(vkd.textures, vkd.device, vkd.physicalDevice, VK_SHADER_STAGE_FRAGMENT_BIT, vkd.trilinearSampler);
+	vkd.pipelineLayout = vk::createPipelineLayout(vkd.device, {&vkd.textures.layout, 1}, {});
 
 	vkd.pipeline = vk::createGraphicsPipeline(vkd.device, {
 		.shaderStages = shaderStages,
-		.vertexInputBindings = {&vertexInputBinding, 1},
+		.vertexInputBindings = vertexInputBindings,
 		.vertexInputAttribs = vertexInputAttribs,
 		.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
 		//.viewport = {}, // viewport: will be set with dynamic state
@@ -237,8 +1040,74 @@ int main()
 		.pipelineLayout = vkd.pipelineLayout,
 		.renderPass = vkd.renderPass,
 		.subpass = 0,
+		.pipelineCache = vkd.pipelineCache,
 	});
 
+	// the objects of the GPU culling path have their own pipeline: an indexed triangle list, and a camera in the vertex shader
+	if (numGpuObjects) {
+		const VkPushConstantRange objectsPushConstantRange = {
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+			.offset = 0,
+			.size = sizeof(ObjectsPushConstants),
+		};
+		vkd.objectsPipelineLayout = vk::createPipelineLayout(vkd.device, {&vkd.textures.layout, 1}, {&objectsPushConstantRange, 1});
+		const vk::ShaderStages objectsShaderStages = {
+			.vertex = {vk::loadShaderModule(vkd.device, "shaders/objects_vert.spirv")},
+			.fragment = shaderStages.fragment,
+		};
+		vkd.objectsPipeline = vk::createGraphicsPipeline(vkd.device, {
+			.shaderStages = objectsShaderStages,
+			.vertexInputBindings = vertexInputBindings,
+			.vertexInputAttribs = vertexInputAttribs,
+			.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+			.faceClockwise = false,
+			.attachmentsBlendInfos = attachmentBlendInfos,
+			.dynamicStates = dynamicStates,
+			.pipelineLayout = vkd.objectsPipelineLayout,
+			.renderPass = vkd.renderPass,
+			.subpass = 0,
+			.pipelineCache = vkd.pipelineCache,
+		});
+		gpu_cull::init(vkd.culler, vkd.device, vkd.allocator, vkd.physicalDeviceProps, vkd.enabledFeatures, features12.drawIndirectCount,
+			vkd.pipelineCache, numGpuObjects, numFramesInFlight);
+	}
+
+	// the virtual texture has its own pipeline: same vertex shader, but its own descriptor set and push constants
+	if (virtualTextureFileName) {
+		const VkSampler pageTableSampler = samplers::get(vkd.samplers, samplers::nearestInfo(VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE));
+		const VkSampler cacheSampler = samplers::get(vkd.samplers, samplers::linearInfo(VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE));
+		if (vt::open(vkd.virtualTexture, vkd.device, vkd.allocator, vkd.physicalDeviceProps, vkd.enabledFeatures,
+			pageTableSampler, cacheSampler, virtualTextureFileName, numFramesInFlight))
+		{
+			const VkPushConstantRange vtPushConstantRange = {
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+				.offset = 0,
+				.size = sizeof(vt::PushConstants),
+			};
+			vkd.vtPipelineLayout = vk::createPipelineLayout(vkd.device, {&vkd.virtualTexture.setLayout, 1}, {&vtPushConstantRange, 1});
+			const vk::ShaderStages vtShaderStages = {
+				.vertex = shaderStages.vertex,
+				.fragment = {vk::loadShaderModule(vkd.device, "shaders/vt_frag.spirv")},
+			};
+			vkd.vtPipeline = vk::createGraphicsPipeline(vkd.device, {
+				.shaderStages = vtShaderStages,
+				.vertexInputBindings = vertexInputBindings,
+				.vertexInputAttribs = vertexInputAttribs,
+				.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+				.faceClockwise = false,
+				.attachmentsBlendInfos = attachmentBlendInfos,
+				.dynamicStates = dynamicStates,
+				.pipelineLayout = vkd.vtPipelineLayout,
+				.renderPass = vkd.renderPass,
+				.subpass = 0,
+				.pipelineCache = vkd.pipelineCache,
+			});
+		}
+		else {
+			fprintf(stderr, "could not open the virtual texture %s\n", virtualTextureFileName);
+		}
+	}
+
 	vkd.cmdPool = vk::createCmdPool(vkd.device, vkd.queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
 	const VkDescriptorPoolSize descPoolSizes[] = {
@@ -251,7 +1120,8 @@ int main()
 
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
-	ImGui_ImplGlfw_InitForVulkan(window, true);
+	if (!headless)
+		ImGui_ImplGlfw_InitForVulkan(window, true);
 
 	ImGui_ImplVulkan_InitInfo imguiVkInitInfo = {
 		.Instance = vkd.instance,
@@ -259,12 +1129,12 @@ int main()
 		.Device = vkd.device,
 		.QueueFamily = vkd.queueFamily,
 		.Queue = vkd.queue,
-		//.PipelineCache = ,
 		.DescriptorPool = vkd.descPool,
 		.RenderPass = vkd.renderPass,
 		.MinImageCount = MIN_SWAPCHAIN_IMAGES,
-		.ImageCount = vkd.swapchain.numImages,
+		.ImageCount = glm::max(numFramesInFlight, MIN_SWAPCHAIN_IMAGES), // imgui rotates its vertex buffers with this count, so it must cover all the frames in flight
 		.MSAASamples = VK_SAMPLE_COUNT_1_BIT,
+		.PipelineCache = vkd.pipelineCache,
 		.Subpass = 0,
 		//.Allocator =,
 		.CheckVkResultFn = [](VkResult vkRes) {
@@ -273,20 +1143,41 @@ int main()
 	};
 	ImGui_ImplVulkan_Init(&imguiVkInitInfo);
 
-	float dpiScaleX, dpiScaleY;
-	glfwGetWindowContentScale(window, &dpiScaleX, &dpiScaleY);
+	float dpiScaleX = 1, dpiScaleY = 1;
+	if (!headless)
+		glfwGetWindowContentScale(window, &dpiScaleX, &dpiScaleY);
 
 	auto& imguiIO = ImGui::GetIO();
 	imguiIO.Fonts->AddFontFromFileTTF("data/Roboto-Medium.ttf", 14 * dpiScaleX);
 
-	vkd.cmdBuffers.resize(vkd.swapchain.numImages);
-	vk::allocateCmdBuffers(vkd.device, vkd.cmdPool, vkd.cmdBuffers);
+	gpu_prof::init(vkd.gpuProfiler, vkd.device, vkd.physicalDevice, vkd.physicalDeviceProps, vkd.queueFamily, numFramesInFlight, gpuTraceFileName);
 
+	// one timeline per queue. Without a dedicated transfer queue, the uploads are submitted to the graphics queue and share its timeline
+	vkd.timeline.semaphore = vk::createTimelineSemaphore(vkd.device);
+	vk::Timeline* uploadTimeline = &vkd.timeline;
+	if (vkd.transferQueueFamily != vkd.queueFamily) {
+		vkd.transferTimeline.semaphore = vk::createTimelineSemaphore(vkd.device);
+		uploadTimeline = &vkd.transferTimeline;
+	}
+
+	// the meshlets and the vertices of the mesh are read by the task and mesh shaders
+	const VkPipelineStageFlags extraUploadStages = meshShaders ? VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT : 0;
+	upload::init(vkd.uploader, vkd.physicalDevice, vkd.device, vkd.allocator, vkd.physicalDeviceProps,
+		vkd.transferQueueFamily, vkd.transferQueue, *uploadTimeline, vkd.queueFamily, STAGING_RING_SIZE, extraUploadStages);
+
+	for (u32 i = 0; i < numFramesInFlight; i++) {
+		Frame& frame = vkd.frames[i];
+		vk::allocateCmdBuffers(vkd.device, vkd.cmdPool, { &frame.cmdBuffer, 1 });
+		vk::createSemaphores(vkd.device, { &frame.semaphore_swapchainImgAvailable, 1 });
+	}
+	sprites::init(vkd.spriteBatcher, vkd.allocator, numDemoSprites + 1, numFramesInFlight); // + the tent or the virtual texture quad
+
+	// the corners of the quad. Each instance places them with its axes
 	const Vert verts[] = {
-		{{-0.8, -0.8}, {0, 0}},
-		{{-0.8, +0.8}, {0, 1}},
-		{{+0.8, -0.8}, {1, 0}},
-		{{+0.8, +0.8}, {1, 1}},
+		{{-1, -1}, {0, 0}},
+		{{-1, +1}, {0, 1}},
+		{{+1, -1}, {1, 0}},
+		{{+1, +1}, {1, 1}},
 	};
 	vk::createStaticVertexBuffer(vkd.device, vkd.allocator, sizeof(verts),
 		vkd.vertexBuffer.buffer, vkd.vertexBuffer.alloc, &vkd.vertexBuffer.allocInfo);
@@ -295,233 +1186,361 @@ int main()
 		memcpy(vkd.vertexBuffer.allocInfo.pMappedData, verts, sizeof(verts));
 		vmaFlushAllocation(vkd.allocator, vkd.vertexBuffer.alloc, 0, VK_WHOLE_SIZE);
 	}
-	else { // the vertex buffer can't be directly mapped, we will have to create a staging buffer
-		StagingProcess& stagingProc = vkd.stagingProcs.emplace_back();
-		vk::createStagingBuffer(vkd.device, vkd.allocator, sizeof(verts),
-			stagingProc.bufferInfo.buffer, stagingProc.bufferInfo.alloc, &stagingProc.bufferInfo.allocInfo);
-
-		memcpy(stagingProc.bufferInfo.allocInfo.pMappedData, verts, sizeof(verts));
-		vmaFlushAllocation(vkd.allocator, stagingProc.bufferInfo.alloc, 0, VK_WHOLE_SIZE);
-
-		vk::allocateCmdBuffers(vkd.device, vkd.cmdPool, { &stagingProc.cmdBuffer, 1 });
-		vk::createFences(vkd.device, false, { &stagingProc.fence, 1 });
+	else { // the vertex buffer can't be directly mapped, we will have to upload it through the staging ring
+		u8* stagingData = upload::copyToBuffer(vkd.uploader, vkd.vertexBuffer.buffer, 0, sizeof(verts));
+		memcpy(stagingData, verts, sizeof(verts));
+	}
 
-		vk::beginCmdBuffer(stagingProc.cmdBuffer);
-		{
-			const VkBufferCopy copyRegion = { .size = sizeof(verts)};
-			vkCmdCopyBuffer(stagingProc.cmdBuffer, stagingProc.bufferInfo.buffer, vkd.vertexBuffer.buffer, 1, &copyRegion);
+	// load image. Preferably the cooked version (pre-mipped and block compressed), which doesn't need any decoding
+	// it's streamed progressively, unless the streaming budget is 0
+	// otherwise the jpg is decoded in the background, and the image is created once it's ready
+	decode::init(decodePool);
+	stream::init(vkd.streamer, vkd.uploader, streamingBytesPerFrame);
+	// the textures are evicted when they go unused while over the VRAM budget, and reloaded when they are used again
+	// the jpg fallback of the tent image can't be reloaded (it would need to be decoded again), so it's never evicted
+	residency::init(vkd.residency, vkd.allocator, vkd.physicalDeviceMemProps, numFramesInFlight + 1, vramBudgetOverride);
+	vkd.tentResidency.name = "tent";
+	vkd.atlasResidency = {
+		.name = "sprite atlas",
+		.load = loadDemoAtlas,
+		.evict = evictDemoAtlas,
+	};
+	residency::add(vkd.residency, vkd.atlasResidency); // built the first time the atlas window is drawn
+	if (numGpuObjects) {
+		// the objects use the atlas. It's touched every frame, so it's never evicted and its indices in the texture table stay valid
+		residency::touch(vkd.residency, vkd.atlasResidency);
+		createGpuObjects();
+	}
 
-			const VkMemoryBarrier memBarrier = {
-				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
-				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-				.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-			};
-			vkCmdPipelineBarrier(stagingProc.cmdBuffer,
-				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
-				1, &memBarrier,
-				0, nullptr,
-				0, nullptr);
+	if (meshFileName) {
+		vfmt::Layout meshLayout = vfmt::compactLayout();
+		if (meshVertexFormat == MeshVertexFormat::FLOAT)
+			meshLayout = vfmt::floatLayout();
+		else if (meshVertexFormat == MeshVertexFormat::HALF)
+			meshLayout = vfmt::makeLayout(vfmt::PosFormat::HALF, vfmt::NormalFormat::OCT_SNORM16, vfmt::TcFormat::HALF);
+		assert(vfmt::layoutIsSupported(vkd.physicalDevice, meshLayout));
+		mesh::Mesh m;
+		meshlets::Meshlets ml;
+		if (!loadMesh(meshFileName, m, ml))
+			fprintf(stderr, "could not load the mesh %s\n", meshFileName);
+		mesh_view::init(vkd.meshViewer, vkd.device, vkd.allocator, vkd.physicalDeviceProps, vkd.enabledFeatures, features12.drawIndirectCount,
+			meshShaders, vkd.pipelineCache, MESH_VIEW_SIZE, meshLayout, u32(ml.meshlets.size()), numFramesInFlight);
+		vkd.imguiMeshTex = ImGui_ImplVulkan_AddTexture(samplers::get(vkd.samplers, samplers::linearInfo(VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+			vkd.meshViewer.colorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		if (m.indices.size()) {
+			mesh_view::setMesh(vkd.meshViewer, vkd.uploader, m, ml);
+			const vfmt::Layout& layout = vkd.meshViewer.layout;
+			fprintf(stderr, "mesh vertices: %u bytes each (%s positions, %s normals, %s uvs), %.1f KB instead of %.1f KB\n", layout.stride,
+				vfmt::POS_FORMAT_NAMES[u32(layout.pos)], vfmt::NORMAL_FORMAT_NAMES[u32(layout.normal)], vfmt::TC_FORMAT_NAMES[u32(layout.tc)],
+				vkd.meshViewer.vertexBufferSize / 1024.0, m.vertices.size() * sizeof(mesh::Vertex) / 1024.0);
 		}
-		vkEndCommandBuffer(stagingProc.cmdBuffer);
+	}
 
-		const VkSubmitInfo submitInfo = {
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.commandBufferCount = 1,
-			.pCommandBuffers = &stagingProc.cmdBuffer,
+	const auto imgLoadStartTime = bench::Clock::now();
+	u32 tentDecodeId = ~0u;
+	if (loadCookedTentImg()) {
+		if (!vkd.tentImgStreamed)
+			fprintf(stderr, "tent image loaded in %.2f ms\n", bench::elapsedMs(imgLoadStartTime));
+		vkd.tentResidency.load = [] {
+			[[maybe_unused]] const bool ok = loadCookedTentImg();
+			assert(ok);
+			return tentImgBytes();
 		};
-		vkRes = vkQueueSubmit(vkd.queue, 1, &submitInfo, stagingProc.fence);
-		vk::assertRes(vkRes);
+		vkd.tentResidency.evict = evictTentImg;
+		residency::addResident(vkd.residency, vkd.tentResidency, tentImgBytes());
 	}
-
-	// load image
+	else {
+		tentDecodeId = decode::request(decodePool, "data/tent.jpg");
+	}
+	std::vector<decode::Image> decodedImgs;
+
+	bench::FrameStats frameStats;
+	frameStats.warmupFrames = glm::min(BENCH_WARMUP_FRAMES, maxFrames / 4);
+	frameStats.keepSamples = BENCH_BUILD || benchOutputFileName;
+	const auto startTime = bench::Clock::now();
+	u32 frameInd = 0;
+	u32 frameCount = 0;
+	while (headless || !glfwWindowShouldClose(window))
 	{
-		int w, h, nc;
-		u8* data = stbi_load("data/tent.jpg", &w, &h, &nc, 4);
-		vk::Img imgInfo = {
-			.width = u32(w),
-			.height = u32(h),
-			.mipLevels = 1,
-		};
-		VmaAllocationInfo allocInfo;
-		vk::createStaticImage(vkd.device, vkd.allocator, imgInfo, vkd.tentImg.img, vkd.tentImg.alloc, &vkd.tentImg.allocInfo, &vkd.tentImg.view);
-
-		const size_t memSize = vkd.tentImg.allocInfo.size;
-		StagingProcess& stagingProc = vkd.stagingProcs.emplace_back();
-		vk::createStagingBuffer(vkd.device, vkd.allocator, memSize,
-			stagingProc.bufferInfo.buffer, stagingProc.bufferInfo.alloc, &stagingProc.bufferInfo.allocInfo);
-		memcpy(stagingProc.bufferInfo.allocInfo.pMappedData, data, memSize);
-		vmaFlushAllocation(vkd.allocator, stagingProc.bufferInfo.alloc, 0, VK_WHOLE_SIZE);
-
-		vk::allocateCmdBuffers(vkd.device, vkd.cmdPool, { &stagingProc.cmdBuffer, 1 });
-		vk::createFences(vkd.device, false, { &stagingProc.fence, 1 });
-
-		vk::beginCmdBuffer(stagingProc.cmdBuffer);
-		{
-			const VkImageSubresourceRange imgSubresRange = {
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.baseMipLevel = 0,
-				.levelCount = 1,
-				.baseArrayLayer = 0,
-				.layerCount = 1,
-			};
-
-			const VkImageMemoryBarrier imgBarrier_transferDst = {
-				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-				.srcAccessMask = VK_ACCESS_NONE,
-				.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-				.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				.image = vkd.tentImg.img,
-				.subresourceRange = imgSubresRange,
-			};
-			vkCmdPipelineBarrier(stagingProc.cmdBuffer,
-				VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-				0, // VkDependencyFlags
-				0, nullptr, // memory barriers
-				0, nullptr, // buffer barriers
-				1, &imgBarrier_transferDst // img barriers
-			);
-
-			const VkBufferImageCopy copyRegion = {
-				.bufferOffset = 0,
-				.bufferRowLength = u32(w),
-				.bufferImageHeight = u32(h),
-				.imageSubresource = {
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.mipLevel = 0,
-					.baseArrayLayer = 0,
-					.layerCount = 1,
-				},
-				.imageOffset = {},
-				.imageExtent = {u32(w), u32(h), 1},
-			};
-			vkCmdCopyBufferToImage(stagingProc.cmdBuffer, stagingProc.bufferInfo.buffer, vkd.tentImg.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-			const VkImageMemoryBarrier imgBarrier_shaderOptimal = {
-				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				.image = vkd.tentImg.img,
-				.subresourceRange = imgSubresRange,
-			};
-
-			vkCmdPipelineBarrier(
-				stagingProc.cmdBuffer,
-				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-				0, // VkDependencyFlags
-				0, nullptr, // memory barriers
-				0, nullptr, // buffer barriers
-				1, &imgBarrier_shaderOptimal // img barriers
-			);
+		const auto frameStartTime = bench::Clock::now();
+		int screenW = DEFAULT_SCREEN_W, screenH = DEFAULT_SCREEN_H;
+		if (!headless) {
+			glfwPollEvents();
+			glfwGetFramebufferSize(window, &screenW, &screenH);
+			if (screenW == 0 || screenH == 0) { // minimized
+				glfwWaitEvents();
+				frameStats.discardFrame();
+				continue;
+			}
+			if (vkd.swapchainNeedsRecreate)
+				recreateSwapchain();
 		}
-		vkEndCommandBuffer(stagingProc.cmdBuffer);
 
-		const VkSubmitInfo submitInfo = {
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.commandBufferCount = 1,
-			.pCommandBuffers = &stagingProc.cmdBuffer,
-		};
-		vkRes = vkQueueSubmit(vkd.queue, 1, &submitInfo, stagingProc.fence);
-		vk::assertRes(vkRes);
-	}
-
-	const VkSamplerCreateInfo samplerInfo = {
-		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-		.magFilter = VK_FILTER_LINEAR,
-		.minFilter = VK_FILTER_LINEAR,
-		//.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
-		//.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-	};
-	vkRes = vkCreateSampler(vkd.device, &samplerInfo, nullptr, &vkd.bilinearSampler);
-	vk::assertRes(vkRes);
-
-	auto imguiTentTex = ImGui_ImplVulkan_AddTexture(vkd.bilinearSampler, vkd.tentImg.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-	vk::allocDescSets(vkd.device, vkd.descPool, { &vkd.descriptorSetLayout, 1 }, {&vkd.descSet, 1});
-
-	vk::writeTextureDescriptor(vkd.device, vkd.descSet, 0, vkd.tentImg.view, vkd.bilinearSampler);
-
-	u32 frameId = 0;
-	while (!glfwWindowShouldClose(window))
-	{
-		glfwPollEvents();
-		int screenW, screenH;
-		glfwGetFramebufferSize(window, &screenW, &screenH);
+		pollFrameLatencies();
+
+		// hand the images decoded in the background to the upload path
+		decodedImgs.clear();
+		decode::takeFinished(decodePool, decodedImgs);
+		for (decode::Image& decoded : decodedImgs) {
+			if (decoded.id == tentDecodeId) {
+				if (!decoded.pixels) { // the decoder has already printed why
+					vkd.tentImgFailed = true;
+				}
+				else if (createTentImgFromPixels(decoded)) {
+					onTentImgCreated();
+					residency::addResident(vkd.residency, vkd.tentResidency, tentImgBytes());
+					fprintf(stderr, "tent image loaded in %.2f ms\n", bench::elapsedMs(imgLoadStartTime));
+				}
+				else {
+					fprintf(stderr, "the tent image is too big for the staging ring of the upload queue\n");
+					vkd.tentImgFailed = true;
+				}
+			}
+			decode::freePixels(decoded);
+		}
 
 		// Start the Dear ImGui frame
 		ImGui_ImplVulkan_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
+		if (headless) {
+			imguiIO.DisplaySize = ImVec2(float(screenW), float(screenH));
+			imguiIO.DeltaTime = 1.f / 60.f;
+		}
+		else {
+			ImGui_ImplGlfw_NewFrame();
+		}
 		ImGui::NewFrame();
 
 		ImGui::ShowDemoWindow();
 
-		ImGui::Begin("img");
-		ImGui::Image(ImTextureID(imguiTentTex), { 256, 256 });
+		// the tent image is used if it's drawn in the quad or in the window. Otherwise it can be evicted
+		const bool imgWindowOpen = ImGui::Begin("img");
+		if (imgWindowOpen || drawTentQuad)
+			residency::touch(vkd.residency, vkd.tentResidency);
+		if (imgWindowOpen) {
+			ImGui::Checkbox("draw quad", &drawTentQuad);
+			if (vkd.tentImgReady) {
+				ImGui::Image(ImTextureID(vkd.imguiTentTex[frameInd]), { 256, 256 });
+				ImGui::Text("%ux%u, %u mips, %s", vkd.tentImgInfo.width, vkd.tentImgInfo.height, vkd.tentImgInfo.mipLevels,
+					texc::formatName(vkd.tentImgInfo.format));
+				if (vkd.tentImgStreamed)
+					ImGui::Text("streamed: resident from level %u, %llu KB", vkd.tentStream.residentLevel, (unsigned long long)(vkd.streamer.bytesStreamed >> 10));
+			}
+			else {
+				ImGui::TextUnformatted(vkd.tentImgFailed ? "could not load the image" : "loading...");
+			}
+		}
 		ImGui::End();
 
-		ImGui::Render();
+		gpu_prof::drawImGuiWindow(vkd.gpuProfiler);
+		if (numDemoSprites || numGpuObjects)
+			residency::touch(vkd.residency, vkd.atlasResidency);
+		drawAtlasImGuiWindow();
+		residency::drawImGuiWindow(vkd.residency);
+		drawVirtualTextureImGuiWindow();
+		drawGpuCullingImGuiWindow();
+		drawMeshImGuiWindow();
+
+		if (!headless) {
+			ImGui::Begin("settings");
+			int profileInd = int(latencyProfile);
+			if (ImGui::Combo("present profile", &profileInd, LATENCY_PROFILE_NAMES, int(LatencyProfile::COUNT))) {
+				latencyProfile = LatencyProfile(profileInd);
+				vkd.swapchainNeedsRecreate = true;
+			}
+			ImGui::Text("present mode: %s, %u images", vk::presentModeName(vkd.swapchain.presentMode), vkd.swapchain.numImages);
+			ImGui::End();
+		}
 
-		u32 swapchainImageInd;
-		vkRes = vkAcquireNextImageKHR(vkd.device, vkd.swapchain.swapchain, -1,
-			vkd.swapchain.semaphore_swapchainImgAvailable[frameId], VK_NULL_HANDLE, &swapchainImageInd);
-		vk::assertRes(vkRes);
+		ImGui::Render();
 
-		if (vkd.framebuffers[swapchainImageInd] == VK_NULL_HANDLE) {
-			const VkImageView attachments[] = { {vkd.swapchain.imageViews[swapchainImageInd]} };
-			vkd.framebuffers[swapchainImageInd] = vk::createFramebuffer(vkd.device, vkd.renderPass, attachments, u32(screenW), u32(screenH));
+		Frame& frame = vkd.frames[frameInd];
+
+		// wait until the GPU has finished with the resources of this frame slot, the last time we used it
+		auto t = bench::Clock::now();
+		vk::waitTimeline(vkd.device, vkd.timeline, frame.timelineValue);
+		frameStats.add(bench::FENCE_WAIT, bench::elapsedMs(t));
+		pollFrameLatencies();
+		if (frame.latencyMs >= 0) {
+			// an upper bound, by the time between the polls: the GPU could have finished before we checked
+			frameStats.add(bench::LATENCY, frame.latencyMs);
+			frame.latencyMs = -1;
 		}
 
-		vkRes = vkWaitForFences(vkd.device, 1, &vkd.swapchain.fence_queueWorkFinished[swapchainImageInd], VK_FALSE, -1);
-		vk::assertRes(vkRes);
-		vkRes = vkResetFences(vkd.device, 1, &vkd.swapchain.fence_queueWorkFinished[swapchainImageInd]);
-		vk::assertRes(vkRes);
-
-		recordDrawCmdBuffer(swapchainImageInd, u32(screenW), u32(screenH));
+		vkd.deletionQueue.flush(vk::updateCompletedValue(vkd.device, vkd.timeline));
+		gpu_cull::readStats(vkd.culler, frameInd);
+		gpu_cull::readStats(vkd.meshViewer.culler, frameInd);
+
+		// evict the textures that haven't been used lately if we are over the VRAM budget
+		residency::update(vkd.residency);
+
+		// the sprite instances of this frame slot can be overwritten now
+		sprites::beginFrame(vkd.spriteBatcher, frameInd);
+
+		// stream more texture levels, and make this frame use the new views
+		stream::update(vkd.streamer);
+		updateFrameDescriptors(frameInd);
+
+		u32 targetImageInd = frameInd; // in headless mode, each frame in flight has its own offscreen image
+		if (!headless) {
+			t = bench::Clock::now();
+			vkRes = vkAcquireNextImageKHR(vkd.device, vkd.swapchain.swapchain, -1,
+				frame.semaphore_swapchainImgAvailable, VK_NULL_HANDLE, &targetImageInd);
+			frameStats.add(bench::ACQUIRE, bench::elapsedMs(t));
+			if (vkRes == VK_ERROR_OUT_OF_DATE_KHR) {
+				vkd.swapchainNeedsRecreate = true;
+				frameStats.discardFrame();
+				continue; // the semaphore was not signaled, so we can just retry this frame slot
+			}
+			if (vkRes == VK_SUBOPTIMAL_KHR)
+				vkd.swapchainNeedsRecreate = true; // the image is still usable, we will recreate in the next frame
+			else
+				vk::assertRes(vkRes);
+
+			// render with the size of the swapchain, the window might have been resized after the swapchain was created
+			screenW = int(vkd.swapchain.w);
+			screenH = int(vkd.swapchain.h);
+			if (vkd.framebuffers[targetImageInd] == VK_NULL_HANDLE) {
+				const VkImageView attachments[] = { {vkd.swapchain.imageViews[targetImageInd]} };
+				vkd.framebuffers[targetImageInd] = vk::createFramebuffer(vkd.device, vkd.renderPass, attachments, vkd.swapchain.w, vkd.swapchain.h);
+			}
+		}
 
-		const VkPipelineStageFlags semaphoreWaitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		// load the virtual texture pages requested the last time this frame slot was rendered. Only once the frame is sure to be
+		// recorded: the page assignments are committed here, and their copies are recorded by the draw command buffer
+		vt::update(vkd.virtualTexture, frameInd);
+
+		// the uploads recorded during this frame must be submitted before the draw commands that use them
+		upload::submit(vkd.uploader);
+
+		recordDrawCmdBuffer(frameInd, frame.cmdBuffer, vkd.framebuffers[targetImageInd], u32(screenW), u32(screenH));
+		frameStats.add(bench::SPRITES_CPU, vkd.spritesCpuMs);
+		frameStats.add(bench::SPRITES_GPU, gpu_prof::lastScopeMs(vkd.gpuProfiler, "sprite batch"));
+
+		// binary and timeline semaphores can be mixed in the same submit, the values of the binary ones are ignored
+		VkSemaphore waitSemaphores[2];
+		u64 waitValues[2];
+		VkPipelineStageFlags waitStages[2];
+		u32 numWaitSemaphores = 0;
+		if (!headless) {
+			waitSemaphores[numWaitSemaphores] = frame.semaphore_swapchainImgAvailable;
+			waitValues[numWaitSemaphores] = 0;
+			waitStages[numWaitSemaphores] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			numWaitSemaphores++;
+		}
+		if (vkd.uploader.graphicsWaitValue) {
+			waitSemaphores[numWaitSemaphores] = vkd.uploader.timeline->semaphore;
+			waitValues[numWaitSemaphores] = vkd.uploader.graphicsWaitValue;
+			waitStages[numWaitSemaphores] = vkd.uploader.consumerStages;
+			numWaitSemaphores++;
+		}
+		frame.timelineValue = vk::nextTimelineValue(vkd.timeline);
+		const VkSemaphore signalSemaphores[] = { vkd.timeline.semaphore, vkd.swapchain.semaphore_drawFinished[targetImageInd] };
+		const u64 signalValues[] = { frame.timelineValue, 0 };
+		const u32 numSignalSemaphores = headless ? 1 : 2;
+		const VkTimelineSemaphoreSubmitInfo timelineInfo = {
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.waitSemaphoreValueCount = numWaitSemaphores,
+			.pWaitSemaphoreValues = waitValues,
+			.signalSemaphoreValueCount = numSignalSemaphores,
+			.pSignalSemaphoreValues = signalValues,
+		};
 		const VkSubmitInfo submitInfo = {
 			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = vkd.swapchain.semaphore_swapchainImgAvailable + frameId,
-			.pWaitDstStageMask = &semaphoreWaitStage,
+			.pNext = &timelineInfo,
+			.waitSemaphoreCount = numWaitSemaphores,
+			.pWaitSemaphores = waitSemaphores,
+			.pWaitDstStageMask = waitStages,
 			.commandBufferCount = 1,
-			.pCommandBuffers = &vkd.cmdBuffers[swapchainImageInd],
-			.signalSemaphoreCount = 1,
-			.pSignalSemaphores = vkd.swapchain.semaphore_drawFinished + swapchainImageInd,
-		};
-		vkRes = vkQueueSubmit(vkd.queue, 1, &submitInfo, vkd.swapchain.fence_queueWorkFinished[swapchainImageInd]);
-		vk::assertRes(vkRes);
-
-		const VkPresentInfoKHR presentInfo = {
-			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = vkd.swapchain.semaphore_drawFinished + swapchainImageInd,
-			.swapchainCount = 1,
-			.pSwapchains = &vkd.swapchain.swapchain,
-			.pImageIndices = &swapchainImageInd,
-			.pResults = nullptr,
+			.pCommandBuffers = &frame.cmdBuffer,
+			.signalSemaphoreCount = numSignalSemaphores,
+			.pSignalSemaphores = signalSemaphores,
 		};
-		vkRes = vkQueuePresentKHR(vkd.queue, &presentInfo);
+		t = bench::Clock::now();
+		vkRes = vkQueueSubmit(vkd.queue, 1, &submitInfo, VK_NULL_HANDLE);
 		vk::assertRes(vkRes);
-
-		for (size_t i = 0; i < vkd.stagingProcs.size(); ) {
-			auto& proc = vkd.stagingProcs[i];
-			if (vk::fenceIsSignaled(vkd.device, proc.fence)) {
-				vkDestroyFence(vkd.device, proc.fence, nullptr);
-				vkFreeCommandBuffers(vkd.device, vkd.cmdPool, 1, &proc.cmdBuffer);
-				vmaDestroyBuffer(vkd.allocator, proc.bufferInfo.buffer, proc.bufferInfo.alloc);
-				if (vkd.stagingProcs.size() >= 2)
-					proc = vkd.stagingProcs.back();
-				vkd.stagingProcs.pop_back();
-			}
+		frameStats.add(bench::SUBMIT, bench::elapsedMs(t));
+		frame.cpuStartTime = frameStartTime;
+		frame.submitted = true;
+
+		if (!headless) {
+			const VkPresentInfoKHR presentInfo = {
+				.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+				.waitSemaphoreCount = 1,
+				.pWaitSemaphores = vkd.swapchain.semaphore_drawFinished + targetImageInd,
+				.swapchainCount = 1,
+				.pSwapchains = &vkd.swapchain.swapchain,
+				.pImageIndices = &targetImageInd,
+				.pResults = nullptr,
+			};
+			t = bench::Clock::now();
+			vkRes = vkQueuePresentKHR(vkd.queue, &presentInfo);
+			if (vkRes == VK_ERROR_OUT_OF_DATE_KHR || vkRes == VK_SUBOPTIMAL_KHR)
+				vkd.swapchainNeedsRecreate = true;
 			else
-				i++;
+				vk::assertRes(vkRes);
+			frameStats.add(bench::PRESENT, bench::elapsedMs(t));
 		}
 
-		frameId = (frameId + 1) % vkd.swapchain.numImages;
+		upload::reclaim(vkd.uploader);
+		pollFrameLatencies();
+
+		frameStats.add(bench::CPU_FRAME, bench::elapsedMs(frameStartTime));
+		frameStats.endFrame();
+
+		frameInd = (frameInd + 1) % numFramesInFlight;
+		frameCount++;
+		if (maxFrames && frameCount >= maxFrames)
+			break;
+	}
+
+	decode::destroy(decodePool);
+	vkDeviceWaitIdle(vkd.device);
+	if (vkd.tentImgReady && vkd.tentImgStreamed)
+		stream::destroy(vkd.streamer, vkd.tentStream);
+	if (vkd.atlasResidency.resident)
+		atlas::destroy(vkd.spriteAtlas, vkd.device, vkd.allocator);
+	vt::destroy(vkd.virtualTexture);
+	sprites::destroy(vkd.spriteBatcher);
+	if (vkd.culler.numObjects) {
+		vmaDestroyBuffer(vkd.allocator, vkd.objectsIndexBuffer.buffer, vkd.objectsIndexBuffer.alloc);
+		vmaDestroyBuffer(vkd.allocator, vkd.objectsInstanceBuffer.buffer, vkd.objectsInstanceBuffer.alloc);
+	}
+	gpu_cull::destroy(vkd.culler);
+	mesh_view::destroy(vkd.meshViewer);
+	bindless::destroy(vkd.textures);
+	samplers::destroy(vkd.samplers);
+	vkd.deletionQueue.flushAll();
+	upload::destroy(vkd.uploader);
+	vkDestroySemaphore(vkd.device, vkd.timeline.semaphore, nullptr);
+	if (vkd.transferTimeline.semaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(vkd.device, vkd.transferTimeline.semaphore, nullptr);
+	gpu_prof::destroy(vkd.gpuProfiler);
+	vk::savePipelineCache(vkd.device, vkd.pipelineCache, vkd.physicalDeviceProps, PIPELINE_CACHE_FILE_NAME);
+	const double elapsedSeconds = bench::elapsedMs(startTime) / 1000.0;
+	fprintf(stderr, "rendered %u frames in %.3f s (%.1f fps)\n", frameCount, elapsedSeconds, frameCount / elapsedSeconds);
+
+	if (BENCH_BUILD || benchOutputFileName) {
+		FILE* benchFile = benchOutputFileName ? fopen(benchOutputFileName, "w") : stdout;
+		if (!benchFile) {
+			fprintf(stderr, "could not open %s, writing the report to stdout\n", benchOutputFileName);
+			benchFile = stdout;
+		}
+		const bench::RunInfo runInfo = {
+			.deviceName = vkd.physicalDeviceProps.deviceName,
+			.headless = headless,
+			.framesInFlight = numFramesInFlight,
+			.latencyProfile = headless ? "none" : LATENCY_PROFILE_NAMES[u32(latencyProfile)],
+			.presentMode = headless ? "none" : vk::presentModeName(vkd.swapchain.presentMode),
+			.swapchainImages = headless ? 0 : vkd.swapchain.numImages,
+			.spritesPerFrame = numDemoSprites,
+			.gpuObjects = vkd.culler.numObjects,
+			.totalSeconds = elapsedSeconds,
+		};
+		bench::writeJson(benchFile, frameStats, runInfo);
+		if (benchFile != stdout)
+			fclose(benchFile);
 	}
 
-	glfwDestroyWindow(window);
+	if (window)
+		glfwDestroyWindow(window);
 }
\ No newline at end of file
@@ -0,0 +1,488 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <span>
+#include <unordered_map>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+namespace
+{
+
+// indexed triangle meshes: OBJ import, vertex deduplication, and the reordering of triangles and vertices for the GPU:
+// - vertex cache: triangles that share vertices are emitted close together, so the post-transform cache reuses them
+//   (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation")
+// - overdraw: the cache-friendly order is split in clusters, which are sorted so the ones facing outwards are drawn first and
+//   occlude the rest (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw")
+// - vertex fetch: the vertices are stored in the order they are first used
+// the efficiency of the post-transform cache is measured with the ACMR (average cache miss ratio): vertex shader invocations
+// per triangle, from 3 (no reuse) down to 0.5 for big regular grids
+// it doesn't depend on Vulkan, so the tools can use it too
+namespace mesh {
+
+static constexpr uint32_t ACMR_CACHE_SIZE = 16; // FIFO entries of the simulated cache in the ACMR reports: a conservative size for current GPUs
+static constexpr uint32_t OPTIMIZER_CACHE_SIZE = 32; // LRU entries modeled by the vertex cache optimizer
+static constexpr float OVERDRAW_THRESHOLD = 1.05f; // the overdraw clusters can make the ACMR this much worse
+
+struct Vertex {
+	glm::vec3 pos;
+	glm::vec3 normal;
+	glm::vec2 tc;
+};
+
+struct Mesh {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices; // triangle list
+};
+
+struct OptimizeStats {
+	float acmrBefore;
+	float acmrAfter;
+	uint32_t numClusters; // of the overdraw optimization
+};
+
+// smooth normals, weighted by the area of the triangles
+void computeNormals(Mesh& mesh)
+{
+	for (Vertex& v : mesh.vertices)
+		v.normal = glm::vec3(0);
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		Vertex& a = mesh.vertices[mesh.indices[i]];
+		Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+		Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+		const glm::vec3 n = glm::cross(b.pos - a.pos, c.pos - a.pos); // its length is twice the area
+		a.normal += n;
+		b.normal += n;
+		c.normal += n;
+	}
+	for (Vertex& v : mesh.vertices) {
+		const float len = glm::length(v.normal);
+		v.normal = len > 0 ? v.normal / len : glm::vec3(0, 0, 1);
+	}
+}
+
+// merges the vertices that are bitwise identical
+void deduplicate(Mesh& mesh)
+{
+	struct Key {
+		const Vertex* v;
+		bool operator==(const Key& o) const { return memcmp(v, o.v, sizeof(Vertex)) == 0; }
+	};
+	struct KeyHasher {
+		size_t operator()(const Key& key) const
+		{
+			// FNV-1a. Vertex has no padding
+			const uint8_t* bytes = (const uint8_t*)key.v;
+			uint64_t h = 0xcbf29ce484222325;
+			for (size_t i = 0; i < sizeof(Vertex); i++) {
+				h ^= bytes[i];
+				h *= 0x100000001b3;
+			}
+			return size_t(h);
+		}
+	};
+	static_assert(sizeof(Vertex) == 8 * sizeof(float));
+
+	std::unordered_map<Key, uint32_t, KeyHasher> unique;
+	unique.reserve(mesh.vertices.size());
+	std::vector<uint32_t> remap(mesh.vertices.size());
+	std::vector<Vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); i++) {
+		auto [it, added] = unique.emplace(Key{ &mesh.vertices[i] }, uint32_t(vertices.size()));
+		if (added)
+			vertices.push_back(mesh.vertices[i]);
+		remap[i] = it->second;
+	}
+	for (uint32_t& ind : mesh.indices)
+		ind = remap[ind];
+	mesh.vertices = std::move(vertices);
+}
+
+// reads the positions, texture coordinates and normals of a Wavefront OBJ. Polygons are triangulated as fans, the rest is ignored
+// the corners of the faces that reference the same position, texture coordinate and normal share a vertex
+// missing normals are computed from the triangles
+bool loadObj(Mesh& mesh, const char* fileName)
+{
+	FILE* file = fopen(fileName, "r");
+	if (!file)
+		return false;
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> tcs;
+	std::vector<glm::vec3> normals;
+	struct Corner {
+		int64_t pos, tc, normal; // -1 if missing
+		bool operator==(const Corner& o) const { return pos == o.pos && tc == o.tc && normal == o.normal; }
+	};
+	struct CornerHasher {
+		size_t operator()(const Corner& c) const { return size_t(c.pos * 73856093 ^ c.tc * 19349663 ^ c.normal * 83492791); }
+	};
+	std::unordered_map<Corner, uint32_t, CornerHasher> cornerVertices;
+	bool missingNormals = false;
+	mesh = {};
+
+	// OBJ indices start at 1, negative ones are relative to the end of the list
+	auto resolve = [](long ind, size_t count) -> int64_t {
+		if (ind > 0 && size_t(ind) <= count)
+			return ind - 1;
+		if (ind < 0 && size_t(-ind) <= count)
+			return int64_t(count) + ind;
+		return -1;
+	};
+
+	char line[4096];
+	std::vector<uint32_t> polygon;
+	while (fgets(line, sizeof(line), file)) {
+		const char* p = line;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (p[0] == 'v' && p[1] == ' ') {
+			glm::vec3 v(0);
+			sscanf(p + 2, "%f %f %f", &v.x, &v.y, &v.z);
+			positions.push_back(v);
+		}
+		else if (p[0] == 'v' && p[1] == 't') {
+			glm::vec2 tc(0);
+			sscanf(p + 3, "%f %f", &tc.x, &tc.y);
+			tcs.push_back({ tc.x, 1 - tc.y }); // OBJ has the origin at the bottom left
+		}
+		else if (p[0] == 'v' && p[1] == 'n') {
+			glm::vec3 n(0);
+			sscanf(p + 3, "%f %f %f", &n.x, &n.y, &n.z);
+			normals.push_back(n);
+		}
+		else if (p[0] == 'f' && p[1] == ' ') {
+			polygon.clear();
+			char* s = (char*)p + 2;
+			for (;;) {
+				while (*s == ' ' || *s == '\t')
+					s++;
+				char* end;
+				const long posInd = strtol(s, &end, 10);
+				if (end == s)
+					break;
+				s = end;
+				Corner corner = { resolve(posInd, positions.size()), -1, -1 };
+				if (*s == '/') {
+					s++;
+					if (*s != '/') {
+						corner.tc = resolve(strtol(s, &end, 10), tcs.size());
+						s = end;
+					}
+					if (*s == '/') {
+						s++;
+						corner.normal = resolve(strtol(s, &end, 10), normals.size());
+						s = end;
+					}
+				}
+				if (corner.pos < 0) { // malformed
+					fclose(file);
+					return false;
+				}
+				auto [it, added] = cornerVertices.emplace(corner, uint32_t(mesh.vertices.size()));
+				if (added) {
+					mesh.vertices.push_back({
+						.pos = positions[corner.pos],
+						.normal = corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0),
+						.tc = corner.tc >= 0 ? tcs[corner.tc] : glm::vec2(0),
+					});
+					missingNormals |= corner.normal < 0;
+				}
+				polygon.push_back(it->second);
+			}
+			for (size_t i = 2; i < polygon.size(); i++) {
+				mesh.indices.push_back(polygon[0]);
+				mesh.indices.push_back(polygon[i - 1]);
+				mesh.indices.push_back(polygon[i]);
+			}
+		}
+	}
+	fclose(file);
+
+	if (missingNormals)
+		computeNormals(mesh);
+	deduplicate(mesh);
+	return !mesh.indices.empty();
+}
+
+// the ACMR of drawing the triangles in this order, with a FIFO cache of cacheSize entries
+float acmr(std::span<const uint32_t> indices, uint32_t numVertices, uint32_t cacheSize = ACMR_CACHE_SIZE)
+{
+	if (indices.size() < 3)
+		return 0;
+	// a vertex is in the cache if less than cacheSize misses have happened since it was loaded
+	std::vector<uint32_t> loadTime(numVertices, 0);
+	uint32_t time = cacheSize + 1;
+	uint32_t misses = 0;
+	for (uint32_t ind : indices) {
+		if (time - loadTime[ind] > cacheSize) {
+			loadTime[ind] = time++;
+			misses++;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
+
+// Forsyth's vertex scores: the vertices in the cache, and the ones with few triangles left, make their triangles more attractive
+float forsythVertexScore(int cachePos, uint32_t numRemainingTris)
+{
+	if (numRemainingTris == 0)
+		return -1; // nothing left to draw with this vertex
+	float score = 0;
+	if (cachePos >= 0) {
+		if (cachePos < 3) // used by the last triangle: a fixed score, so there's no preference for any particular edge
+			score = 0.75f;
+		else
+			score = powf(1 - float(cachePos - 3) / float(OPTIMIZER_CACHE_SIZE - 3), 1.5f);
+	}
+	// finish off the vertices with few triangles left, so they don't have to be loaded again later
+	score += 2.f * powf(float(numRemainingTris), -0.5f);
+	return score;
+}
+
+// reorders the triangles for the post-transform vertex cache
+void optimizeVertexCache(std::span<uint32_t> indices, uint32_t numVertices)
+{
+	const uint32_t numTris = uint32_t(indices.size() / 3);
+	if (numTris == 0)
+		return;
+
+	// the triangles of each vertex
+	std::vector<uint32_t> triOffsets(numVertices + 1, 0);
+	for (uint32_t ind : indices)
+		triOffsets[ind + 1]++;
+	for (uint32_t v = 0; v < numVertices; v++)
+		triOffsets[v + 1] += triOffsets[v];
+	std::vector<uint32_t> vertexTris(indices.size());
+	std::vector<uint32_t> numRemaining(numVertices, 0); // triangles not emitted yet, they are the first ones of the vertex's list
+	for (uint32_t t = 0; t < numTris; t++) {
+		for (uint32_t k = 0; k < 3; k++) {
+			const uint32_t v = indices[3 * t + k];
+			vertexTris[triOffsets[v] + numRemaining[v]++] = t;
+		}
+	}
+
+	std::vector<int> cachePos(numVertices, -1);
+	std::vector<float> vertexScores(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++)
+		vertexScores[v] = forsythVertexScore(-1, numRemaining[v]);
+	std::vector<float> triScores(numTris);
+	std::vector<bool> emitted(numTris, false);
+	uint32_t bestTri = 0;
+	for (uint32_t t = 0; t < numTris; t++) {
+		triScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+		if (triScores[t] > triScores[bestTri])
+			bestTri = t;
+	}
+
+	std::vector<uint32_t> result(indices.size());
+	uint32_t cache[OPTIMIZER_CACHE_SIZE + 3];
+	uint32_t cacheSize = 0;
+	uint32_t scanPos = 0; // for finding a new starting triangle when the cache has nothing left to offer
+	for (uint32_t outTri = 0; outTri < numTris; outTri++) {
+		if (bestTri == ~0u) {
+			while (emitted[scanPos])
+				scanPos++;
+			bestTri = scanPos;
+		}
+		emitted[bestTri] = true;
+		const uint32_t* tri = &indices[3 * bestTri];
+		result[3 * outTri] = tri[0];
+		result[3 * outTri + 1] = tri[1];
+		result[3 * outTri + 2] = tri[2];
+
+		// the vertices of the triangle go to the front of the cache, the rest are pushed back
+		uint32_t newCache[OPTIMIZER_CACHE_SIZE + 3] = { tri[0], tri[1], tri[2] };
+		uint32_t newCacheSize = 3;
+		for (uint32_t i = 0; i < cacheSize; i++) {
+			const uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCacheSize++] = v;
+		}
+		for (uint32_t k = 0; k < 3; k++) { // the triangle is done: remove it from the lists of its vertices
+			const uint32_t v = tri[k];
+			uint32_t* first = &vertexTris[triOffsets[v]];
+			uint32_t* last = first + numRemaining[v];
+			*std::find(first, last, bestTri) = *(last - 1);
+			numRemaining[v]--;
+		}
+		// update the scores of the vertices that were in the cache, or are now, and of their triangles
+		cacheSize = glm::min(newCacheSize, OPTIMIZER_CACHE_SIZE);
+		for (uint32_t i = 0; i < newCacheSize; i++) {
+			const uint32_t v = newCache[i];
+			cachePos[v] = i < cacheSize ? int(i) : -1;
+			vertexScores[v] = forsythVertexScore(cachePos[v], numRemaining[v]);
+		}
+		bestTri = ~0u;
+		float bestScore = -1;
+		for (uint32_t i = 0; i < newCacheSize; i++) {
+			const uint32_t v = newCache[i];
+			for (uint32_t j = 0; j < numRemaining[v]; j++) {
+				const uint32_t t = vertexTris[triOffsets[v] + j];
+				const uint32_t* tv = &indices[3 * t];
+				triScores[t] = vertexScores[tv[0]] + vertexScores[tv[1]] + vertexScores[tv[2]];
+				// only the triangles of the cached vertices are considered: scanning them all would make it quadratic
+				if (i < cacheSize && triScores[t] > bestScore) {
+					bestScore = triScores[t];
+					bestTri = t;
+				}
+			}
+		}
+		std::copy(newCache, newCache + cacheSize, cache);
+	}
+	std::copy(result.begin(), result.end(), indices.begin());
+}
+
+// the FIFO cache simulation of acmr(), a triangle at a time. Returns the number of misses
+uint32_t simulateTriangle(const uint32_t* tri, std::vector<uint32_t>& loadTime, uint32_t& time)
+{
+	uint32_t misses = 0;
+	for (uint32_t k = 0; k < 3; k++) {
+		if (time - loadTime[tri[k]] > ACMR_CACHE_SIZE) {
+			loadTime[tri[k]] = time++;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+// reorders the triangles to reduce overdraw, keeping the ACMR within threshold times the one of the current order
+// the triangles should be optimized for the vertex cache first. Returns the number of clusters
+uint32_t optimizeOverdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices, float threshold = OVERDRAW_THRESHOLD)
+{
+	const uint32_t numTris = uint32_t(indices.size() / 3);
+	if (numTris == 0)
+		return 0;
+	std::vector<uint32_t> loadTime(vertices.size(), 0);
+	uint32_t time = ACMR_CACHE_SIZE + 1;
+	auto resetCache = [&] { time += ACMR_CACHE_SIZE + 1; };
+
+	// hard boundaries: triangles where the 3 vertices miss the cache, which usually start a disjoint patch of the mesh
+	std::vector<uint32_t> hardStarts;
+	for (uint32_t t = 0; t < numTris; t++) {
+		if (simulateTriangle(&indices[3 * t], loadTime, time) == 3 || t == 0)
+			hardStarts.push_back(t);
+	}
+	hardStarts.push_back(numTris);
+
+	// soft boundaries: each patch is split where its running ACMR is already within the threshold of the ACMR of the whole patch
+	// smaller clusters sort better, but each split starts with a cold cache
+	std::vector<uint32_t> clusterStarts;
+	for (size_t h = 0; h + 1 < hardStarts.size(); h++) {
+		const uint32_t start = hardStarts[h], end = hardStarts[h + 1];
+		resetCache();
+		uint32_t patchMisses = 0;
+		for (uint32_t t = start; t < end; t++)
+			patchMisses += simulateTriangle(&indices[3 * t], loadTime, time);
+		const float clusterThreshold = threshold * float(patchMisses) / float(end - start);
+
+		clusterStarts.push_back(start);
+		resetCache();
+		uint32_t runningMisses = 0, runningTris = 0;
+		for (uint32_t t = start; t < end; t++) {
+			runningMisses += simulateTriangle(&indices[3 * t], loadTime, time);
+			runningTris++;
+			if (float(runningMisses) / float(runningTris) <= clusterThreshold && t + 1 < end) {
+				clusterStarts.push_back(t + 1);
+				resetCache();
+				runningMisses = runningTris = 0;
+			}
+		}
+	}
+	const uint32_t numClusters = uint32_t(clusterStarts.size());
+	clusterStarts.push_back(numTris);
+
+	// the clusters that are far from the center, and face outwards, are likely to occlude the others: they go first
+	glm::dvec3 meshCenter(0);
+	for (uint32_t ind : indices)
+		meshCenter += glm::dvec3(vertices[ind].pos);
+	meshCenter /= double(indices.size());
+	struct ClusterKey {
+		float sortKey;
+		uint32_t cluster;
+	};
+	std::vector<ClusterKey> keys(numClusters);
+	for (uint32_t c = 0; c < numClusters; c++) {
+		glm::vec3 center(0), normal(0);
+		float area = 0;
+		for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+			const glm::vec3& a = vertices[indices[3 * t]].pos;
+			const glm::vec3& b = vertices[indices[3 * t + 1]].pos;
+			const glm::vec3& d = vertices[indices[3 * t + 2]].pos;
+			const glm::vec3 n = glm::cross(b - a, d - a);
+			const float triArea = glm::length(n);
+			center += (a + b + d) * (triArea / 3);
+			normal += n;
+			area += triArea;
+		}
+		center = area > 0 ? center / area : center;
+		const float normalLen = glm::length(normal);
+		normal = normalLen > 0 ? normal / normalLen : normal;
+		keys[c] = { glm::dot(center - glm::vec3(meshCenter), normal), c };
+	}
+	std::stable_sort(keys.begin(), keys.end(), [](const ClusterKey& a, const ClusterKey& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (const ClusterKey& key : keys) {
+		const uint32_t c = key.cluster;
+		result.insert(result.end(), indices.begin() + 3 * clusterStarts[c], indices.begin() + 3 * clusterStarts[c + 1]);
+	}
+	std::copy(result.begin(), result.end(), indices.begin());
+	return numClusters;
+}
+
+// stores the vertices in the order the triangles use them, and drops the unused ones
+void optimizeVertexFetch(Mesh& mesh)
+{
+	std::vector<uint32_t> remap(mesh.vertices.size(), ~0u);
+	std::vector<Vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for (uint32_t& ind : mesh.indices) {
+		if (remap[ind] == ~0u) {
+			remap[ind] = uint32_t(vertices.size());
+			vertices.push_back(mesh.vertices[ind]);
+		}
+		ind = remap[ind];
+	}
+	mesh.vertices = std::move(vertices);
+}
+
+// all the optimizations, in order
+OptimizeStats optimize(Mesh& mesh)
+{
+	OptimizeStats stats = {};
+	stats.acmrBefore = acmr(mesh.indices, uint32_t(mesh.vertices.size()));
+	optimizeVertexCache(mesh.indices, uint32_t(mesh.vertices.size()));
+	stats.numClusters = optimizeOverdraw(mesh.indices, mesh.vertices);
+	optimizeVertexFetch(mesh);
+	stats.acmrAfter = acmr(mesh.indices, uint32_t(mesh.vertices.size()));
+	return stats;
+}
+
+// center and radius
+glm::vec4 boundingSphere(std::span<const Vertex> vertices)
+{
+	if (vertices.empty())
+		return glm::vec4(0);
+	glm::vec3 bmin = vertices[0].pos, bmax = vertices[0].pos;
+	for (const Vertex& v : vertices) {
+		bmin = glm::min(bmin, v.pos);
+		bmax = glm::max(bmax, v.pos);
+	}
+	const glm::vec3 center = 0.5f * (bmin + bmax);
+	float radius = 0;
+	for (const Vertex& v : vertices)
+		radius = glm::max(radius, glm::length(v.pos - center));
+	return glm::vec4(center, radius);
+}
+
+} // namespace mesh
+
+}
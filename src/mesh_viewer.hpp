@@ -0,0 +1,601 @@
+#pragma once
+
+#include <glm/gtc/matrix_transform.hpp>
+#include "helpers.hpp"
+#include "uploader.hpp"
+#include "mesh.hpp"
+#include "vertex_format.hpp"
+#include "meshlets.hpp"
+#include "gpu_culling.hpp"
+
+namespace
+{
+
+// draws an indexed mesh (see mesh.hpp) in an offscreen square target with a depth buffer, so it can be shown in an imgui window
+// the main render pass is 2D and has no depth attachment, that's why the mesh has its own pass
+// there is a single target for all the frames in flight: the dependencies of the render pass order each frame's writes after the
+// previous frame's reads in the fragment shader (imgui's), which are in the same queue
+// the mesh can also be drawn by meshlets (see meshlets.hpp), which are culled on the GPU before being drawn: with a compute pass
+// and indirect draws (gpu_culling.hpp), or with a task shader that launches the mesh shaders of the visible ones (VK_EXT_mesh_shader)
+namespace mesh_view {
+
+static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+static constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D16_UNORM; // always supported as depth attachment
+static constexpr float FOV = glm::radians(45.f);
+
+static constexpr u32 TASK_LOCAL_SIZE = 32; // meshlets culled by each task shader workgroup. Must match mesh_task.glsl
+
+enum class RenderPath {
+	INDEXED, // a single indexed draw of the whole mesh
+	CLUSTER_CULLING, // the meshlets are culled by a compute pass, and the visible ones are drawn with indirect draws
+	MESH_SHADER, // a task shader culls the meshlets, and launches a mesh shader workgroup for each visible one
+	COUNT
+};
+static ConstStr RENDER_PATH_NAMES[] = { "indexed draw", "cluster culling + indirect draws", "task + mesh shaders" };
+
+// must match the push_constant block of mesh_vert.glsl
+struct PushConstants {
+	glm::mat4 modelViewProj;
+	glm::vec4 lightDir; // in model space, pointing to the light
+	glm::vec4 tcScaleOffset; // dequantization of the texture coordinates
+};
+
+// must match the push_constant blocks of mesh_task.glsl and mesh_mesh.glsl
+struct MeshShaderPushConstants {
+	glm::mat4 modelViewProj; // from the original model space: the mesh shader dequantizes the positions itself
+	glm::vec4 lightDir;
+	glm::vec4 cameraPos; // in model space, for the normal cones
+	u32 numMeshlets;
+};
+
+// must match the MeshInfo block of mesh_mesh.glsl
+struct MeshInfo {
+	glm::vec4 posScale;
+	glm::vec4 posOffset;
+	glm::vec4 tcScaleOffset;
+};
+
+struct Viewer {
+	VkDevice device = VK_NULL_HANDLE;
+	VmaAllocator allocator;
+	u32 size; // of the target, in pixels
+	VkImage colorImg; // in SHADER_READ_ONLY_OPTIMAL layout after cmdRender
+	VmaAllocation colorAlloc;
+	VkImageView colorView;
+	VkImage depthImg;
+	VmaAllocation depthAlloc;
+	VkImageView depthView;
+	VkRenderPass renderPass;
+	VkFramebuffer framebuffer;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+	vfmt::Layout layout; // of the vertex buffer
+	RenderPath renderPath = RenderPath::INDEXED;
+	gpu_cull::Culler culler; // the objects are the meshlets. Not initialized if the GPU culling features are not supported
+	// mesh shader path, only if VK_EXT_mesh_shader is enabled
+	bool meshShaders = false;
+	PFN_vkCmdDrawMeshTasksEXT vkCmdDrawMeshTasksEXT;
+	VkDescriptorSetLayout msSetLayout;
+	VkDescriptorPool msDescPool;
+	VkDescriptorSet msDescSet; // written by setMesh
+	VkPipelineLayout msPipelineLayout;
+	VkPipeline msPipeline;
+	// the mesh
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VmaAllocation vertexAlloc;
+	VkBuffer indexBuffer;
+	VmaAllocation indexAlloc;
+	VkIndexType indexType;
+	u32 numVertices = 0;
+	u32 numIndices = 0;
+	u64 vertexBufferSize = 0;
+	vfmt::Dequantize dequantize;
+	glm::vec4 sphere; // bounding sphere, for framing the camera
+	u32 numMeshlets = 0;
+	// the meshlets of the mesh shader path
+	VkBuffer meshletsBuffer = VK_NULL_HANDLE; // meshlets::Meshlet
+	VmaAllocation meshletsAlloc;
+	VkBuffer meshletVerticesBuffer;
+	VmaAllocation meshletVerticesAlloc;
+	VkBuffer meshletTrianglesBuffer;
+	VmaAllocation meshletTrianglesAlloc;
+	VkBuffer meshInfoBuffer; // MeshInfo
+	VmaAllocation meshInfoAlloc;
+};
+
+// task shaders are needed too, for culling the meshlets
+bool meshShaderFeaturesAreSupported(const VkPhysicalDeviceMeshShaderFeaturesEXT& supported)
+{
+	return supported.taskShader && supported.meshShader;
+}
+
+void enableMeshShaderFeatures(VkPhysicalDeviceMeshShaderFeaturesEXT& features)
+{
+	features.taskShader = VK_TRUE;
+	features.meshShader = VK_TRUE;
+}
+
+bool renderPathIsSupported(const Viewer& v, RenderPath path)
+{
+	switch (path) {
+	case RenderPath::INDEXED:
+		return true;
+	case RenderPath::CLUSTER_CULLING:
+		return v.culler.device != VK_NULL_HANDLE;
+	case RenderPath::MESH_SHADER:
+		return v.culler.device != VK_NULL_HANDLE && v.meshShaders;
+	default:
+		return false;
+	}
+}
+
+VkRenderPass createRenderPass(VkDevice device)
+{
+	const VkAttachmentDescription attachments[] = {
+		{
+			.format = COLOR_FORMAT,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, // sampled by imgui
+		},
+		{
+			.format = DEPTH_FORMAT,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		},
+	};
+	const VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	const VkAttachmentReference depthRef = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+	const VkSubpassDescription subpass = {
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &colorRef,
+		.pDepthStencilAttachment = &depthRef,
+	};
+	const VkSubpassDependency dependencies[] = {
+		{ // the previous frame sampled the color, and wrote the depth
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+			.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		},
+		{ // the color is sampled afterwards
+			.srcSubpass = 0,
+			.dstSubpass = VK_SUBPASS_EXTERNAL,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+		},
+	};
+	const VkRenderPassCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = u32(std::size(attachments)),
+		.pAttachments = attachments,
+		.subpassCount = 1,
+		.pSubpasses = &subpass,
+		.dependencyCount = u32(std::size(dependencies)),
+		.pDependencies = dependencies,
+	};
+	VkRenderPass rp;
+	VkResult vkRes = vkCreateRenderPass(device, &info, nullptr, &rp);
+	vk::assertRes(vkRes);
+	return rp;
+}
+
+// the task shader culls the meshlets with the objects and the counts of the culler, and the mesh shader fetches the vertices itself
+void createMeshShaderPipeline(Viewer& v, VkPipelineCache pipelineCache)
+{
+	v.vkCmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(v.device, "vkCmdDrawMeshTasksEXT");
+	assert(v.vkCmdDrawMeshTasksEXT);
+
+	// 0: objects, 1: counts (task shader). 2: meshlets, 3: meshlet vertices, 4: meshlet triangles, 5: vertices, 6: MeshInfo (mesh shader)
+	VkDescriptorSetLayoutBinding bindings[7];
+	for (u32 i = 0; i < 7; i++) {
+		bindings[i] = {
+			.binding = i,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VkShaderStageFlags(i < 2 ? VK_SHADER_STAGE_TASK_BIT_EXT : VK_SHADER_STAGE_MESH_BIT_EXT),
+		};
+	}
+	const VkDescriptorSetLayoutCreateInfo layoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = u32(std::size(bindings)),
+		.pBindings = bindings,
+	};
+	VkResult vkRes = vkCreateDescriptorSetLayout(v.device, &layoutInfo, nullptr, &v.msSetLayout);
+	vk::assertRes(vkRes);
+	const VkDescriptorPoolSize poolSize = { .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = u32(std::size(bindings)) };
+	v.msDescPool = vk::createDescriptorPool(v.device, 1, { &poolSize, 1 });
+	vk::allocDescSets(v.device, v.msDescPool, { &v.msSetLayout, 1 }, { &v.msDescSet, 1 });
+
+	const VkPushConstantRange pushConstantRange = {
+		.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT,
+		.offset = 0,
+		.size = sizeof(MeshShaderPushConstants),
+	};
+	v.msPipelineLayout = vk::createPipelineLayout(v.device, { &v.msSetLayout, 1 }, { &pushConstantRange, 1 });
+
+	// the specialization constants of mesh_mesh.glsl: the vertex layout, with the offsets in 32-bit words
+	const vfmt::Layout& layout = v.layout;
+	assert(layout.stride % 4 == 0 && layout.normalOffset % 4 == 0 && layout.tcOffset % 4 == 0);
+	const u32 specData[] = { layout.normal == vfmt::NormalFormat::OCT_SNORM16, u32(layout.pos), u32(layout.tc),
+		layout.stride / 4, layout.normalOffset / 4, layout.tcOffset / 4 };
+	VkSpecializationMapEntry specEntries[std::size(specData)];
+	for (u32 i = 0; i < std::size(specData); i++)
+		specEntries[i] = { .constantID = i, .offset = i * u32(sizeof(u32)), .size = sizeof(u32) };
+	const VkSpecializationInfo specInfo = {
+		.mapEntryCount = u32(std::size(specEntries)),
+		.pMapEntries = specEntries,
+		.dataSize = sizeof(specData),
+		.pData = specData,
+	};
+	const vk::ShaderStages shaderStages = {
+		.task = {vk::loadShaderModule(v.device, "shaders/mesh_task.spirv")},
+		.mesh = {vk::loadShaderModule(v.device, "shaders/mesh_mesh.spirv"), &specInfo},
+		.fragment = {vk::loadShaderModule(v.device, "shaders/mesh_frag.spirv")},
+	};
+	const VkPipelineColorBlendAttachmentState blendInfo = {
+		.blendEnable = VK_FALSE,
+		.colorWriteMask = VK_COLOR_COMPONENT_RGBA_BITS,
+	};
+	const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	v.msPipeline = vk::createGraphicsPipeline(v.device, {
+		.shaderStages = shaderStages,
+		.cullMode = VK_CULL_MODE_BACK_BIT,
+		.faceClockwise = false, // same winding as the index buffer
+		.depthTest = true,
+		.attachmentsBlendInfos = { &blendInfo, 1 },
+		.dynamicStates = dynamicStates,
+		.pipelineLayout = v.msPipelineLayout,
+		.renderPass = v.renderPass,
+		.subpass = 0,
+		.pipelineCache = pipelineCache,
+	});
+	vkDestroyShaderModule(v.device, shaderStages.task.module, nullptr);
+	vkDestroyShaderModule(v.device, shaderStages.mesh.module, nullptr);
+	vkDestroyShaderModule(v.device, shaderStages.fragment.module, nullptr);
+}
+
+// the meshes are converted to the vertex layout when they are set
+// the meshlets need the GPU culling features (see gpu_cull::featuresAreSupported), and meshShaders the features of meshShaderFeaturesAreSupported
+// enabledFeatures, drawIndirectCount and meshShaders: what is enabled in the device. maxMeshlets: of the meshes that will be set
+void init(Viewer& v, VkDevice device, VmaAllocator allocator, const VkPhysicalDeviceProperties& props, const VkPhysicalDeviceFeatures& enabledFeatures,
+	bool drawIndirectCount, bool meshShaders, VkPipelineCache pipelineCache, u32 size, const vfmt::Layout& layout, u32 maxMeshlets, u32 numFrames)
+{
+	v.device = device;
+	v.allocator = allocator;
+	v.size = size;
+	v.layout = layout;
+
+	vk::Img colorInfo = {
+		.width = size,
+		.height = size,
+		.mipLevels = 1,
+		.format = COLOR_FORMAT,
+		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	};
+	vk::createStaticImage(device, allocator, colorInfo, v.colorImg, v.colorAlloc, nullptr, &v.colorView);
+	vk::Img depthInfo = {
+		.width = size,
+		.height = size,
+		.mipLevels = 1,
+		.format = DEPTH_FORMAT,
+		.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+	};
+	vk::createStaticImage(device, allocator, depthInfo, v.depthImg, v.depthAlloc, nullptr, &v.depthView);
+
+	v.renderPass = createRenderPass(device);
+	const VkImageView attachments[] = { v.colorView, v.depthView };
+	v.framebuffer = vk::createFramebuffer(device, v.renderPass, attachments, size, size);
+
+	const VkPushConstantRange pushConstantRange = {
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		.offset = 0,
+		.size = sizeof(PushConstants),
+	};
+	v.pipelineLayout = vk::createPipelineLayout(device, {}, { &pushConstantRange, 1 });
+
+	// the OCT_NORMALS specialization constant of mesh_vert.glsl
+	const VkBool32 octNormals = layout.normal == vfmt::NormalFormat::OCT_SNORM16;
+	const VkSpecializationMapEntry specEntry = { .constantID = 0, .offset = 0, .size = sizeof(VkBool32) };
+	const VkSpecializationInfo specInfo = {
+		.mapEntryCount = 1,
+		.pMapEntries = &specEntry,
+		.dataSize = sizeof(octNormals),
+		.pData = &octNormals,
+	};
+	const vk::ShaderStages shaderStages = {
+		.vertex = {vk::loadShaderModule(device, "shaders/mesh_vert.spirv"), &specInfo},
+		.fragment = {vk::loadShaderModule(device, "shaders/mesh_frag.spirv")},
+	};
+	const VkVertexInputBindingDescription binding = vfmt::bindingDesc(layout, 0);
+	const auto attribs = vfmt::attribs(layout, 0, 0);
+	const VkPipelineColorBlendAttachmentState blendInfo = {
+		.blendEnable = VK_FALSE,
+		.colorWriteMask = VK_COLOR_COMPONENT_RGBA_BITS,
+	};
+	const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	v.pipeline = vk::createGraphicsPipeline(device, {
+		.shaderStages = shaderStages,
+		.vertexInputBindings = { &binding, 1 },
+		.vertexInputAttribs = attribs,
+		.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		.cullMode = VK_CULL_MODE_BACK_BIT,
+		.faceClockwise = false, // OBJ winding. The projection flips Y, so it's still counter clockwise in the framebuffer
+		.depthTest = true,
+		.attachmentsBlendInfos = { &blendInfo, 1 },
+		.dynamicStates = dynamicStates,
+		.pipelineLayout = v.pipelineLayout,
+		.renderPass = v.renderPass,
+		.subpass = 0,
+		.pipelineCache = pipelineCache,
+	});
+	vkDestroyShaderModule(device, shaderStages.vertex.module, nullptr);
+	vkDestroyShaderModule(device, shaderStages.fragment.module, nullptr);
+
+	if (gpu_cull::featuresAreSupported(enabledFeatures))
+		gpu_cull::init(v.culler, device, allocator, props, enabledFeatures, drawIndirectCount, pipelineCache, maxMeshlets, numFrames);
+	v.meshShaders = meshShaders && v.culler.device != VK_NULL_HANDLE;
+	if (v.meshShaders)
+		createMeshShaderPipeline(v, pipelineCache);
+}
+
+void destroyMeshBuffers(Viewer& v)
+{
+	if (v.vertexBuffer == VK_NULL_HANDLE)
+		return;
+	vmaDestroyBuffer(v.allocator, v.vertexBuffer, v.vertexAlloc);
+	vmaDestroyBuffer(v.allocator, v.indexBuffer, v.indexAlloc);
+	v.vertexBuffer = VK_NULL_HANDLE;
+	v.numVertices = v.numIndices = 0;
+	v.vertexBufferSize = 0;
+	v.numMeshlets = 0;
+	if (v.meshletsBuffer != VK_NULL_HANDLE) {
+		vmaDestroyBuffer(v.allocator, v.meshletsBuffer, v.meshletsAlloc);
+		vmaDestroyBuffer(v.allocator, v.meshletVerticesBuffer, v.meshletVerticesAlloc);
+		vmaDestroyBuffer(v.allocator, v.meshletTrianglesBuffer, v.meshletTrianglesAlloc);
+		vmaDestroyBuffer(v.allocator, v.meshInfoBuffer, v.meshInfoAlloc);
+		v.meshletsBuffer = VK_NULL_HANDLE;
+	}
+}
+
+void destroy(Viewer& v)
+{
+	if (v.device == VK_NULL_HANDLE)
+		return;
+	destroyMeshBuffers(v);
+	gpu_cull::destroy(v.culler);
+	if (v.meshShaders) {
+		vkDestroyPipeline(v.device, v.msPipeline, nullptr);
+		vkDestroyPipelineLayout(v.device, v.msPipelineLayout, nullptr);
+		vkDestroyDescriptorPool(v.device, v.msDescPool, nullptr);
+		vkDestroyDescriptorSetLayout(v.device, v.msSetLayout, nullptr);
+	}
+	vkDestroyPipeline(v.device, v.pipeline, nullptr);
+	vkDestroyPipelineLayout(v.device, v.pipelineLayout, nullptr);
+	vkDestroyFramebuffer(v.device, v.framebuffer, nullptr);
+	vkDestroyRenderPass(v.device, v.renderPass, nullptr);
+	vkDestroyImageView(v.device, v.colorView, nullptr);
+	vmaDestroyImage(v.allocator, v.colorImg, v.colorAlloc);
+	vkDestroyImageView(v.device, v.depthView, nullptr);
+	vmaDestroyImage(v.allocator, v.depthImg, v.depthAlloc);
+	v = {};
+}
+
+// the meshlets of the mesh shader path, and the descriptors of the task and mesh shaders
+void setMeshletBuffers(Viewer& v, upload::Uploader& up, const meshlets::Meshlets& ml)
+{
+	auto createBuffer = [&](const void* data, size_t size, VkBuffer& buffer, VmaAllocation& alloc) {
+		vk::createDeviceBuffer(v.allocator, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, buffer, alloc);
+		upload::copyToBuffer(up, buffer, 0, data, size);
+	};
+	createBuffer(ml.meshlets.data(), ml.meshlets.size() * sizeof(meshlets::Meshlet), v.meshletsBuffer, v.meshletsAlloc);
+	createBuffer(ml.vertices.data(), ml.vertices.size() * sizeof(u32), v.meshletVerticesBuffer, v.meshletVerticesAlloc);
+	assert(ml.triangles.size() % 4 == 0); // read as 32-bit words
+	createBuffer(ml.triangles.data(), ml.triangles.size(), v.meshletTrianglesBuffer, v.meshletTrianglesAlloc);
+	const MeshInfo meshInfo = {
+		.posScale = glm::vec4(v.dequantize.posScale, 0),
+		.posOffset = glm::vec4(v.dequantize.posOffset, 0),
+		.tcScaleOffset = glm::vec4(v.dequantize.tcScale, v.dequantize.tcOffset),
+	};
+	createBuffer(&meshInfo, sizeof(meshInfo), v.meshInfoBuffer, v.meshInfoAlloc);
+
+	const VkDescriptorBufferInfo bufferInfos[] = {
+		{ .buffer = v.culler.objectsBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = v.culler.countBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = v.meshletsBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = v.meshletVerticesBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = v.meshletTrianglesBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = v.vertexBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = v.meshInfoBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+	};
+	const VkWriteDescriptorSet write = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = v.msDescSet,
+		.dstBinding = 0,
+		.descriptorCount = u32(std::size(bufferInfos)), // consecutive bindings
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = bufferInfos,
+	};
+	vkUpdateDescriptorSets(v.device, 1, &write, 0, nullptr);
+}
+
+// uploads the vertices, in the layout of the viewer, and the indices. 16-bit indices are used if the mesh is small enough, they halve the index fetch bandwidth
+// the meshlets (see meshlets::build) must be of the same index buffer. They become the objects of the culler, as ranges of the index buffer
+// the previous mesh must not be in use by the GPU anymore
+void setMesh(Viewer& v, upload::Uploader& up, const mesh::Mesh& m, const meshlets::Meshlets& ml)
+{
+	destroyMeshBuffers(v);
+	v.numVertices = u32(m.vertices.size());
+	v.numIndices = u32(m.indices.size());
+	v.sphere = mesh::boundingSphere(m.vertices);
+
+	const std::vector<u8> vertices = vfmt::encode(v.layout, m.vertices, v.dequantize);
+	v.vertexBufferSize = vertices.size();
+	const VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+		(v.meshShaders ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0); // the mesh shader fetches the vertices itself
+	vk::createDeviceBuffer(v.allocator, vertices.size(), vertexUsage, v.vertexBuffer, v.vertexAlloc);
+	upload::copyToBuffer(up, v.vertexBuffer, 0, vertices.data(), vertices.size());
+
+	if (v.numVertices <= 0xFFFF) { // 0xFFFF could be a primitive restart, so it's not a valid vertex index for us
+		v.indexType = VK_INDEX_TYPE_UINT16;
+		std::vector<u16> indices16(m.indices.begin(), m.indices.end());
+		vk::createDeviceBuffer(v.allocator, indices16.size() * sizeof(u16), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, v.indexBuffer, v.indexAlloc);
+		upload::copyToBuffer(up, v.indexBuffer, 0, indices16.data(), indices16.size() * sizeof(u16));
+	}
+	else {
+		v.indexType = VK_INDEX_TYPE_UINT32;
+		vk::createDeviceBuffer(v.allocator, m.indices.size() * sizeof(u32), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, v.indexBuffer, v.indexAlloc);
+		upload::copyToBuffer(up, v.indexBuffer, 0, m.indices.data(), m.indices.size() * sizeof(u32));
+	}
+
+	if (v.culler.device == VK_NULL_HANDLE)
+		return;
+	if (ml.meshlets.size() > v.culler.capacity) { // the meshlets paths are not available for this mesh, see cmdRender
+		fprintf(stderr, "the mesh has %zu meshlets, the viewer was initialized for up to %u\n", ml.meshlets.size(), v.culler.capacity);
+		return;
+	}
+	v.numMeshlets = u32(ml.meshlets.size());
+	std::vector<gpu_cull::Object> objects(v.numMeshlets);
+	for (u32 i = 0; i < v.numMeshlets; i++) {
+		objects[i] = {
+			.sphere = ml.bounds[i].sphere,
+			.cone = ml.bounds[i].cone,
+			.indexCount = 3 * ml.meshlets[i].triangleCount,
+			.firstIndex = ml.firstIndices[i],
+			.vertexOffset = 0,
+			.firstInstance = 0,
+		};
+	}
+	gpu_cull::setObjects(v.culler, up, objects);
+	if (v.meshShaders)
+		setMeshletBuffers(v, up, ml);
+}
+
+// the camera looks at the mesh from a distance that fits its bounding sphere, and the mesh rotates around its vertical axis
+struct Camera {
+	glm::mat4 modelViewProj; // from the original model space, where the bounds of the meshlets are
+	glm::vec3 pos; // in model space
+	glm::vec3 lightDir; // in model space, pointing to the light
+};
+
+Camera camera(const Viewer& v, float angle)
+{
+	const glm::vec3 center = glm::vec3(v.sphere);
+	const float radius = glm::max(v.sphere.w, 1e-6f);
+	const float distance = 1.1f * radius / glm::sin(0.5f * FOV);
+	const glm::mat4 rotation = glm::rotate(glm::mat4(1), angle, glm::vec3(0, 1, 0));
+	const glm::mat4 model = rotation * glm::translate(glm::mat4(1), -center);
+	const glm::mat4 view = glm::translate(glm::mat4(1), glm::vec3(0, 0, -distance));
+	glm::mat4 proj = glm::perspectiveRH_ZO(FOV, 1.f, distance - 1.2f * radius, distance + 1.2f * radius);
+	proj[1][1] *= -1; // Vulkan's clip space has Y pointing down
+	const glm::vec3 worldLightDir = glm::normalize(glm::vec3(0.5f, 1, 1));
+	return {
+		.modelViewProj = proj * view * model,
+		.pos = glm::vec3(glm::inverse(view * model)[3]),
+		.lightDir = glm::transpose(glm::mat3(rotation)) * worldLightDir,
+	};
+}
+
+// of the vertex shader path
+PushConstants pushConstants(const Viewer& v, const Camera& cam)
+{
+	// the quantized positions are relative to the bounding box: the model matrix takes them back to the original space first
+	const glm::mat4 dequantize = glm::scale(glm::translate(glm::mat4(1), v.dequantize.posOffset), v.dequantize.posScale);
+	return {
+		.modelViewProj = cam.modelViewProj * dequantize,
+		.lightDir = glm::vec4(cam.lightDir, 0),
+		.tcScaleOffset = glm::vec4(v.dequantize.tcScale, v.dequantize.tcOffset),
+	};
+}
+
+// records the render pass of the mesh, and the culling of the meshlets before it. Must be outside of any other render pass
+// the counts of the culling are read back in the frame slot, see gpu_cull::readStats
+void cmdRender(Viewer& v, VkCommandBuffer cmdBuffer, u32 frameInd, float angle)
+{
+	const Camera cam = camera(v, angle);
+	const RenderPath path = v.numMeshlets ? v.renderPath : RenderPath::INDEXED; // no meshlets without a mesh
+	assert(renderPathIsSupported(v, path));
+	if (path == RenderPath::CLUSTER_CULLING) {
+		glm::vec4 planes[6];
+		gpu_cull::frustumPlanes(cam.modelViewProj, planes);
+		gpu_cull::cmdCull(v.culler, cmdBuffer, frameInd, planes, cam.pos);
+	}
+	else if (path == RenderPath::MESH_SHADER) {
+		gpu_cull::cmdResetCounts(v.culler, cmdBuffer, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT);
+	}
+
+	const VkClearValue clearValues[] = {
+		{ .color = {0.2f, 0.2f, 0.25f, 1.f} },
+		{ .depthStencil = {1.f, 0} },
+	};
+	const VkRenderPassBeginInfo rpBeginInfo = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.renderPass = v.renderPass,
+		.framebuffer = v.framebuffer,
+		.renderArea = {{0, 0}, {v.size, v.size}},
+		.clearValueCount = u32(std::size(clearValues)),
+		.pClearValues = clearValues,
+	};
+	vkCmdBeginRenderPass(cmdBuffer, &rpBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	if (v.numIndices) {
+		const VkViewport viewport = { 0, 0, float(v.size), float(v.size), 0, 1 };
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+		const VkRect2D scissor = { {0, 0}, {v.size, v.size} };
+		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+		if (path == RenderPath::MESH_SHADER) {
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, v.msPipeline);
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, v.msPipelineLayout, 0, 1, &v.msDescSet, 0, nullptr);
+			const MeshShaderPushConstants pc = {
+				.modelViewProj = cam.modelViewProj,
+				.lightDir = glm::vec4(cam.lightDir, 0),
+				.cameraPos = glm::vec4(cam.pos, 1),
+				.numMeshlets = v.numMeshlets,
+			};
+			vkCmdPushConstants(cmdBuffer, v.msPipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0, sizeof(pc), &pc);
+			v.vkCmdDrawMeshTasksEXT(cmdBuffer, (v.numMeshlets + TASK_LOCAL_SIZE - 1) / TASK_LOCAL_SIZE, 1, 1);
+		}
+		else {
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, v.pipeline);
+			const PushConstants pc = pushConstants(v, cam);
+			vkCmdPushConstants(cmdBuffer, v.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pc), &pc);
+			const VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &v.vertexBuffer, &offset);
+			vkCmdBindIndexBuffer(cmdBuffer, v.indexBuffer, 0, v.indexType);
+			if (path == RenderPath::CLUSTER_CULLING)
+				gpu_cull::cmdDraw(v.culler, cmdBuffer);
+			else
+				vkCmdDrawIndexed(cmdBuffer, v.numIndices, 1, 0, 0, 0);
+		}
+	}
+	vkCmdEndRenderPass(cmdBuffer);
+
+	if (path == RenderPath::MESH_SHADER) {
+		const VkMemoryBarrier countsBarrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+		};
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &countsBarrier, 0, nullptr, 0, nullptr);
+		gpu_cull::cmdReadbackCounts(v.culler, cmdBuffer, frameInd);
+	}
+}
+
+} // namespace mesh_view
+
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh.hpp"
+
+namespace
+{
+
+// meshlets: the mesh is split in small clusters of triangles, which can be culled on the GPU one by one (see gpu_culling.hpp), and
+// are the unit of work of mesh shaders
+// the clusters are built greedily, following the order of the index buffer: it's already optimized for the vertex cache, so
+// consecutive triangles share many vertices. The triangles of each meshlet are then a contiguous range of the index buffer too,
+// so the meshlets can also be drawn as regular indexed draws
+// each meshlet has a bounding sphere, and a normal cone: if the camera is behind all the triangles of the meshlet, it can be culled
+// (see "Optimizing the Graphics Pipeline with Compute", Wihlidal, and meshoptimizer's meshopt_computeMeshletBounds)
+namespace meshlets {
+
+static constexpr uint32_t MAX_VERTICES = 64;
+static constexpr uint32_t MAX_TRIANGLES = 124; // the 126 of the first mesh shader hardware, rounded down so the local indices take a multiple of 4 bytes
+
+// must match the Meshlet struct of mesh_mesh.glsl
+struct Meshlet {
+	uint32_t vertexOffset; // in Meshlets::vertices
+	uint32_t triangleOffset; // in Meshlets::triangles, a multiple of 4
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+struct Bounds {
+	glm::vec4 sphere; // center and radius
+	glm::vec4 cone; // axis and cutoff, see gpu_cull::Object
+};
+
+struct Meshlets {
+	std::vector<Meshlet> meshlets;
+	std::vector<Bounds> bounds; // of each meshlet
+	std::vector<uint32_t> firstIndices; // of each meshlet, in the index buffer of the mesh
+	std::vector<uint32_t> vertices; // the vertices of each meshlet, as indices of the vertex buffer
+	std::vector<uint8_t> triangles; // 3 local vertex indices per triangle. The triangles of each meshlet start 4-byte aligned
+};
+
+Bounds computeBounds(const mesh::Mesh& m, const Meshlets& ml, const Meshlet& meshlet)
+{
+	Bounds bounds;
+	const uint32_t* vertices = &ml.vertices[meshlet.vertexOffset];
+	glm::vec3 bmin = m.vertices[vertices[0]].pos, bmax = bmin;
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+		bmin = glm::min(bmin, m.vertices[vertices[i]].pos);
+		bmax = glm::max(bmax, m.vertices[vertices[i]].pos);
+	}
+	const glm::vec3 center = 0.5f * (bmin + bmax);
+	float radius = 0;
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		radius = glm::max(radius, glm::length(m.vertices[vertices[i]].pos - center));
+	bounds.sphere = glm::vec4(center, radius);
+
+	// the axis is the average of the normals of the triangles, and the cone is as wide as the farthest one
+	glm::vec3 normals[MAX_TRIANGLES];
+	uint32_t numNormals = 0;
+	glm::vec3 axis(0);
+	for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+		const uint8_t* tri = &ml.triangles[meshlet.triangleOffset + 3 * t];
+		const glm::vec3& a = m.vertices[vertices[tri[0]]].pos;
+		const glm::vec3& b = m.vertices[vertices[tri[1]]].pos;
+		const glm::vec3& c = m.vertices[vertices[tri[2]]].pos;
+		const glm::vec3 n = glm::cross(b - a, c - a);
+		const float len = glm::length(n);
+		if (len == 0) // degenerate: it's never rasterized, so it doesn't matter where it faces
+			continue;
+		normals[numNormals] = n / len;
+		axis += normals[numNormals];
+		numNormals++;
+	}
+	const float axisLen = glm::length(axis);
+	float minDot = 1;
+	if (axisLen > 0) {
+		axis /= axisLen;
+		for (uint32_t i = 0; i < numNormals; i++)
+			minDot = glm::min(minDot, glm::dot(axis, normals[i]));
+	}
+	else {
+		minDot = -1;
+	}
+	// the test uses the sphere instead of the apex of the cone, so it's conservative. Cones wider than a hemisphere (or close to it)
+	// would almost never be culled: they are disabled with cutoff 1
+	const float cutoff = minDot <= 0.1f ? 1.f : glm::sqrt(1 - minDot * minDot);
+	bounds.cone = glm::vec4(axis, cutoff);
+	return bounds;
+}
+
+// the mesh should be optimized for the vertex cache first (see mesh::optimize), so the meshlets get more triangles per vertex
+Meshlets build(const mesh::Mesh& m)
+{
+	Meshlets ml;
+	std::vector<uint8_t> localIndices(m.vertices.size(), 0xFF); // of the vertices in the current meshlet
+	Meshlet meshlet = {};
+	uint32_t firstIndex = 0;
+
+	auto finishMeshlet = [&](uint32_t nextFirstIndex) {
+		if (meshlet.triangleCount == 0)
+			return;
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+			localIndices[ml.vertices[meshlet.vertexOffset + i]] = 0xFF;
+		while (ml.triangles.size() % 4)
+			ml.triangles.push_back(0);
+		ml.meshlets.push_back(meshlet);
+		ml.bounds.push_back(computeBounds(m, ml, meshlet));
+		ml.firstIndices.push_back(firstIndex);
+		firstIndex = nextFirstIndex;
+		meshlet = {
+			.vertexOffset = uint32_t(ml.vertices.size()),
+			.triangleOffset = uint32_t(ml.triangles.size()),
+		};
+	};
+
+	for (uint32_t i = 0; i + 2 < m.indices.size(); i += 3) {
+		const uint32_t* tri = &m.indices[i];
+		uint32_t numNewVertices = 0;
+		for (uint32_t k = 0; k < 3; k++)
+			numNewVertices += localIndices[tri[k]] == 0xFF && (k == 0 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]);
+		if (meshlet.vertexCount + numNewVertices > MAX_VERTICES || meshlet.triangleCount == MAX_TRIANGLES)
+			finishMeshlet(i);
+		for (uint32_t k = 0; k < 3; k++) {
+			uint8_t& local = localIndices[tri[k]];
+			if (local == 0xFF) {
+				local = uint8_t(meshlet.vertexCount++);
+				ml.vertices.push_back(tri[k]);
+			}
+			ml.triangles.push_back(local);
+		}
+		meshlet.triangleCount++;
+	}
+	finishMeshlet(uint32_t(m.indices.size()));
+	return ml;
+}
+
+} // namespace meshlets
+
+}
@@ -0,0 +1,496 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define PIXCONV_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define PIXCONV_NEON
+	#include <arm_neon.h>
+#endif
+
+// gcc and clang need the instruction set of each function, so the rest of the binary still runs on CPUs without it
+// msvc accepts any intrinsic without flags
+#if defined(__GNUC__) || defined(__clang__)
+	#define PIXCONV_TARGET(isa) __attribute__((target(isa)))
+#else
+	#define PIXCONV_TARGET(isa)
+#endif
+
+namespace
+{
+
+// pixel format conversion kernels for the upload path, meant to write straight into mapped staging memory
+// each kernel has a scalar version and SIMD versions (SSSE3, AVX2, NEON), selected at runtime depending on the CPU
+// all the versions of a kernel produce exactly the same output
+// the kernels convert numPixels consecutive pixels. For images with padded rows use convertRows()
+// RGBA pixels are 4 bytes (or 4 floats). The alpha channel is always linear: the sRGB conversions only apply to the color channels
+namespace pixconv {
+
+enum class Isa { SCALAR, SSSE3, AVX2, NEON, COUNT };
+static const char* ISA_NAMES[] = { "scalar", "ssse3", "avx2", "neon" };
+
+struct Kernels {
+	Isa isa;
+	void (*rgbToRgba)(uint8_t* dst, const uint8_t* src, uint32_t numPixels); // alpha = 255
+	void (*swapRedBlue)(uint8_t* dst, const uint8_t* src, uint32_t numPixels); // RGBA <-> BGRA
+	void (*premultiplyAlpha)(uint8_t* dst, const uint8_t* src, uint32_t numPixels); // RGBA8, rounded exactly: c * a / 255
+	void (*srgbToLinear)(float* dst, const uint8_t* src, uint32_t numPixels); // RGBA8 sRGB -> RGBA32F linear
+	void (*linearToSrgb)(uint8_t* dst, const float* src, uint32_t numPixels); // RGBA32F linear -> RGBA8 sRGB
+};
+
+static constexpr uint32_t LINEAR_TO_SRGB_BITS = 12;
+static constexpr uint32_t LINEAR_TO_SRGB_SIZE = 1 << LINEAR_TO_SRGB_BITS;
+
+struct Tables {
+	float srgbToLinear[512]; // [0, 256): sRGB to linear, [256, 512): alpha, just divided by 255
+	// linear, quantized to LINEAR_TO_SRGB_BITS, to sRGB. The error is at most 1 in the darkest values, where the curve is steep
+	// there are 3 more bytes at the end so the AVX2 gather can read 4 bytes from any entry
+	uint8_t linearToSrgb[LINEAR_TO_SRGB_SIZE + 3];
+};
+
+const Tables& tables()
+{
+	static const Tables t = [] {
+		Tables t = {};
+		for (uint32_t i = 0; i < 256; i++) {
+			const float c = i / 255.f;
+			t.srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			t.srgbToLinear[256 + i] = c;
+		}
+		for (uint32_t i = 0; i < LINEAR_TO_SRGB_SIZE; i++) {
+			const float c = float(i) / (LINEAR_TO_SRGB_SIZE - 1);
+			const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+			t.linearToSrgb[i] = uint8_t(s * 255.f + 0.5f);
+		}
+		return t;
+	}();
+	return t;
+}
+
+// ---- scalar ----
+
+uint8_t mulDiv255(uint32_t c, uint32_t a)
+{
+	const uint32_t x = c * a + 128;
+	return uint8_t((x + (x >> 8)) >> 8);
+}
+
+// NaNs become 0
+float saturate(float x)
+{
+	x = x > 0.f ? x : 0.f;
+	return x < 1.f ? x : 1.f;
+}
+
+void rgbToRgba_scalar(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	for (uint32_t i = 0; i < numPixels; i++) {
+		dst[4 * i + 0] = src[3 * i + 0];
+		dst[4 * i + 1] = src[3 * i + 1];
+		dst[4 * i + 2] = src[3 * i + 2];
+		dst[4 * i + 3] = 255;
+	}
+}
+
+void swapRedBlue_scalar(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	for (uint32_t i = 0; i < numPixels; i++) {
+		const uint8_t r = src[4 * i + 0];
+		dst[4 * i + 0] = src[4 * i + 2];
+		dst[4 * i + 1] = src[4 * i + 1];
+		dst[4 * i + 2] = r;
+		dst[4 * i + 3] = src[4 * i + 3];
+	}
+}
+
+void premultiplyAlpha_scalar(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	for (uint32_t i = 0; i < numPixels; i++) {
+		const uint32_t a = src[4 * i + 3];
+		dst[4 * i + 0] = mulDiv255(src[4 * i + 0], a);
+		dst[4 * i + 1] = mulDiv255(src[4 * i + 1], a);
+		dst[4 * i + 2] = mulDiv255(src[4 * i + 2], a);
+		dst[4 * i + 3] = uint8_t(a);
+	}
+}
+
+void srgbToLinear_scalar(float* dst, const uint8_t* src, uint32_t numPixels)
+{
+	const float* table = tables().srgbToLinear;
+	for (uint32_t i = 0; i < numPixels; i++) {
+		dst[4 * i + 0] = table[src[4 * i + 0]];
+		dst[4 * i + 1] = table[src[4 * i + 1]];
+		dst[4 * i + 2] = table[src[4 * i + 2]];
+		dst[4 * i + 3] = table[256 + src[4 * i + 3]];
+	}
+}
+
+void linearToSrgb_scalar(uint8_t* dst, const float* src, uint32_t numPixels)
+{
+	const uint8_t* table = tables().linearToSrgb;
+	for (uint32_t i = 0; i < numPixels; i++) {
+		for (uint32_t c = 0; c < 3; c++)
+			dst[4 * i + c] = table[uint32_t(saturate(src[4 * i + c]) * float(LINEAR_TO_SRGB_SIZE - 1) + 0.5f)];
+		dst[4 * i + 3] = uint8_t(saturate(src[4 * i + 3]) * 255.f + 0.5f);
+	}
+}
+
+static const Kernels SCALAR_KERNELS = {
+	.isa = Isa::SCALAR,
+	.rgbToRgba = rgbToRgba_scalar,
+	.swapRedBlue = swapRedBlue_scalar,
+	.premultiplyAlpha = premultiplyAlpha_scalar,
+	.srgbToLinear = srgbToLinear_scalar,
+	.linearToSrgb = linearToSrgb_scalar,
+};
+
+// ---- SSSE3 ----
+#ifdef PIXCONV_X86
+
+PIXCONV_TARGET("ssse3")
+void rgbToRgba_ssse3(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+	uint32_t i = 0;
+	for (; i + 16 <= numPixels; i += 16) { // 48 bytes in, 64 bytes out
+		const __m128i a = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+		const __m128i b = _mm_loadu_si128((const __m128i*)(src + 3 * i + 16));
+		const __m128i c = _mm_loadu_si128((const __m128i*)(src + 3 * i + 32));
+		__m128i* out = (__m128i*)(dst + 4 * i);
+		_mm_storeu_si128(out + 0, _mm_or_si128(_mm_shuffle_epi8(a, shuffle), alpha));
+		_mm_storeu_si128(out + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle), alpha));
+		_mm_storeu_si128(out + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle), alpha));
+		_mm_storeu_si128(out + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle), alpha));
+	}
+	rgbToRgba_scalar(dst + 4 * i, src + 3 * i, numPixels - i);
+}
+
+PIXCONV_TARGET("ssse3")
+void swapRedBlue_ssse3(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	uint32_t i = 0;
+	for (; i + 4 <= numPixels; i += 4) {
+		const __m128i px = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_shuffle_epi8(px, shuffle));
+	}
+	swapRedBlue_scalar(dst + 4 * i, src + 4 * i, numPixels - i);
+}
+
+// 8 channels of 16 bits, multiplied by their pixel's alpha and divided by 255
+PIXCONV_TARGET("ssse3")
+__m128i mulDiv255ByAlpha_sse(__m128i x)
+{
+	const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xFF), 0xFF);
+	x = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+PIXCONV_TARGET("ssse3")
+void premultiplyAlpha_ssse3(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000));
+	uint32_t i = 0;
+	for (; i + 4 <= numPixels; i += 4) {
+		const __m128i px = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+		const __m128i lo = mulDiv255ByAlpha_sse(_mm_unpacklo_epi8(px, zero));
+		const __m128i hi = mulDiv255ByAlpha_sse(_mm_unpackhi_epi8(px, zero));
+		const __m128i res = _mm_packus_epi16(lo, hi);
+		_mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(_mm_andnot_si128(alphaMask, res), _mm_and_si128(alphaMask, px)));
+	}
+	premultiplyAlpha_scalar(dst + 4 * i, src + 4 * i, numPixels - i);
+}
+
+// without gathers, only the quantization is vectorized
+PIXCONV_TARGET("ssse3")
+void linearToSrgb_ssse3(uint8_t* dst, const float* src, uint32_t numPixels)
+{
+	const uint8_t* table = tables().linearToSrgb;
+	const __m128 scale = _mm_setr_ps(LINEAR_TO_SRGB_SIZE - 1, LINEAR_TO_SRGB_SIZE - 1, LINEAR_TO_SRGB_SIZE - 1, 255);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), half = _mm_set1_ps(0.5f);
+	alignas(16) int32_t inds[4];
+	for (uint32_t i = 0; i < numPixels; i++) {
+		__m128 c = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + 4 * i), zero), one);
+		_mm_store_si128((__m128i*)inds, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, scale), half)));
+		dst[4 * i + 0] = table[inds[0]];
+		dst[4 * i + 1] = table[inds[1]];
+		dst[4 * i + 2] = table[inds[2]];
+		dst[4 * i + 3] = uint8_t(inds[3]);
+	}
+}
+
+static const Kernels SSSE3_KERNELS = {
+	.isa = Isa::SSSE3,
+	.rgbToRgba = rgbToRgba_ssse3,
+	.swapRedBlue = swapRedBlue_ssse3,
+	.premultiplyAlpha = premultiplyAlpha_ssse3,
+	.srgbToLinear = srgbToLinear_scalar, // a table lookup per channel is already as fast as it gets without gathers
+	.linearToSrgb = linearToSrgb_ssse3,
+};
+
+// ---- AVX2 ----
+
+PIXCONV_TARGET("avx2")
+void rgbToRgba_avx2(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+	const __m256i alpha = _mm256_set1_epi32(int(0xFF000000));
+	uint32_t i = 0;
+	// 8 pixels per iteration, 4 in each lane. Each lane loads 16 bytes but only uses 12, so we stop early enough not to read past the end
+	for (; i + 10 <= numPixels; i += 8) {
+		const __m128i lo = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+		const __m128i hi = _mm_loadu_si128((const __m128i*)(src + 3 * i + 12));
+		const __m256i px = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		_mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_or_si256(_mm256_shuffle_epi8(px, shuffle), alpha));
+	}
+	rgbToRgba_scalar(dst + 4 * i, src + 3 * i, numPixels - i);
+}
+
+PIXCONV_TARGET("avx2")
+void swapRedBlue_avx2(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+	uint32_t i = 0;
+	for (; i + 8 <= numPixels; i += 8) {
+		const __m256i px = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+		_mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_shuffle_epi8(px, shuffle));
+	}
+	swapRedBlue_scalar(dst + 4 * i, src + 4 * i, numPixels - i);
+}
+
+PIXCONV_TARGET("avx2")
+__m256i mulDiv255ByAlpha_avx2(__m256i x)
+{
+	const __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, 0xFF), 0xFF);
+	x = _mm256_add_epi16(_mm256_mullo_epi16(x, a), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+PIXCONV_TARGET("avx2")
+void premultiplyAlpha_avx2(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alphaMask = _mm256_set1_epi32(int(0xFF000000));
+	uint32_t i = 0;
+	for (; i + 8 <= numPixels; i += 8) {
+		// unpack and pack work within each 128-bit lane, so the pixels end up in their original order
+		const __m256i px = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+		const __m256i lo = mulDiv255ByAlpha_avx2(_mm256_unpacklo_epi8(px, zero));
+		const __m256i hi = mulDiv255ByAlpha_avx2(_mm256_unpackhi_epi8(px, zero));
+		const __m256i res = _mm256_packus_epi16(lo, hi);
+		_mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_or_si256(_mm256_andnot_si256(alphaMask, res), _mm256_and_si256(alphaMask, px)));
+	}
+	premultiplyAlpha_scalar(dst + 4 * i, src + 4 * i, numPixels - i);
+}
+
+PIXCONV_TARGET("avx2")
+void srgbToLinear_avx2(float* dst, const uint8_t* src, uint32_t numPixels)
+{
+	const float* table = tables().srgbToLinear;
+	const __m256i alphaOffset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256); // the alpha channel uses the second half of the table
+	uint32_t i = 0;
+	for (; i + 2 <= numPixels; i += 2) {
+		const __m256i inds = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + 4 * i))), alphaOffset);
+		_mm256_storeu_ps(dst + 4 * i, _mm256_i32gather_ps(table, inds, 4));
+	}
+	srgbToLinear_scalar(dst + 4 * i, src + 4 * i, numPixels - i);
+}
+
+PIXCONV_TARGET("avx2")
+__m256i linearToSrgb2Pixels_avx2(const float* src, const uint8_t* table)
+{
+	const float q = LINEAR_TO_SRGB_SIZE - 1;
+	const __m256 scale = _mm256_setr_ps(q, q, q, 255, q, q, q, 255);
+	const __m256 c = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src), _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+	const __m256i inds = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(c, scale), _mm256_set1_ps(0.5f)));
+	// gather 4 bytes from each entry (the table is padded) and keep the first one
+	const __m256i colors = _mm256_and_si256(_mm256_i32gather_epi32((const int*)table, inds, 1), _mm256_set1_epi32(0xFF));
+	return _mm256_blend_epi32(colors, inds, 0x88); // the alpha channels are already quantized
+}
+
+PIXCONV_TARGET("avx2")
+void linearToSrgb_avx2(uint8_t* dst, const float* src, uint32_t numPixels)
+{
+	const uint8_t* table = tables().linearToSrgb;
+	uint32_t i = 0;
+	for (; i + 4 <= numPixels; i += 4) {
+		const __m256i a = linearToSrgb2Pixels_avx2(src + 4 * i, table);
+		const __m256i b = linearToSrgb2Pixels_avx2(src + 4 * i + 8, table);
+		// packus works within lanes: fix the order of the 64-bit blocks before packing again to bytes
+		const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+		const __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i), bytes);
+	}
+	linearToSrgb_scalar(dst + 4 * i, src + 4 * i, numPixels - i);
+}
+
+static const Kernels AVX2_KERNELS = {
+	.isa = Isa::AVX2,
+	.rgbToRgba = rgbToRgba_avx2,
+	.swapRedBlue = swapRedBlue_avx2,
+	.premultiplyAlpha = premultiplyAlpha_avx2,
+	.srgbToLinear = srgbToLinear_avx2,
+	.linearToSrgb = linearToSrgb_avx2,
+};
+
+#endif // PIXCONV_X86
+
+// ---- NEON ----
+#ifdef PIXCONV_NEON
+
+void rgbToRgba_neon(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	uint32_t i = 0;
+	for (; i + 16 <= numPixels; i += 16) {
+		const uint8x16x3_t rgb = vld3q_u8(src + 3 * i);
+		const uint8x16x4_t rgba = { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(255) };
+		vst4q_u8(dst + 4 * i, rgba);
+	}
+	rgbToRgba_scalar(dst + 4 * i, src + 3 * i, numPixels - i);
+}
+
+void swapRedBlue_neon(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	uint32_t i = 0;
+	for (; i + 16 <= numPixels; i += 16) {
+		uint8x16x4_t px = vld4q_u8(src + 4 * i);
+		const uint8x16_t r = px.val[0];
+		px.val[0] = px.val[2];
+		px.val[2] = r;
+		vst4q_u8(dst + 4 * i, px);
+	}
+	swapRedBlue_scalar(dst + 4 * i, src + 4 * i, numPixels - i);
+}
+
+// (x + 128 + ((x + 128) >> 8)) >> 8, narrowed to 8 bits
+uint8x8_t div255_neon(uint16x8_t x)
+{
+	return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+void premultiplyAlpha_neon(uint8_t* dst, const uint8_t* src, uint32_t numPixels)
+{
+	uint32_t i = 0;
+	for (; i + 16 <= numPixels; i += 16) {
+		uint8x16x4_t px = vld4q_u8(src + 4 * i);
+		const uint8x16_t a = px.val[3];
+		for (uint32_t c = 0; c < 3; c++) {
+			const uint8x8_t lo = div255_neon(vmull_u8(vget_low_u8(px.val[c]), vget_low_u8(a)));
+			const uint8x8_t hi = div255_neon(vmull_u8(vget_high_u8(px.val[c]), vget_high_u8(a)));
+			px.val[c] = vcombine_u8(lo, hi);
+		}
+		vst4q_u8(dst + 4 * i, px);
+	}
+	premultiplyAlpha_scalar(dst + 4 * i, src + 4 * i, numPixels - i);
+}
+
+static const Kernels NEON_KERNELS = {
+	.isa = Isa::NEON,
+	.rgbToRgba = rgbToRgba_neon,
+	.swapRedBlue = swapRedBlue_neon,
+	.premultiplyAlpha = premultiplyAlpha_neon,
+	.srgbToLinear = srgbToLinear_scalar, // no gathers in NEON
+	.linearToSrgb = linearToSrgb_scalar,
+};
+
+#endif // PIXCONV_NEON
+
+// ---- dispatch ----
+
+bool isaIsSupported(Isa isa)
+{
+	switch (isa) {
+	case Isa::SCALAR:
+		return true;
+#ifdef PIXCONV_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+	case Isa::SSSE3: {
+		int info[4];
+		__cpuid(info, 1);
+		return info[2] & (1 << 9);
+	}
+	case Isa::AVX2: {
+		int info[4];
+		__cpuid(info, 1);
+		const bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; // OSXSAVE, and the OS saves the SSE and AVX registers
+		if (!osSavesYmm)
+			return false;
+		__cpuidex(info, 7, 0);
+		return info[1] & (1 << 5);
+	}
+#else
+	case Isa::SSSE3:
+		return __builtin_cpu_supports("ssse3");
+	case Isa::AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+#endif
+#ifdef PIXCONV_NEON
+	case Isa::NEON:
+		return true; // mandatory in aarch64
+#endif
+	default:
+		return false;
+	}
+}
+
+// null if the kernels for that instruction set are not compiled in, because of the target architecture
+const Kernels* kernelsForIsa(Isa isa)
+{
+	switch (isa) {
+	case Isa::SCALAR:
+		return &SCALAR_KERNELS;
+#ifdef PIXCONV_X86
+	case Isa::SSSE3:
+		return &SSSE3_KERNELS;
+	case Isa::AVX2:
+		return &AVX2_KERNELS;
+#endif
+#ifdef PIXCONV_NEON
+	case Isa::NEON:
+		return &NEON_KERNELS;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+// the best kernels supported by this CPU. Selected the first time it's called
+const Kernels& kernels()
+{
+	static const Kernels* best = [] {
+		const Kernels* k = &SCALAR_KERNELS;
+		for (uint32_t i = 0; i < uint32_t(Isa::COUNT); i++) {
+			if (kernelsForIsa(Isa(i)) && isaIsSupported(Isa(i)))
+				k = kernelsForIsa(Isa(i)); // they are sorted from worst to best
+		}
+		return k;
+	}();
+	return *best;
+}
+
+// applies a kernel to each row of an image whose rows can be padded (pitches in bytes)
+template <typename Dst, typename Src>
+void convertRows(void (*kernel)(Dst*, const Src*, uint32_t), Dst* dst, size_t dstPitch, const Src* src, size_t srcPitch,
+	uint32_t width, uint32_t height, uint32_t dstChannels, uint32_t srcChannels)
+{
+	if (dstPitch == width * dstChannels * sizeof(Dst) && srcPitch == width * srcChannels * sizeof(Src)) {
+		kernel(dst, src, width * height); // tightly packed: a single call
+		return;
+	}
+	for (uint32_t y = 0; y < height; y++)
+		kernel((Dst*)((uint8_t*)dst + y * dstPitch), (const Src*)((const uint8_t*)src + y * srcPitch), width);
+}
+
+} // namespace pixconv
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <functional>
+#include <algorithm>
+#include <imgui.h>
+#include "helpers.hpp"
+
+namespace
+{
+
+// keeps the memory used by textures under the VRAM budget
+// every frame, the budget of the device local heaps is queried (vmaGetHeapBudgets, which is accurate with VK_EXT_memory_budget)
+// when the usage is over the budget, the least recently used textures are evicted. They are reloaded on demand, the next time they are used
+// textures used in the last minIdleFrames frames are never evicted, so the frames in flight don't thrash them
+namespace residency {
+
+struct Texture {
+	CStr name;
+	// (re)creates the texture and returns its size in bytes. The texture is usable right away (it could still be streaming its levels)
+	// if empty, the texture can't be reloaded, so it's never evicted
+	std::function<u64()> load;
+	// destroys the texture. The GPU could still be using it, so the destruction of the resources must be deferred
+	std::function<void()> evict;
+	u64 bytes = 0; // while resident
+	u64 lastUsedFrame = 0;
+	bool resident = false;
+};
+
+// bytes evicted in a frame, that will be freed once the frames in flight finish
+struct PendingFree {
+	u64 frame;
+	u64 bytes;
+};
+
+struct Manager {
+	VmaAllocator allocator;
+	u32 deviceLocalHeaps = 0; // bitmask
+	float budgetFraction = 0.9f; // of the budget reported by the driver, so there is room for the rest of the allocations
+	u64 budgetOverride = 0; // if not 0 and lower than the real budget, it's used instead
+	u32 minIdleFrames;
+	u64 frame = 0;
+	std::vector<Texture*> textures;
+	std::vector<PendingFree> pendingFrees;
+	// stats
+	u64 usage = 0, budget = 0;
+	u32 numEvictions = 0, numReloads = 0;
+};
+
+// minIdleFrames should be more than the number of frames in flight
+void init(Manager& mgr, VmaAllocator allocator, const VkPhysicalDeviceMemoryProperties& memProps, u32 minIdleFrames, u64 budgetOverride = 0)
+{
+	mgr.allocator = allocator;
+	mgr.minIdleFrames = minIdleFrames;
+	mgr.budgetOverride = budgetOverride;
+	for (u32 i = 0; i < memProps.memoryHeapCount; i++) {
+		if (memProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			mgr.deviceLocalHeaps |= 1u << i;
+	}
+}
+
+// the texture is not loaded until it's used
+void add(Manager& mgr, Texture& tex)
+{
+	tex.resident = false;
+	tex.bytes = 0;
+	mgr.textures.push_back(&tex);
+}
+
+// the texture must be evicted or destroyed by the caller
+void remove(Manager& mgr, Texture& tex)
+{
+	auto it = std::find(mgr.textures.begin(), mgr.textures.end(), &tex);
+	if (it != mgr.textures.end())
+		mgr.textures.erase(it);
+}
+
+// registers a texture that is already loaded (for example the first load happened through another path)
+void addResident(Manager& mgr, Texture& tex, u64 bytes)
+{
+	mgr.textures.push_back(&tex);
+	tex.resident = true;
+	tex.bytes = bytes;
+	tex.lastUsedFrame = mgr.frame;
+}
+
+// marks the texture as used in this frame. It's reloaded if it was evicted
+// textures that can't be reloaded, and are not resident, are ignored (they might not have been created yet)
+void touch(Manager& mgr, Texture& tex)
+{
+	tex.lastUsedFrame = mgr.frame;
+	if (tex.resident || !tex.load)
+		return;
+	tex.bytes = tex.load();
+	tex.resident = true;
+	mgr.numReloads++;
+}
+
+u64 allocationSize(VmaAllocator allocator, VmaAllocation alloc)
+{
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(allocator, alloc, &info);
+	return info.size;
+}
+
+// call it once per frame. Evicts textures if the usage is over the budget
+void update(Manager& mgr)
+{
+	mgr.frame++;
+
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(mgr.allocator, budgets);
+	mgr.usage = 0;
+	mgr.budget = 0;
+	for (u32 i = 0; i < VK_MAX_MEMORY_HEAPS; i++) {
+		if (mgr.deviceLocalHeaps & (1u << i)) {
+			mgr.usage += budgets[i].usage;
+			mgr.budget += budgets[i].budget;
+		}
+	}
+	mgr.budget = u64(double(mgr.budget) * mgr.budgetFraction);
+	if (mgr.budgetOverride)
+		mgr.budget = glm::min(mgr.budget, mgr.budgetOverride);
+
+	// the memory of the recent evictions is not freed until their frames finish, don't count it
+	std::erase_if(mgr.pendingFrees, [&](const PendingFree& f) { return f.frame + mgr.minIdleFrames <= mgr.frame; });
+	u64 usage = mgr.usage;
+	for (const PendingFree& f : mgr.pendingFrees)
+		usage -= glm::min(usage, f.bytes);
+
+	if (usage <= mgr.budget)
+		return;
+
+	// least recently used first
+	std::vector<Texture*> candidates;
+	for (Texture* tex : mgr.textures) {
+		if (tex->resident && tex->load && tex->lastUsedFrame + mgr.minIdleFrames <= mgr.frame)
+			candidates.push_back(tex);
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const Texture* a, const Texture* b) { return a->lastUsedFrame < b->lastUsedFrame; });
+	for (size_t i = 0; i < candidates.size() && usage > mgr.budget; i++) {
+		Texture& tex = *candidates[i];
+		tex.evict();
+		tex.resident = false;
+		usage -= glm::min(usage, tex.bytes);
+		mgr.pendingFrees.push_back({ mgr.frame, tex.bytes });
+		tex.bytes = 0;
+		mgr.numEvictions++;
+	}
+}
+
+void drawImGuiWindow(const Manager& mgr)
+{
+	ImGui::Begin("VRAM residency");
+	ImGui::Text("usage: %.1f MB / budget: %.1f MB", mgr.usage / (1024.0 * 1024.0), mgr.budget / (1024.0 * 1024.0));
+	ImGui::Text("evictions: %u, reloads: %u", mgr.numEvictions, mgr.numReloads);
+	for (const Texture* tex : mgr.textures) {
+		if (tex->resident)
+			ImGui::Text("%s: %.1f MB, used %llu frames ago", tex->name, tex->bytes / (1024.0 * 1024.0), (unsigned long long)(mgr.frame - tex->lastUsedFrame));
+		else
+			ImGui::Text("%s: evicted", tex->name);
+	}
+	ImGui::End();
+}
+
+} // namespace residency
+
+}
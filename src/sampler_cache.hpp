@@ -0,0 +1,131 @@
+#pragma once
+
+#include <unordered_map>
+#include <bit>
+#include "helpers.hpp"
+
+namespace
+{
+
+// deduplicating sampler cache: samplers are looked up by their VkSamplerCreateInfo, and equal infos share the same handle
+// devices limit the number of sampler objects (maxSamplerAllocationCount, can be as low as 4000), and most materials use a handful of configurations
+// the samplers live until the cache is destroyed
+namespace samplers {
+
+struct Key {
+	VkSamplerCreateInfo info;
+};
+
+bool operator==(const Key& a, const Key& b)
+{
+	const VkSamplerCreateInfo& x = a.info;
+	const VkSamplerCreateInfo& y = b.info;
+	return x.flags == y.flags &&
+		x.magFilter == y.magFilter && x.minFilter == y.minFilter && x.mipmapMode == y.mipmapMode &&
+		x.addressModeU == y.addressModeU && x.addressModeV == y.addressModeV && x.addressModeW == y.addressModeW &&
+		x.mipLodBias == y.mipLodBias &&
+		x.anisotropyEnable == y.anisotropyEnable && x.maxAnisotropy == y.maxAnisotropy &&
+		x.compareEnable == y.compareEnable && x.compareOp == y.compareOp &&
+		x.minLod == y.minLod && x.maxLod == y.maxLod &&
+		x.borderColor == y.borderColor &&
+		x.unnormalizedCoordinates == y.unnormalizedCoordinates;
+}
+
+// FNV-1a of the fields. The struct has padding, so it can't be hashed as a block of memory
+// the floats are added to 0 so -0 and 0, which compare equal, also hash the same
+struct KeyHasher {
+	size_t operator()(const Key& key) const
+	{
+		const VkSamplerCreateInfo& x = key.info;
+		const u32 fields[] = {
+			u32(x.flags), u32(x.magFilter), u32(x.minFilter), u32(x.mipmapMode),
+			u32(x.addressModeU), u32(x.addressModeV), u32(x.addressModeW),
+			std::bit_cast<u32>(x.mipLodBias + 0.f), x.anisotropyEnable, std::bit_cast<u32>(x.maxAnisotropy + 0.f),
+			x.compareEnable, u32(x.compareOp), std::bit_cast<u32>(x.minLod + 0.f), std::bit_cast<u32>(x.maxLod + 0.f),
+			u32(x.borderColor), x.unnormalizedCoordinates,
+		};
+		u64 h = 0xcbf29ce484222325;
+		for (u32 f : fields) {
+			h ^= f;
+			h *= 0x100000001b3;
+		}
+		return size_t(h);
+	}
+};
+
+struct Cache {
+	VkDevice device;
+	u32 maxSamplers; // maxSamplerAllocationCount
+	std::unordered_map<Key, VkSampler, KeyHasher> samplers;
+	u32 numRequests = 0; // stats: calls to get(), the difference with samplers.size() are the samplers that have been shared
+};
+
+void init(Cache& cache, VkDevice device, const VkPhysicalDeviceProperties& props)
+{
+	cache.device = device;
+	cache.maxSamplers = props.limits.maxSamplerAllocationCount;
+}
+
+void destroy(Cache& cache)
+{
+	for (auto& [key, sampler] : cache.samplers)
+		vkDestroySampler(cache.device, sampler, nullptr);
+	cache.samplers.clear();
+}
+
+// returns the sampler for the info, creating it the first time. The handle must not be destroyed by the caller
+// extension structs (pNext) are not part of the key, so they are not supported
+[[nodiscard]]
+VkSampler get(Cache& cache, const VkSamplerCreateInfo& info)
+{
+	assert(info.pNext == nullptr);
+	cache.numRequests++;
+	Key key = { info };
+	key.info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	auto it = cache.samplers.find(key);
+	if (it != cache.samplers.end())
+		return it->second;
+
+	assert(cache.samplers.size() < cache.maxSamplers);
+	VkSampler sampler;
+	VkResult vkRes = vkCreateSampler(cache.device, &key.info, nullptr, &sampler);
+	vk::assertRes(vkRes);
+	cache.samplers.emplace(key, sampler);
+	return sampler;
+}
+
+// the usual configurations
+
+VkSamplerCreateInfo linearInfo(VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT)
+{
+	return {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_LINEAR,
+		.minFilter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		.addressModeU = addressMode,
+		.addressModeV = addressMode,
+		.addressModeW = addressMode,
+		.minLod = 0,
+		.maxLod = VK_LOD_CLAMP_NONE,
+	};
+}
+
+VkSamplerCreateInfo nearestInfo(VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT)
+{
+	return {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_NEAREST,
+		.minFilter = VK_FILTER_NEAREST,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		.addressModeU = addressMode,
+		.addressModeV = addressMode,
+		.addressModeW = addressMode,
+		.minLod = 0,
+		.maxLod = VK_LOD_CLAMP_NONE,
+	};
+}
+
+} // namespace samplers
+
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include "helpers.hpp"
+
+namespace
+{
+
+// instanced quad batcher: each sprite is an instance of the same 4-vertex quad, with its transform, uv rect and texture index
+// (in the bindless texture table) in a per-instance vertex buffer. The buffer is persistently mapped and has a region per frame in flight,
+// so the instances are written straight where the GPU reads them, and a batch of any size is a single instanced draw
+namespace sprites {
+
+static constexpr u32 QUAD_BINDING = 0;
+static constexpr u32 INSTANCE_BINDING = 1;
+
+// must match the per-instance attributes of example_vert.glsl
+struct Instance {
+	glm::vec2 pos; // center, in clip space
+	glm::vec2 axisX; // the corners are pos +- axisX +- axisY, so the axes encode the scale and the rotation
+	glm::vec2 axisY;
+	glm::vec4 uvRect; // uvMin, uvMax
+	u32 textureInd;
+};
+
+// the attributes of the instance binding, starting at firstLocation
+std::array<VkVertexInputAttributeDescription, 5> instanceAttribs(u32 firstLocation)
+{
+	return { {
+		{ firstLocation + 0, INSTANCE_BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(Instance, pos) },
+		{ firstLocation + 1, INSTANCE_BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(Instance, axisX) },
+		{ firstLocation + 2, INSTANCE_BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(Instance, axisY) },
+		{ firstLocation + 3, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Instance, uvRect) },
+		{ firstLocation + 4, INSTANCE_BINDING, VK_FORMAT_R32_UINT, offsetof(Instance, textureInd) },
+	} };
+}
+
+VkVertexInputBindingDescription instanceBinding()
+{
+	return {
+		.binding = INSTANCE_BINDING,
+		.stride = sizeof(Instance),
+		.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+	};
+}
+
+struct Batcher {
+	VmaAllocator allocator;
+	VkBuffer buffer;
+	VmaAllocation alloc;
+	Instance* instances; // mapped, capacity * numFrames
+	u32 capacity; // instances per frame
+	u32 frameInd = 0;
+	u32 numInstances = 0; // written in the current frame
+	u32 batchStart = 0; // first instance of the batch being written
+	// stats of the last frame
+	u32 numDraws = 0;
+	u32 numDrawnInstances = 0;
+};
+
+void init(Batcher& b, VmaAllocator allocator, u32 capacity, u32 numFrames)
+{
+	b.allocator = allocator;
+	b.capacity = capacity;
+	const VkBufferCreateInfo bufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = VkDeviceSize(capacity) * numFrames * sizeof(Instance),
+		.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+	};
+	const VmaAllocationCreateInfo allocInfo = {
+		.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		.usage = VMA_MEMORY_USAGE_AUTO,
+	};
+	VmaAllocationInfo info;
+	VkResult vkRes = vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &b.buffer, &b.alloc, &info);
+	vk::assertRes(vkRes);
+	b.instances = (Instance*)info.pMappedData;
+}
+
+void destroy(Batcher& b)
+{
+	vmaDestroyBuffer(b.allocator, b.buffer, b.alloc);
+	b = {};
+}
+
+// the GPU must have finished the previous use of the frame slot, its region of the buffer is overwritten
+void beginFrame(Batcher& b, u32 frameInd)
+{
+	b.frameInd = frameInd;
+	b.numInstances = 0;
+	b.batchStart = 0;
+	b.numDraws = 0;
+	b.numDrawnInstances = 0;
+}
+
+// returns where to write count instances of the current batch, or null if the frame region is full
+// the memory is write-combined: write it sequentially, and don't read from it
+[[nodiscard]]
+Instance* allocInstances(Batcher& b, u32 count)
+{
+	if (b.numInstances + count > b.capacity)
+		return nullptr;
+	Instance* instances = b.instances + size_t(b.frameInd) * b.capacity + b.numInstances;
+	b.numInstances += count;
+	return instances;
+}
+
+// instances written since the last draw
+u32 batchSize(const Batcher& b)
+{
+	return b.numInstances - b.batchStart;
+}
+
+void add(Batcher& b, const Instance& instance)
+{
+	if (Instance* p = allocInstances(b, 1))
+		*p = instance;
+}
+
+// draws the instances written since the last draw, with a single instanced draw of the quad (a 4-vertex triangle strip)
+// the bound pipeline must use QUAD_BINDING for the quad vertices and INSTANCE_BINDING for the instances
+void cmdDraw(Batcher& b, VkCommandBuffer cmdBuffer, VkBuffer quadVertexBuffer)
+{
+	const u32 count = batchSize(b);
+	if (count == 0)
+		return;
+	const VkDeviceSize regionOffset = VkDeviceSize(b.frameInd) * b.capacity * sizeof(Instance);
+	vmaFlushAllocation(b.allocator, b.alloc, regionOffset + VkDeviceSize(b.batchStart) * sizeof(Instance), VkDeviceSize(count) * sizeof(Instance));
+
+	const VkBuffer buffers[] = { quadVertexBuffer, b.buffer };
+	const VkDeviceSize offsets[] = { 0, regionOffset };
+	vkCmdBindVertexBuffers(cmdBuffer, QUAD_BINDING, 2, buffers, offsets);
+	vkCmdDraw(cmdBuffer, 4, count, 0, b.batchStart);
+	b.batchStart = b.numInstances;
+	b.numDraws++;
+	b.numDrawnInstances += count;
+}
+
+} // namespace sprites
+
+}
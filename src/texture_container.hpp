@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace
+{
+
+// texture container written by the offline cooker (tools/texture_cooker.cpp) and read at runtime
+// it's similar to KTX2, but much simpler:
+//   FileHeader
+//   LevelIndex[numLevels] (level 0 is the biggest one)
+//   level data, from the smallest level to the biggest one, each one aligned to LEVEL_ALIGNMENT
+// the level data is ready to be copied to the image, so the loader can read it straight into staging memory
+// the index makes it possible to seek to any level without reading the previous ones
+namespace texc {
+
+static constexpr uint32_t MAGIC = 0x31435854; // "TXC1"
+static constexpr uint32_t VERSION = 1;
+static constexpr uint32_t MAX_LEVELS = 16;
+static constexpr uint64_t LEVEL_ALIGNMENT = 16;
+
+struct FileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format; // VkFormat
+	uint32_t width;
+	uint32_t height;
+	uint32_t numLevels;
+};
+
+struct LevelIndex {
+	uint64_t offset; // from the beginning of the file
+	uint64_t size; // in bytes
+	uint32_t width;
+	uint32_t height;
+};
+
+// block compressed formats are made of 4x4 blocks
+bool isBlockCompressed(VkFormat format)
+{
+	return format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+		format == VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+const char* formatName(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK: return "BC1";
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK: return "BC1A";
+	case VK_FORMAT_BC7_SRGB_BLOCK: return "BC7";
+	case VK_FORMAT_R8G8B8A8_SRGB: return "RGBA8";
+	default: return "OTHER";
+	}
+}
+
+// the formats written by the cooker
+bool isSupportedFormat(VkFormat format)
+{
+	return isBlockCompressed(format) || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+// uncompressed formats have 1x1 blocks
+uint32_t blockHeight(VkFormat format)
+{
+	return isBlockCompressed(format) ? 4 : 1;
+}
+
+// size in bytes of a row of blocks
+uint64_t blockRowSize(VkFormat format, uint32_t width)
+{
+	if (format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK)
+		return uint64_t((width + 3) / 4) * 8;
+	if (format == VK_FORMAT_BC7_SRGB_BLOCK)
+		return uint64_t((width + 3) / 4) * 16;
+	return uint64_t(width) * 4; // RGBA8
+}
+
+uint64_t levelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+	const uint32_t bh = blockHeight(format);
+	return blockRowSize(format, width) * ((height + bh - 1) / bh);
+}
+
+// 64-bit offsets, virtual textures can be bigger than 2GB
+bool seek(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+	return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+uint64_t fileSize(FILE* file)
+{
+#ifdef _WIN32
+	_fseeki64(file, 0, SEEK_END);
+	return uint64_t(_ftelli64(file));
+#else
+	fseeko(file, 0, SEEK_END);
+	return uint64_t(ftello(file));
+#endif
+}
+
+// reads and validates the header and the level index. Leaves the file position undefined
+// maxDimension: of the images that can be created (maxImageDimension2D)
+bool readIndex(FILE* file, FileHeader& header, LevelIndex (&levels)[MAX_LEVELS], uint32_t maxDimension)
+{
+	const uint64_t size = fileSize(file);
+	if (!seek(file, 0) || fread(&header, sizeof(header), 1, file) != 1)
+		return false;
+	if (header.magic != MAGIC || header.version != VERSION || header.numLevels == 0 || header.numLevels > MAX_LEVELS)
+		return false;
+	if (!isSupportedFormat(VkFormat(header.format)) || header.width == 0 || header.height == 0 ||
+		header.width > maxDimension || header.height > maxDimension)
+		return false;
+	if (fread(levels, sizeof(LevelIndex), header.numLevels, file) != header.numLevels)
+		return false;
+	for (uint32_t i = 0; i < header.numLevels; i++) {
+		// the full mip chain, or the first levels of it
+		const uint32_t width = header.width >> i, height = header.height >> i;
+		if (width == 0 && height == 0)
+			return false;
+		if (levels[i].width != (width ? width : 1) || levels[i].height != (height ? height : 1))
+			return false;
+		if (levels[i].size != levelSize(VkFormat(header.format), levels[i].width, levels[i].height) ||
+			levels[i].offset > size || levels[i].size > size - levels[i].offset)
+			return false;
+	}
+	return true;
+}
+
+// ---- virtual textures ----
+// images too big to be loaded as a whole (see src/virtual_texture.hpp) are cut in square pages, for each level of the mip chain:
+//   VtHeader, padded to VT_DATA_OFFSET
+//   pages of level 0 (row major), then the pages of level 1, etc. All of them are vtPageBytes() long
+// the virtual texture is pagesPerSide pages wide at level 0 (a power of 2), so each level halves exactly, down to a single page
+// only the pages that cover the image are stored, the rest of the virtual texture is never sampled
+// each page has a border of texels from its neighbors (clamped at the edges of the image), so it can be filtered without seams
+static constexpr uint32_t VT_MAGIC = 0x31545456; // "VTT1"
+static constexpr uint32_t VT_VERSION = 1;
+static constexpr uint64_t VT_DATA_OFFSET = 64;
+
+struct VtHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format; // VkFormat of the pages
+	uint32_t width; // of the image, at level 0
+	uint32_t height;
+	uint32_t pageSize; // in texels, including the borders
+	uint32_t border; // in texels, on each side
+	uint32_t numLevels;
+	uint32_t pagesPerSide; // at level 0
+};
+
+// texels of the image in each page
+uint32_t vtPayloadSize(const VtHeader& header)
+{
+	return header.pageSize - 2 * header.border;
+}
+
+uint64_t vtPageBytes(const VtHeader& header)
+{
+	return levelSize(VkFormat(header.format), header.pageSize, header.pageSize);
+}
+
+// stored pages of a level, the ones that cover the image
+uint32_t vtLevelPagesX(const VtHeader& header, uint32_t level)
+{
+	const uint32_t levelWidth = (header.width + (1u << level) - 1) >> level;
+	return (levelWidth + vtPayloadSize(header) - 1) / vtPayloadSize(header);
+}
+
+uint32_t vtLevelPagesY(const VtHeader& header, uint32_t level)
+{
+	const uint32_t levelHeight = (header.height + (1u << level) - 1) >> level;
+	return (levelHeight + vtPayloadSize(header) - 1) / vtPayloadSize(header);
+}
+
+uint64_t vtPageOffset(const VtHeader& header, uint32_t level, uint32_t x, uint32_t y)
+{
+	uint64_t pageInd = 0;
+	for (uint32_t l = 0; l < level; l++)
+		pageInd += uint64_t(vtLevelPagesX(header, l)) * vtLevelPagesY(header, l);
+	pageInd += uint64_t(y) * vtLevelPagesX(header, level) + x;
+	return VT_DATA_OFFSET + pageInd * vtPageBytes(header);
+}
+
+// reads and validates the header
+// maxPageSize: the biggest pages that fit in the page cache. maxPagesPerSide: the biggest page table
+bool readVtHeader(FILE* file, VtHeader& header, uint32_t maxPageSize, uint32_t maxPagesPerSide)
+{
+	const uint64_t size = fileSize(file);
+	if (!seek(file, 0) || fread(&header, sizeof(header), 1, file) != 1)
+		return false;
+	if (header.magic != VT_MAGIC || header.version != VT_VERSION || header.numLevels == 0 || header.numLevels > MAX_LEVELS)
+		return false;
+	if (!isSupportedFormat(VkFormat(header.format)) || header.pageSize > maxPageSize || header.pagesPerSide > maxPagesPerSide)
+		return false;
+	if (header.pagesPerSide != 1u << (header.numLevels - 1) || header.pageSize % 4 != 0 || 2 * header.border >= header.pageSize)
+		return false;
+	if (header.width == 0 || header.height == 0 ||
+		header.width > header.pagesPerSide * vtPayloadSize(header) || header.height > header.pagesPerSide * vtPayloadSize(header))
+		return false;
+	const uint32_t lastLevel = header.numLevels - 1;
+	return vtLevelPagesX(header, lastLevel) == 1 && vtLevelPagesY(header, lastLevel) == 1 &&
+		vtPageOffset(header, lastLevel, 0, 0) + vtPageBytes(header) <= size;
+}
+
+} // namespace texc
+
+}
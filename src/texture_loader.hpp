@@ -0,0 +1,88 @@
+#pragma once
+
+#include "helpers.hpp"
+#include "uploader.hpp"
+#include "texture_container.hpp"
+
+namespace
+{
+
+namespace tex {
+
+// true if the device can sample images of this format. Block compressed formats also need the textureCompressionBC feature
+bool formatIsUsable(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceFeatures& enabledFeatures, VkFormat format)
+{
+	if (texc::isBlockCompressed(format) && !enabledFeatures.textureCompressionBC)
+		return false;
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+	return props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
+
+// the biggest width and height of the textures, for validating the containers (see texc::readIndex)
+u32 maxImageDimension(VkPhysicalDevice physicalDevice)
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(physicalDevice, &props);
+	return props.limits.maxImageDimension2D;
+}
+
+// loads a texture container written by the cooker. The levels are read from the file straight into the staging ring, there is no decoding
+// returns false if the file can't be read, its format is not usable, or a level is too big for the upload queue (see
+// upload::canCopyToImage). In that case nothing is created
+bool loadCookedTexture(upload::Uploader& up, VkPhysicalDevice physicalDevice, const VkPhysicalDeviceFeatures& enabledFeatures,
+	CStr fileName, vk::Img& info, VkImage& img, VmaAllocation& allocation, VmaAllocationInfo* allocInfo = nullptr, VkImageView* view = nullptr)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+		return false;
+
+	texc::FileHeader header;
+	texc::LevelIndex levels[texc::MAX_LEVELS];
+	if (!texc::readIndex(file, header, levels, maxImageDimension(physicalDevice)) || !formatIsUsable(physicalDevice, enabledFeatures, VkFormat(header.format))) {
+		fclose(file);
+		return false;
+	}
+	const u32 blockHeight = texc::blockHeight(VkFormat(header.format));
+	for (u32 i = 0; i < header.numLevels; i++) {
+		if (!upload::canCopyToImage(up, levels[i].height, levels[i].size, blockHeight)) {
+			fclose(file);
+			return false;
+		}
+	}
+
+	info = {
+		.width = header.width,
+		.height = header.height,
+		.mipLevels = header.numLevels,
+		.format = VkFormat(header.format),
+	};
+	vk::createStaticImage(up.device, up.allocator, info, img, allocation, allocInfo, view);
+
+	const VkImageSubresourceRange range = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.baseMipLevel = 0,
+		.levelCount = info.mipLevels,
+		.baseArrayLayer = 0,
+		.layerCount = 1,
+	};
+	upload::prepareImage(up, img, range);
+	for (u32 i = header.numLevels; i-- > 0; ) { // in file order: the smallest levels go first
+		const texc::LevelIndex& level = levels[i];
+		const u64 blockRowSize = texc::blockRowSize(info.format, level.width);
+		texc::seek(file, level.offset);
+		// big levels are read in pieces of rows, that fit in the staging ring
+		upload::copyToImage(up, img, i, 0, {0, 0}, {level.width, level.height}, level.size, blockHeight, [&](u8* dst, u32, u32 numRows) {
+			const size_t size = size_t((numRows + blockHeight - 1) / blockHeight * blockRowSize);
+			[[maybe_unused]] const size_t readSize = fread(dst, 1, size, file);
+			assert(readSize == size); // readIndex() already checked that the file is big enough
+		});
+	}
+	upload::finishImage(up, img, range);
+	fclose(file);
+	return true;
+}
+
+} // namespace tex
+
+}
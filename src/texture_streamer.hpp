@@ -0,0 +1,227 @@
+#pragma once
+
+#include "helpers.hpp"
+#include "uploader.hpp"
+#include "texture_container.hpp"
+#include "texture_loader.hpp"
+
+namespace
+{
+
+// progressive streaming of cooked textures: the smallest mips are uploaded first, so the texture can be sampled right away,
+// and the bigger ones are streamed in later frames, without exceeding a byte budget per frame
+// levels that don't fit in the budget are uploaded in chunks of rows
+// sampling is clamped to the resident levels with a view whose base level is the biggest resident one (one view per possible base level)
+namespace stream {
+
+struct Texture {
+	FILE* file = nullptr; // open while there are levels left to stream
+	texc::FileHeader header;
+	texc::LevelIndex levels[texc::MAX_LEVELS];
+	vk::Img info;
+	VkImage img = VK_NULL_HANDLE;
+	VmaAllocation alloc;
+	VkImageView views[texc::MAX_LEVELS]; // views[i] covers the levels [i, numLevels)
+	u32 residentLevel; // the levels [residentLevel, numLevels) have been uploaded and can be sampled
+	u32 rowsUploaded = 0; // of the level being streamed (residentLevel - 1)
+};
+
+struct Streamer {
+	upload::Uploader* uploader;
+	u64 bytesPerFrame;
+	std::vector<Texture*> textures; // that still have levels left to stream
+	u64 bytesStreamed = 0; // stats
+};
+
+void init(Streamer& streamer, upload::Uploader& uploader, u64 bytesPerFrame)
+{
+	streamer.uploader = &uploader;
+	streamer.bytesPerFrame = bytesPerFrame;
+}
+
+bool isFullyResident(const Texture& tex)
+{
+	return tex.residentLevel == 0;
+}
+
+// the view to sample with. It changes as levels become resident
+VkImageView currentView(const Texture& tex)
+{
+	return tex.views[tex.residentLevel];
+}
+
+// number of rows of the level that can be uploaded with at most maxBytes. 0 if not even the minimum chunk fits
+// if mustProgress, at least the minimum chunk is returned even if it exceeds maxBytes (otherwise a big level could never be uploaded)
+// the minimum chunk always fits in the staging ring, open() checked it
+u32 chunkRows(const Streamer& streamer, const Texture& tex, u32 level, u64 maxBytes, bool mustProgress)
+{
+	const VkExtent3D& granularity = streamer.uploader->granularity;
+	const VkFormat format = tex.info.format;
+	const texc::LevelIndex& index = tex.levels[level];
+	const u32 rowsLeft = index.height - tex.rowsUploaded;
+	if (texc::levelSize(format, index.width, rowsLeft) <= maxBytes)
+		return rowsLeft;
+	// partial copies must be aligned to the transfer granularity. A granularity of 0 means that only whole levels can be copied
+	if (granularity.height == 0)
+		return mustProgress ? rowsLeft : 0;
+	const u32 bh = texc::blockHeight(format);
+	const u32 rowAlignment = glm::max(granularity.height, bh);
+	u32 rows = u32(maxBytes / texc::blockRowSize(format, index.width)) * bh / rowAlignment * rowAlignment;
+	if (rows == 0 && mustProgress)
+		rows = rowAlignment;
+	return glm::min(rows, rowsLeft);
+}
+
+// uploads the rows [tex.rowsUploaded, tex.rowsUploaded + rows) of the level
+void uploadRows(upload::Uploader& up, Texture& tex, u32 level, u32 rows)
+{
+	const VkFormat format = tex.info.format;
+	const texc::LevelIndex& index = tex.levels[level];
+	const u64 rowSize = texc::blockRowSize(format, index.width);
+	const u32 bh = texc::blockHeight(format);
+	const u64 size = texc::levelSize(format, index.width, rows);
+	u8* stagingData = upload::copyToImage(up, tex.img, level, 0,
+		{0, i32(tex.rowsUploaded)}, {index.width, rows}, size);
+	texc::seek(tex.file, index.offset + tex.rowsUploaded / bh * rowSize);
+	[[maybe_unused]] const size_t readSize = fread(stagingData, 1, size, tex.file);
+	assert(readSize == size); // readIndex() already checked that the file is big enough
+
+	tex.rowsUploaded += rows;
+	if (tex.rowsUploaded == index.height) {
+		upload::finishImage(up, tex.img, {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = level,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		});
+		tex.residentLevel = level;
+		tex.rowsUploaded = 0;
+		if (level == 0) {
+			fclose(tex.file);
+			tex.file = nullptr;
+		}
+	}
+}
+
+// streams levels of the texture until it's fully resident or the budget is exhausted. Returns the bytes used
+u64 streamTexture(Streamer& streamer, Texture& tex, u64 budget, bool mustProgress)
+{
+	u64 used = 0;
+	while (!isFullyResident(tex) && used < budget) {
+		const u32 level = tex.residentLevel - 1;
+		const u32 rows = chunkRows(streamer, tex, level, budget - used, mustProgress && used == 0);
+		if (rows == 0)
+			break;
+		used += texc::levelSize(tex.info.format, tex.levels[level].width, rows);
+		uploadRows(*streamer.uploader, tex, level, rows);
+	}
+	return used;
+}
+
+// opens a texture container and creates the image. The smallest level is uploaded immediately, so the texture can be sampled right away
+// returns false if the file can't be read, its format is not usable, or a level can't be split in chunks that fit in the staging
+// ring (see upload::canCopyToImage). In that case nothing is created
+bool open(Streamer& streamer, Texture& tex, VkPhysicalDevice physicalDevice, const VkPhysicalDeviceFeatures& enabledFeatures, CStr fileName)
+{
+	upload::Uploader& up = *streamer.uploader;
+	tex.file = fopen(fileName, "rb");
+	if (!tex.file)
+		return false;
+	if (!texc::readIndex(tex.file, tex.header, tex.levels, tex::maxImageDimension(physicalDevice)) || !tex::formatIsUsable(physicalDevice, enabledFeatures, VkFormat(tex.header.format))) {
+		fclose(tex.file);
+		tex.file = nullptr;
+		return false;
+	}
+	for (u32 i = 0; i < tex.header.numLevels; i++) {
+		if (!upload::canCopyToImage(up, tex.levels[i].height, tex.levels[i].size, texc::blockHeight(VkFormat(tex.header.format)))) {
+			fclose(tex.file);
+			tex.file = nullptr;
+			return false;
+		}
+	}
+
+	tex.info = {
+		.width = tex.header.width,
+		.height = tex.header.height,
+		.mipLevels = tex.header.numLevels,
+		.format = VkFormat(tex.header.format),
+	};
+	vk::createStaticImage(up.device, up.allocator, tex.info, tex.img, tex.alloc);
+	const u32 numLevels = tex.info.mipLevels;
+	for (u32 i = 0; i < numLevels; i++) {
+		tex.views[i] = vk::createImageView(up.device, tex.img, tex.info.format, {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = i,
+			.levelCount = numLevels - i,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		});
+	}
+
+	upload::prepareImage(up, tex.img, {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.baseMipLevel = 0,
+		.levelCount = numLevels,
+		.baseArrayLayer = 0,
+		.layerCount = 1,
+	});
+	tex.residentLevel = numLevels;
+	tex.rowsUploaded = 0;
+	uploadRows(up, tex, numLevels - 1, tex.levels[numLevels - 1].height); // the smallest level, regardless of the budget
+	if (isFullyResident(tex))
+		return true;
+
+	streamer.textures.push_back(&tex);
+	return true;
+}
+
+// streams the pending levels of all the textures, within the budget. Call it once per frame, before upload::submit()
+void update(Streamer& streamer)
+{
+	u64 budget = streamer.bytesPerFrame;
+	for (size_t i = 0; i < streamer.textures.size() && budget > 0; ) {
+		Texture& tex = *streamer.textures[i];
+		const bool mustProgress = budget == streamer.bytesPerFrame; // nothing has been streamed yet this frame
+		const u64 used = streamTexture(streamer, tex, budget, mustProgress);
+		budget -= glm::min(used, budget);
+		streamer.bytesStreamed += used;
+		if (isFullyResident(tex)) {
+			streamer.textures[i] = streamer.textures.back();
+			streamer.textures.pop_back();
+		}
+		else if (used == 0) {
+			i++; // not even the minimum chunk of its next level fits in what's left of the budget
+		}
+	}
+}
+
+// no more levels will be streamed, the texture stays with the levels that are resident. Its resources are not destroyed
+void stopStreaming(Streamer& streamer, Texture& tex)
+{
+	for (size_t i = 0; i < streamer.textures.size(); i++) {
+		if (streamer.textures[i] == &tex) {
+			streamer.textures[i] = streamer.textures.back();
+			streamer.textures.pop_back();
+			break;
+		}
+	}
+	if (tex.file)
+		fclose(tex.file);
+	tex.file = nullptr;
+}
+
+// the texture must not be in use by the GPU
+void destroy(Streamer& streamer, Texture& tex)
+{
+	upload::Uploader& up = *streamer.uploader;
+	stopStreaming(streamer, tex);
+	for (u32 i = 0; i < tex.info.mipLevels; i++)
+		vkDestroyImageView(up.device, tex.views[i], nullptr);
+	vmaDestroyImage(up.allocator, tex.img, tex.alloc);
+	tex = {};
+}
+
+} // namespace stream
+
+}
@@ -0,0 +1,506 @@
+#pragma once
+
+#include "helpers.hpp"
+
+namespace
+{
+
+// uploads data to the GPU through a persistently mapped staging ring buffer
+// all the copies issued during a frame are recorded in the same cmd buffer (a batch) and submitted together with submit()
+// each batch signals a value of the queue's timeline semaphore. The space used by a batch is reclaimed once that value has been reached,
+// so there are no per-upload buffers, cmd buffers or fences
+// if the device has a dedicated transfer queue, the copies are executed there, in parallel with rendering. In that case the
+// ownership of the resources is released by the transfer queue, and acquired by the graphics queue with recordAcquireBarriers()
+namespace upload {
+
+static constexpr u32 MAX_BATCHES = 8;
+
+// stages of the graphics queue that can consume uploaded data. TRANSFER is for the generation of mips
+// the stages of optional features (e.g. task and mesh shaders) are added at init, they are only valid if the feature is enabled
+static constexpr VkPipelineStageFlags CONSUMER_STAGES = VK_PIPELINE_STAGE_TRANSFER_BIT |
+	VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+	VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+static constexpr VkAccessFlags CONSUMER_BUFFER_ACCESS =
+	VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+	VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+struct Batch {
+	VkCommandBuffer cmdBuffer;
+	u64 timelineValue; // signaled when the batch finishes
+	u64 ringEnd; // ring position after the last allocation of this batch
+};
+
+// mips that have to be generated in the graphics queue, because the transfer queue can't blit
+struct MipGeneration {
+	VkImage img;
+	VkImageSubresourceRange range;
+	VkExtent2D baseExtent;
+};
+
+struct Uploader {
+	VkDevice device;
+	VmaAllocator allocator;
+	VkQueue queue;
+	vk::Timeline* timeline; // of the queue. Shared with the graphics submits if there is no dedicated transfer queue
+	u32 queueFamily;
+	u32 graphicsQueueFamily;
+	VkExtent3D granularity; // minImageTransferGranularity of the queue. A height of 0 means that only whole levels can be copied
+	VkCommandPool cmdPool;
+	VkBuffer buffer;
+	VmaAllocation alloc;
+	u8* mappedData;
+	u64 capacity;
+	u64 alignment;
+	// positions in the ring grow monotonically, the offset in the buffer is (position % capacity)
+	u64 head = 0; // next free position
+	u64 tail = 0; // oldest position that might still be in use by the GPU
+	u64 batchStart = 0; // position where the batch being recorded started
+	Batch batches[MAX_BATCHES];
+	u32 curBatch = 0; // the batch being recorded
+	u32 numPendingBatches = 0; // submitted but not reclaimed yet, they are the ones right before curBatch
+	bool recording = false;
+	bool hasBufferCopies = false;
+	VkPipelineStageFlags consumerStages; // CONSUMER_STAGES, and the optional stages enabled in the device
+	u64 bytesUploaded = 0; // stats
+
+	// queue ownership transfers (only when using a dedicated transfer queue)
+	std::vector<VkBufferMemoryBarrier> bufferAcquires; // of the batch being recorded
+	std::vector<VkImageMemoryBarrier> imageAcquires;
+	std::vector<VkBufferMemoryBarrier> pendingBufferAcquires; // of the submitted batches, waiting to be recorded in the graphics queue
+	std::vector<VkImageMemoryBarrier> pendingImageAcquires;
+	std::vector<MipGeneration> mipGenerations; // of the batch being recorded
+	std::vector<MipGeneration> pendingMipGenerations;
+	u64 pendingWaitValue = 0; // timeline value of the last batch whose acquires haven't been recorded yet
+	u64 graphicsWaitValue = 0; // the next graphics submit must wait for this value of the timeline (at consumerStages). 0 if not needed
+};
+
+bool usesTransferQueue(const Uploader& up)
+{
+	return up.queueFamily != up.graphicsQueueFamily;
+}
+
+u64 alignUp(u64 x, u64 alignment)
+{
+	return (x + alignment - 1) / alignment * alignment;
+}
+
+void init(Uploader& up, VkPhysicalDevice physicalDevice, VkDevice device, VmaAllocator allocator, const VkPhysicalDeviceProperties& props,
+	u32 queueFamily, VkQueue queue, vk::Timeline& timeline, u32 graphicsQueueFamily, u64 capacity, VkPipelineStageFlags extraConsumerStages = 0)
+{
+	up.device = device;
+	up.allocator = allocator;
+	up.queue = queue;
+	up.timeline = &timeline;
+	up.queueFamily = queueFamily;
+	up.graphicsQueueFamily = graphicsQueueFamily;
+	up.consumerStages = CONSUMER_STAGES | extraConsumerStages;
+	VkQueueFamilyProperties familyProps[32];
+	u32 numFamilies = std::size(familyProps);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &numFamilies, familyProps);
+	up.granularity = familyProps[queueFamily].minImageTransferGranularity;
+	up.alignment = glm::max<u64>(16, glm::max<u64>(props.limits.optimalBufferCopyOffsetAlignment, props.limits.nonCoherentAtomSize));
+	up.capacity = alignUp(capacity, up.alignment);
+
+	VmaAllocationInfo allocInfo;
+	vk::createStagingBuffer(device, allocator, up.capacity, up.buffer, up.alloc, &allocInfo);
+	up.mappedData = (u8*)allocInfo.pMappedData;
+
+	up.cmdPool = vk::createCmdPool(device, queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	for (u32 i = 0; i < MAX_BATCHES; i++) {
+		vk::allocateCmdBuffers(device, up.cmdPool, { &up.batches[i].cmdBuffer, 1 });
+		up.batches[i].timelineValue = 0;
+	}
+}
+
+void destroy(Uploader& up)
+{
+	vkDestroyCommandPool(up.device, up.cmdPool, nullptr);
+	vmaDestroyBuffer(up.allocator, up.buffer, up.alloc);
+}
+
+u32 oldestPendingBatch(const Uploader& up)
+{
+	return (up.curBatch + MAX_BATCHES - up.numPendingBatches) % MAX_BATCHES;
+}
+
+void retireOldestBatch(Uploader& up)
+{
+	const Batch& batch = up.batches[oldestPendingBatch(up)];
+	up.tail = batch.ringEnd;
+	up.numPendingBatches--;
+}
+
+// reclaims the ring space of the batches that the GPU has finished. Doesn't block
+void reclaim(Uploader& up)
+{
+	while (up.numPendingBatches && vk::timelineReached(up.device, *up.timeline, up.batches[oldestPendingBatch(up)].timelineValue))
+		retireOldestBatch(up);
+}
+
+void waitOldestBatch(Uploader& up)
+{
+	assert(up.numPendingBatches);
+	vk::waitTimeline(up.device, *up.timeline, up.batches[oldestPendingBatch(up)].timelineValue);
+	retireOldestBatch(up);
+}
+
+// true if the uploads of the batch that signals this value (returned by submit()) have finished
+[[nodiscard]]
+bool isComplete(Uploader& up, u64 timelineValue)
+{
+	return vk::timelineReached(up.device, *up.timeline, timelineValue);
+}
+
+VkCommandBuffer getCmdBuffer(Uploader& up)
+{
+	Batch& batch = up.batches[up.curBatch];
+	if (!up.recording) {
+		vk::beginCmdBuffer(batch.cmdBuffer);
+		up.recording = true;
+	}
+	return batch.cmdBuffer;
+}
+
+void flushRange(Uploader& up, u64 begin, u64 end)
+{
+	if (begin == end)
+		return;
+	const u64 beginOffset = begin % up.capacity;
+	const u64 size = end - begin;
+	if (beginOffset + size <= up.capacity) {
+		vmaFlushAllocation(up.allocator, up.alloc, beginOffset, size);
+	}
+	else {
+		vmaFlushAllocation(up.allocator, up.alloc, beginOffset, up.capacity - beginOffset);
+		vmaFlushAllocation(up.allocator, up.alloc, 0, size - (up.capacity - beginOffset));
+	}
+}
+
+// submits the copies recorded so far. Call it once per frame, before submitting the work that uses the uploaded data
+// returns the timeline value that will be signaled when the copies finish, or 0 if there was nothing to submit
+u64 submit(Uploader& up)
+{
+	if (!up.recording)
+		return 0;
+
+	Batch& batch = up.batches[up.curBatch];
+	if (usesTransferQueue(up)) {
+		// the release barriers were recorded after each copy, the graphics queue will record the matching acquires
+		up.pendingBufferAcquires.insert(up.pendingBufferAcquires.end(), up.bufferAcquires.begin(), up.bufferAcquires.end());
+		up.pendingImageAcquires.insert(up.pendingImageAcquires.end(), up.imageAcquires.begin(), up.imageAcquires.end());
+		up.pendingMipGenerations.insert(up.pendingMipGenerations.end(), up.mipGenerations.begin(), up.mipGenerations.end());
+		up.bufferAcquires.clear();
+		up.imageAcquires.clear();
+		up.mipGenerations.clear();
+	}
+	else if (up.hasBufferCopies) {
+		// a single barrier for all the buffer copies of the batch
+		const VkMemoryBarrier memBarrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = CONSUMER_BUFFER_ACCESS,
+		};
+		vkCmdPipelineBarrier(batch.cmdBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, up.consumerStages,
+			0,
+			1, &memBarrier,
+			0, nullptr,
+			0, nullptr);
+	}
+	VkResult vkRes = vkEndCommandBuffer(batch.cmdBuffer);
+	vk::assertRes(vkRes);
+
+	flushRange(up, up.batchStart, up.head);
+
+	batch.timelineValue = vk::nextTimelineValue(*up.timeline);
+	if (usesTransferQueue(up))
+		up.pendingWaitValue = batch.timelineValue;
+
+	const VkTimelineSemaphoreSubmitInfo timelineInfo = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &batch.timelineValue,
+	};
+	const VkSubmitInfo submitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timelineInfo,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &batch.cmdBuffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &up.timeline->semaphore,
+	};
+	vkRes = vkQueueSubmit(up.queue, 1, &submitInfo, VK_NULL_HANDLE);
+	vk::assertRes(vkRes);
+
+	batch.ringEnd = up.head;
+	up.batchStart = up.head;
+	up.recording = false;
+	up.hasBufferCopies = false;
+	up.numPendingBatches++;
+	up.curBatch = (up.curBatch + 1) % MAX_BATCHES;
+	if (up.numPendingBatches == MAX_BATCHES) // the cmd buffer of the next batch is still in flight
+		waitOldestBatch(up);
+	return batch.timelineValue;
+}
+
+// records, in a graphics cmd buffer, the acquire barriers for the batches submitted since the last call, and the pending mip generations
+// the submit of that cmd buffer must wait for up.graphicsWaitValue of up.timeline at up.consumerStages
+// a single wait is enough because the values are signaled in order
+void recordAcquireBarriers(Uploader& up, VkCommandBuffer cmdBuffer)
+{
+	up.graphicsWaitValue = 0;
+	if (up.pendingWaitValue == 0)
+		return;
+	up.graphicsWaitValue = up.pendingWaitValue;
+	up.pendingWaitValue = 0;
+	vkCmdPipelineBarrier(cmdBuffer,
+		up.consumerStages, up.consumerStages, // chained with the semaphore wait
+		0,
+		0, nullptr,
+		u32(up.pendingBufferAcquires.size()), up.pendingBufferAcquires.data(),
+		u32(up.pendingImageAcquires.size()), up.pendingImageAcquires.data());
+	up.pendingBufferAcquires.clear();
+	up.pendingImageAcquires.clear();
+
+	for (const MipGeneration& gen : up.pendingMipGenerations)
+		vk::cmdGenerateMips(cmdBuffer, gen.img, gen.range, gen.baseExtent.width, gen.baseExtent.height);
+	up.pendingMipGenerations.clear();
+}
+
+static constexpr u64 INVALID_OFFSET = ~u64(0);
+
+// returns the offset in the staging buffer, or INVALID_OFFSET if the size is bigger than the whole ring
+u64 allocRing(Uploader& up, u64 size)
+{
+	if (size > up.capacity)
+		return INVALID_OFFSET;
+	for (;;) {
+		u64 start = alignUp(up.head, up.alignment);
+		const u64 offset = start % up.capacity;
+		if (offset + size > up.capacity)
+			start += up.capacity - offset; // it doesn't fit at the end, we have to wrap around
+		if (start + size - up.tail <= up.capacity) {
+			up.head = start + size;
+			up.bytesUploaded += size;
+			return start % up.capacity;
+		}
+
+		if (up.numPendingBatches == 0 && up.head == up.tail) {
+			// the ring is empty, but the allocation didn't fit after wrapping around: restart from the beginning of the buffer
+			up.head = up.tail = up.batchStart = alignUp(up.head, up.capacity);
+			continue;
+		}
+
+		// not enough space: we have to wait for the GPU to finish the oldest batch
+		if (up.numPendingBatches == 0)
+			submit(up); // the ring is full with the copies of the current batch
+		waitOldestBatch(up);
+	}
+}
+
+// records a copy to a buffer and returns the staging memory where the data must be written
+// the size must fit in the ring, see the copyToBuffer() below for any size
+[[nodiscard]]
+u8* copyToBuffer(Uploader& up, VkBuffer dst, u64 dstOffset, u64 size)
+{
+	const u64 offset = allocRing(up, size);
+	assert(offset != INVALID_OFFSET);
+	const VkBufferCopy region = {
+		.srcOffset = offset,
+		.dstOffset = dstOffset,
+		.size = size,
+	};
+	VkCommandBuffer cmdBuffer = getCmdBuffer(up);
+	vkCmdCopyBuffer(cmdBuffer, up.buffer, dst, 1, &region);
+	up.hasBufferCopies = true;
+
+	if (usesTransferQueue(up)) {
+		VkBufferMemoryBarrier barrier = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = 0,
+			.srcQueueFamilyIndex = up.queueFamily,
+			.dstQueueFamilyIndex = up.graphicsQueueFamily,
+			.buffer = dst,
+			.offset = dstOffset,
+			.size = size,
+		};
+		vkCmdPipelineBarrier(cmdBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr);
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = CONSUMER_BUFFER_ACCESS;
+		up.bufferAcquires.push_back(barrier);
+	}
+	return up.mappedData + offset;
+}
+
+// copies data of any size to a buffer, in pieces that fit in the ring
+void copyToBuffer(Uploader& up, VkBuffer dst, u64 dstOffset, const void* data, u64 size)
+{
+	const u64 maxPieceSize = up.capacity / 4;
+	for (u64 done = 0; done < size;) {
+		const u64 pieceSize = glm::min(size - done, maxPieceSize);
+		u8* stagingData = copyToBuffer(up, dst, dstOffset + done, pieceSize);
+		memcpy(stagingData, (const u8*)data + done, pieceSize);
+		done += pieceSize;
+	}
+}
+
+// transitions the subresources to TRANSFER_DST_OPTIMAL, discarding their previous contents
+void prepareImage(Uploader& up, VkImage img, const VkImageSubresourceRange& range)
+{
+	vk::cmdImageBarrier(getCmdBuffer(up), img, range,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_ACCESS_NONE,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+}
+
+// records a copy to a region of an image (which must be in TRANSFER_DST_OPTIMAL) and returns the staging memory where the texels must be written
+// the rows must be tightly packed, dataSize is the size in bytes of the whole region
+// returns nullptr, and records nothing, if the region doesn't fit in the ring. See the copyToImage() below for splitting it
+[[nodiscard]]
+u8* copyToImage(Uploader& up, VkImage img, u32 mipLevel, u32 layer, VkOffset2D offset, VkExtent2D extent, u64 dataSize)
+{
+	const u64 bufferOffset = allocRing(up, dataSize);
+	if (bufferOffset == INVALID_OFFSET)
+		return nullptr;
+	const VkBufferImageCopy region = {
+		.bufferOffset = bufferOffset,
+		.bufferRowLength = 0, // tightly packed
+		.bufferImageHeight = 0,
+		.imageSubresource = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.mipLevel = mipLevel,
+			.baseArrayLayer = layer,
+			.layerCount = 1,
+		},
+		.imageOffset = {offset.x, offset.y, 0},
+		.imageExtent = {extent.width, extent.height, 1},
+	};
+	vkCmdCopyBufferToImage(getCmdBuffer(up), up.buffer, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	return up.mappedData + bufferOffset;
+}
+
+// rows of blocks of each piece of the copyToImage() below. 0 if the region can't be copied: it doesn't fit in the ring, and the
+// queue can only copy whole levels (or a single aligned row of blocks doesn't fit either)
+u32 imagePieceRows(const Uploader& up, u32 height, u64 dataSize, u32 blockHeight)
+{
+	const u64 blockRowSize = dataSize / glm::max((height + blockHeight - 1) / blockHeight, 1u);
+	const u64 maxPieceSize = up.capacity / 4; // same as copyToBuffer(), so a piece doesn't have to wait for the whole ring
+	if (dataSize <= maxPieceSize)
+		return height;
+	if (up.granularity.height == 0)
+		return dataSize <= up.capacity ? height : 0;
+	const u32 rowAlignment = glm::max(up.granularity.height, blockHeight);
+	const u32 rows = glm::max(u32(maxPieceSize / blockRowSize) * blockHeight / rowAlignment, 1u) * rowAlignment;
+	return u64(rows / blockHeight) * blockRowSize <= up.capacity ? rows : 0;
+}
+
+// true if the copyToImage() below can copy the region. Check it before recording anything for the image
+bool canCopyToImage(const Uploader& up, u32 height, u64 dataSize, u32 blockHeight = 1)
+{
+	return imagePieceRows(up, height, dataSize, blockHeight) != 0;
+}
+
+// copies a region of any size (see canCopyToImage), in pieces of whole rows of blocks that fit in the ring, aligned to the transfer granularity
+// fill(dst, firstRow, numRows) writes the texels of the rows [firstRow, firstRow + numRows) of the region, tightly packed
+void copyToImage(Uploader& up, VkImage img, u32 mipLevel, u32 layer, VkOffset2D offset, VkExtent2D extent, u64 dataSize, u32 blockHeight,
+	const std::function<void(u8* dst, u32 firstRow, u32 numRows)>& fill)
+{
+	const u64 blockRowSize = dataSize / glm::max((extent.height + blockHeight - 1) / blockHeight, 1u);
+	const u32 pieceRows = imagePieceRows(up, extent.height, dataSize, blockHeight);
+	assert(pieceRows);
+	for (u32 row = 0; row < extent.height; row += pieceRows) {
+		const u32 rows = glm::min(pieceRows, extent.height - row);
+		const u64 pieceSize = u64((rows + blockHeight - 1) / blockHeight) * blockRowSize;
+		u8* stagingData = copyToImage(up, img, mipLevel, layer, {offset.x, offset.y + i32(row)}, {extent.width, rows}, pieceSize);
+		assert(stagingData);
+		fill(stagingData, row, rows);
+	}
+}
+
+// same, from texels in memory
+void copyToImage(Uploader& up, VkImage img, u32 mipLevel, u32 layer, VkOffset2D offset, VkExtent2D extent, const void* data, u64 dataSize,
+	u32 blockHeight = 1)
+{
+	const u64 blockRowSize = dataSize / glm::max((extent.height + blockHeight - 1) / blockHeight, 1u);
+	copyToImage(up, img, mipLevel, layer, offset, extent, dataSize, blockHeight, [&](u8* dst, u32 firstRow, u32 numRows) {
+		memcpy(dst, (const u8*)data + firstRow / blockHeight * blockRowSize, (numRows + blockHeight - 1) / blockHeight * blockRowSize);
+	});
+}
+
+// transitions the subresources from TRANSFER_DST_OPTIMAL to SHADER_READ_ONLY_OPTIMAL
+void finishImage(Uploader& up, VkImage img, const VkImageSubresourceRange& range)
+{
+	if (!usesTransferQueue(up)) {
+		vk::cmdImageBarrier(getCmdBuffer(up), img, range,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		return;
+	}
+
+	// the layout transition is done by the release and the acquire barriers, which must match
+	VkImageMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = 0,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		.srcQueueFamilyIndex = up.queueFamily,
+		.dstQueueFamilyIndex = up.graphicsQueueFamily,
+		.image = img,
+		.subresourceRange = range,
+	};
+	vkCmdPipelineBarrier(getCmdBuffer(up),
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	up.imageAcquires.push_back(barrier);
+}
+
+// like finishImage(), but the levels after range.baseMipLevel are generated from it (which must have been written) with linear blits
+// all the levels of the range must have been prepared with prepareImage(), and the image must have been created with generateMips
+// if the uploads go through a dedicated transfer queue, the blits are recorded in the graphics queue by recordAcquireBarriers()
+void finishImageWithMips(Uploader& up, VkImage img, const VkImageSubresourceRange& range, VkExtent2D baseExtent)
+{
+	if (!usesTransferQueue(up)) {
+		vk::cmdGenerateMips(getCmdBuffer(up), img, range, baseExtent.width, baseExtent.height);
+		return;
+	}
+
+	// transfer the ownership keeping the TRANSFER_DST_OPTIMAL layout, the graphics queue will do the rest
+	VkImageMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = 0,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.srcQueueFamilyIndex = up.queueFamily,
+		.dstQueueFamilyIndex = up.graphicsQueueFamily,
+		.image = img,
+		.subresourceRange = range,
+	};
+	vkCmdPipelineBarrier(getCmdBuffer(up),
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	up.imageAcquires.push_back(barrier);
+	up.mipGenerations.push_back({ img, range, baseExtent });
+}
+
+} // namespace upload
+
+}
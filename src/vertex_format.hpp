@@ -0,0 +1,233 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <vector>
+#include <glm/gtc/packing.hpp>
+#include "helpers.hpp"
+#include "mesh.hpp"
+
+namespace
+{
+
+// compact vertex formats for meshes: each attribute of mesh::Vertex can be stored as 32-bit floats, or quantized to 16 bits
+// - positions: half floats, or 16-bit SNORM relative to the bounding box of the mesh
+// - normals: octahedral encoding (the unit sphere folded into a square) in 2 x 16-bit SNORM
+// - texture coordinates: half floats, or 16-bit UNORM relative to their bounding rectangle
+// the quantized formats are decoded for free by the vertex fetch. The bounds of the SNORM/UNORM ones are undone with a scale and
+// an offset (see Dequantize), and the octahedral normals are unfolded in the vertex shader (mesh_vert.glsl)
+// all of them are 4-byte aligned, and they have mandatory VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT support
+namespace vfmt {
+
+enum class PosFormat { FLOAT32, HALF, SNORM16, COUNT };
+enum class NormalFormat { FLOAT32, OCT_SNORM16, COUNT };
+enum class TcFormat { FLOAT32, HALF, UNORM16, COUNT };
+
+static ConstStr POS_FORMAT_NAMES[] = { "float32", "half", "snorm16" };
+static ConstStr NORMAL_FORMAT_NAMES[] = { "float32", "octahedral snorm16" };
+static ConstStr TC_FORMAT_NAMES[] = { "float32", "half", "unorm16" };
+
+static constexpr VkFormat POS_VK_FORMATS[] = { VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R16G16B16A16_SNORM };
+static constexpr VkFormat NORMAL_VK_FORMATS[] = { VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R16G16_SNORM };
+static constexpr VkFormat TC_VK_FORMATS[] = { VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_R16G16_UNORM };
+static constexpr u32 POS_SIZES[] = { 12, 8, 8 }; // the 16-bit positions have a 4th component: 3-component 16-bit formats are not mandatory
+static constexpr u32 NORMAL_SIZES[] = { 12, 4 };
+static constexpr u32 TC_SIZES[] = { 8, 4, 4 };
+
+struct Layout {
+	PosFormat pos;
+	NormalFormat normal;
+	TcFormat tc;
+	// the attributes are interleaved in this order
+	u32 posOffset;
+	u32 normalOffset;
+	u32 tcOffset;
+	u32 stride;
+};
+
+// undoes the quantization relative to the bounds: attrib = decoded * scale + offset
+struct Dequantize {
+	glm::vec3 posScale = glm::vec3(1);
+	glm::vec3 posOffset = glm::vec3(0);
+	glm::vec2 tcScale = glm::vec2(1);
+	glm::vec2 tcOffset = glm::vec2(0);
+};
+
+Layout makeLayout(PosFormat pos, NormalFormat normal, TcFormat tc)
+{
+	Layout layout = { pos, normal, tc };
+	layout.posOffset = 0;
+	layout.normalOffset = layout.posOffset + POS_SIZES[u32(pos)];
+	layout.tcOffset = layout.normalOffset + NORMAL_SIZES[u32(normal)];
+	layout.stride = layout.tcOffset + TC_SIZES[u32(tc)];
+	return layout;
+}
+
+// same as mesh::Vertex: 32 bytes per vertex
+Layout floatLayout()
+{
+	return makeLayout(PosFormat::FLOAT32, NormalFormat::FLOAT32, TcFormat::FLOAT32);
+}
+
+// 16 bytes per vertex
+Layout compactLayout()
+{
+	return makeLayout(PosFormat::SNORM16, NormalFormat::OCT_SNORM16, TcFormat::UNORM16);
+}
+
+// the position, the normal and the texture coordinates, in consecutive locations
+std::array<VkVertexInputAttributeDescription, 3> attribs(const Layout& layout, u32 binding, u32 firstLocation)
+{
+	return { {
+		{ firstLocation + 0, binding, POS_VK_FORMATS[u32(layout.pos)], layout.posOffset },
+		{ firstLocation + 1, binding, NORMAL_VK_FORMATS[u32(layout.normal)], layout.normalOffset },
+		{ firstLocation + 2, binding, TC_VK_FORMATS[u32(layout.tc)], layout.tcOffset },
+	} };
+}
+
+VkVertexInputBindingDescription bindingDesc(const Layout& layout, u32 binding)
+{
+	return {
+		.binding = binding,
+		.stride = layout.stride,
+		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	};
+}
+
+// the formats above are mandatory, but this can catch a typo in the tables
+bool layoutIsSupported(VkPhysicalDevice physicalDevice, const Layout& layout)
+{
+	for (const VkVertexInputAttributeDescription& attrib : attribs(layout, 0, 0)) {
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, attrib.format, &props);
+		if (!(props.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT))
+			return false;
+	}
+	return true;
+}
+
+// the unit sphere is projected on the octahedron |x| + |y| + |z| = 1, and its lower half is folded over the upper half's square
+// (Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors")
+glm::vec2 octEncode(glm::vec3 n)
+{
+	const float l1 = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+	if (l1 == 0)
+		return glm::vec2(0); // decoded as +Z
+	n /= l1;
+	glm::vec2 p(n.x, n.y);
+	if (n.z < 0) {
+		const glm::vec2 signs(p.x >= 0 ? 1.f : -1.f, p.y >= 0 ? 1.f : -1.f);
+		p = (1.f - glm::abs(glm::vec2(p.y, p.x))) * signs;
+	}
+	return p;
+}
+
+// same as mesh_vert.glsl
+glm::vec3 octDecode(glm::vec2 p)
+{
+	glm::vec3 n(p.x, p.y, 1 - glm::abs(p.x) - glm::abs(p.y));
+	const float t = glm::max(-n.z, 0.f);
+	n.x += n.x >= 0 ? -t : t;
+	n.y += n.y >= 0 ? -t : t;
+	return glm::normalize(n);
+}
+
+// the 2 closest SNORM16 codes of each component are tried: with plain rounding the decoded normal can be noticeably farther
+// from the original than it needs to be, because of the normalization after decoding
+glm::u16vec2 octEncodeSnorm16(const glm::vec3& n)
+{
+	const glm::vec2 p = octEncode(n);
+	const glm::vec2 base = glm::floor(glm::clamp(p, -1.f, 1.f) * 32767.f);
+	glm::u16vec2 best;
+	float bestDot = -2;
+	for (u32 i = 0; i < 4; i++) {
+		const glm::vec2 code = glm::clamp(base + glm::vec2(i & 1, i >> 1), -32767.f, 32767.f);
+		const float d = glm::dot(octDecode(code / 32767.f), n);
+		if (d > bestDot) {
+			bestDot = d;
+			best = glm::u16vec2(u16(i16(code.x)), u16(i16(code.y)));
+		}
+	}
+	return best;
+}
+
+// scale and offset that map [minVal, maxVal] to [-1, 1] (or [0, 1] if unorm) and back
+template <typename Vec>
+void quantizationRange(Vec minVal, Vec maxVal, bool unorm, Vec& scale, Vec& offset)
+{
+	const Vec extent = glm::max(maxVal - minVal, Vec(1e-20f));
+	if (unorm) {
+		scale = extent;
+		offset = minVal;
+	}
+	else {
+		scale = 0.5f * extent;
+		offset = 0.5f * (minVal + maxVal);
+	}
+}
+
+// writes the vertices in the layout, and returns how to undo the quantization of the bounds-relative formats
+std::vector<u8> encode(const Layout& layout, std::span<const mesh::Vertex> vertices, Dequantize& dequantize)
+{
+	dequantize = {};
+	if (vertices.empty())
+		return {};
+	glm::vec3 posMin = vertices[0].pos, posMax = vertices[0].pos;
+	glm::vec2 tcMin = vertices[0].tc, tcMax = vertices[0].tc;
+	for (const mesh::Vertex& v : vertices) {
+		posMin = glm::min(posMin, v.pos);
+		posMax = glm::max(posMax, v.pos);
+		tcMin = glm::min(tcMin, v.tc);
+		tcMax = glm::max(tcMax, v.tc);
+	}
+	if (layout.pos == PosFormat::SNORM16)
+		quantizationRange(posMin, posMax, false, dequantize.posScale, dequantize.posOffset);
+	if (layout.tc == TcFormat::UNORM16)
+		quantizationRange(tcMin, tcMax, true, dequantize.tcScale, dequantize.tcOffset);
+
+	std::vector<u8> data(vertices.size() * layout.stride);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const mesh::Vertex& v = vertices[i];
+		u8* out = data.data() + i * layout.stride;
+
+		u8* pos = out + layout.posOffset;
+		if (layout.pos == PosFormat::FLOAT32) {
+			memcpy(pos, &v.pos, sizeof(v.pos));
+		}
+		else {
+			u16 encoded[4];
+			const glm::vec3 p = (v.pos - dequantize.posOffset) / dequantize.posScale;
+			for (int c = 0; c < 3; c++)
+				encoded[c] = layout.pos == PosFormat::HALF ? glm::packHalf1x16(p[c]) : glm::packSnorm1x16(p[c]);
+			encoded[3] = 0;
+			memcpy(pos, encoded, sizeof(encoded));
+		}
+
+		u8* normal = out + layout.normalOffset;
+		if (layout.normal == NormalFormat::FLOAT32) {
+			memcpy(normal, &v.normal, sizeof(v.normal));
+		}
+		else {
+			const glm::u16vec2 encoded = octEncodeSnorm16(v.normal);
+			memcpy(normal, &encoded, sizeof(encoded));
+		}
+
+		u8* tc = out + layout.tcOffset;
+		if (layout.tc == TcFormat::FLOAT32) {
+			memcpy(tc, &v.tc, sizeof(v.tc));
+		}
+		else {
+			const glm::vec2 t = (v.tc - dequantize.tcOffset) / dequantize.tcScale;
+			const u16 encoded[2] = {
+				layout.tc == TcFormat::HALF ? glm::packHalf1x16(t.x) : glm::packUnorm1x16(t.x),
+				layout.tc == TcFormat::HALF ? glm::packHalf1x16(t.y) : glm::packUnorm1x16(t.y),
+			};
+			memcpy(tc, encoded, sizeof(encoded));
+		}
+	}
+	return data;
+}
+
+} // namespace vfmt
+
+}
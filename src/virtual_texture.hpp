@@ -0,0 +1,499 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include "helpers.hpp"
+#include "uploader.hpp"
+#include "texture_container.hpp"
+
+namespace
+{
+
+// virtual texturing, for images bigger than the device limits or than the VRAM (the file format is described in texture_container.hpp)
+// only the pages being sampled are resident, in the slots of a fixed size physical cache texture. The page table texture has a texel
+// per virtual page, and a mip per level, which says where the page is in the cache. Pages that are not resident fall back to a coarser level
+// the fragment shader writes the pages it needs in a feedback buffer, which the CPU reads once the frame has finished. The missing
+// pages are streamed from disk by priority (coarser levels first), replacing the least recently requested ones
+// the copies to the cache and to the page table are recorded in the graphics cmd buffer of the frame, before the render pass, so they
+// are ordered with the sampling done by the previous frames, and a slot can be reused right away
+namespace vt {
+
+static constexpr u32 CACHE_PAGES_PER_SIDE = 16; // 256 slots
+static constexpr u32 MAX_PAGE_LOADS_PER_FRAME = 16;
+static constexpr u32 FEEDBACK_BLOCK_SIZE = 4; // only one pixel of each 4x4 block writes feedback, a different one every frame
+static constexpr u32 INVALID = ~0u;
+
+// must match the push_constant block of vt_frag.glsl
+struct PushConstants {
+	glm::vec2 uvOffset; // from the texture coordinates of the quad to the uv of the virtual texture
+	glm::vec2 uvScale;
+	u32 pagesPerSide;
+	u32 numLevels;
+	u32 pageSize;
+	u32 border;
+	u32 feedbackPixel; // x + FEEDBACK_BLOCK_SIZE * y: the pixel of each block that writes feedback in this frame
+};
+
+// page table entries, RGBA8_UINT
+struct Entry {
+	u8 slotX, slotY;
+	u8 level;
+	u8 resident;
+};
+
+struct Slot {
+	u32 page = INVALID; // index of the virtual page in it
+	u64 lastRequestedFrame = 0;
+	bool pinned = false;
+};
+
+struct PageLoad {
+	u32 page;
+	u32 level;
+};
+
+struct VirtualTexture {
+	VkDevice device;
+	VmaAllocator allocator;
+	FILE* file = nullptr;
+	texc::VtHeader header;
+	u64 pageBytes;
+	u32 numFrames; // in flight, each one has its own feedback and staging regions
+	// virtual pages are numbered level by level, row major, including the ones that are not stored in the file
+	u32 numVirtualPages;
+	u32 levelFirstPage[texc::MAX_LEVELS];
+	std::vector<u32> pageSlots; // slot of each virtual page, INVALID if not resident
+	std::vector<u8> requested; // scratch, per virtual page
+	std::vector<Slot> slots;
+	std::vector<PageLoad> loads; // scratch
+
+	VkImage cacheImg;
+	VmaAllocation cacheAlloc;
+	VkImageView cacheView;
+	VkImage pageTableImg;
+	VmaAllocation pageTableAlloc;
+	VkImageView pageTableView;
+	bool imagesInitialized = false;
+
+	VkBuffer feedbackBuffer; // a u32 per virtual page, for each frame in flight. Host visible
+	VmaAllocation feedbackAlloc;
+	const u32* feedbackData;
+	u64 feedbackFrameSize;
+
+	VkBuffer stagingBuffer; // pages and page table entries, for each frame in flight
+	VmaAllocation stagingAlloc;
+	u8* stagingData;
+	u64 stagingFrameSize;
+	// the copies to record in the frame being prepared
+	std::vector<VkBufferImageCopy> cacheCopies;
+	std::vector<VkBufferImageCopy> pageTableCopies;
+
+	VkDescriptorSetLayout setLayout;
+	VkDescriptorPool descPool;
+	VkDescriptorSet descSet;
+
+	u64 frame = 0;
+	// stats
+	u32 numRequestedPages = 0; // in the last feedback
+	u32 numResidentPages = 0;
+	u32 numPagesLoaded = 0; // in the last update
+	u64 bytesRead = 0;
+};
+
+u32 levelPagesPerSide(const VirtualTexture& vt, u32 level)
+{
+	return vt.header.pagesPerSide >> level;
+}
+
+// the part of the virtual texture covered by the image, in uv
+glm::vec2 imageUvSize(const VirtualTexture& vt)
+{
+	const float virtualSize = float(vt.header.pagesPerSide * texc::vtPayloadSize(vt.header));
+	return glm::vec2(vt.header.width, vt.header.height) / virtualSize;
+}
+
+// the device needs the fragmentStoresAndAtomics feature, for writing the feedback
+// the samplers are not owned: the page table one must be nearest, and the cache one linear without mips, clamped to the edge
+// returns false if the file can't be read, or its format is not supported by the enabled features
+bool open(VirtualTexture& vt, VkDevice device, VmaAllocator allocator, const VkPhysicalDeviceProperties& props,
+	const VkPhysicalDeviceFeatures& enabledFeatures, VkSampler pageTableSampler, VkSampler cacheSampler, CStr fileName, u32 numFrames)
+{
+	vt.file = fopen(fileName, "rb");
+	if (!vt.file)
+		return false;
+	// the page cache is CACHE_PAGES_PER_SIDE pages wide, and the page table a texel per page
+	const u32 maxDimension = props.limits.maxImageDimension2D;
+	if (!texc::readVtHeader(vt.file, vt.header, maxDimension / CACHE_PAGES_PER_SIDE, maxDimension) ||
+		(texc::isBlockCompressed(VkFormat(vt.header.format)) && !enabledFeatures.textureCompressionBC))
+	{
+		fclose(vt.file);
+		vt.file = nullptr;
+		return false;
+	}
+	vt.device = device;
+	vt.allocator = allocator;
+	vt.numFrames = numFrames;
+	vt.pageBytes = texc::vtPageBytes(vt.header);
+	const texc::VtHeader& header = vt.header;
+
+	vt.numVirtualPages = 0;
+	for (u32 level = 0; level < header.numLevels; level++) {
+		vt.levelFirstPage[level] = vt.numVirtualPages;
+		vt.numVirtualPages += levelPagesPerSide(vt, level) * levelPagesPerSide(vt, level);
+	}
+	vt.pageSlots.assign(vt.numVirtualPages, INVALID);
+	vt.requested.resize(vt.numVirtualPages);
+	vt.slots.assign(CACHE_PAGES_PER_SIDE * CACHE_PAGES_PER_SIDE, {});
+
+	vk::Img cacheInfo = {
+		.width = CACHE_PAGES_PER_SIDE * header.pageSize,
+		.height = CACHE_PAGES_PER_SIDE * header.pageSize,
+		.mipLevels = 1,
+		.format = VkFormat(header.format),
+	};
+	vk::createStaticImage(device, allocator, cacheInfo, vt.cacheImg, vt.cacheAlloc, nullptr, &vt.cacheView);
+	vk::Img pageTableInfo = {
+		.width = header.pagesPerSide,
+		.height = header.pagesPerSide,
+		.mipLevels = header.numLevels,
+		.format = VK_FORMAT_R8G8B8A8_UINT,
+	};
+	vk::createStaticImage(device, allocator, pageTableInfo, vt.pageTableImg, vt.pageTableAlloc, nullptr, &vt.pageTableView);
+
+	// the frame regions of the buffers are bound with dynamic offsets, or copied from, so they must be aligned
+	const u64 alignment = glm::max<u64>(16, glm::max(props.limits.minStorageBufferOffsetAlignment,
+		glm::max(props.limits.optimalBufferCopyOffsetAlignment, props.limits.nonCoherentAtomSize)));
+	vt.feedbackFrameSize = upload::alignUp(u64(vt.numVirtualPages) * sizeof(u32), alignment);
+	const VkBufferCreateInfo feedbackBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = vt.feedbackFrameSize * numFrames,
+		.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	};
+	const VmaAllocationCreateInfo feedbackAllocInfo = {
+		.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, // read back by the CPU, preferably cached
+		.usage = VMA_MEMORY_USAGE_AUTO,
+	};
+	VmaAllocationInfo allocInfo;
+	VkResult vkRes = vmaCreateBuffer(allocator, &feedbackBufferInfo, &feedbackAllocInfo, &vt.feedbackBuffer, &vt.feedbackAlloc, &allocInfo);
+	vk::assertRes(vkRes);
+	memset(allocInfo.pMappedData, 0, feedbackBufferInfo.size); // the frames that haven't been rendered yet don't request anything
+	vmaFlushAllocation(allocator, vt.feedbackAlloc, 0, VK_WHOLE_SIZE);
+	vt.feedbackData = (const u32*)allocInfo.pMappedData;
+
+	// each page load can evict a page, so there are up to 2 page table entries per load
+	vt.stagingFrameSize = upload::alignUp(MAX_PAGE_LOADS_PER_FRAME * (vt.pageBytes + 2 * sizeof(Entry)), alignment);
+	vk::createStagingBuffer(device, allocator, vt.stagingFrameSize * numFrames, vt.stagingBuffer, vt.stagingAlloc, &allocInfo);
+	vt.stagingData = (u8*)allocInfo.pMappedData;
+
+	const VkDescriptorSetLayoutBinding bindings[] = {
+		{
+			.binding = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			.pImmutableSamplers = &pageTableSampler,
+		},
+		{
+			.binding = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			.pImmutableSamplers = &cacheSampler,
+		},
+		{
+			.binding = 2,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, // offset to the region of the frame
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		},
+	};
+	const VkDescriptorSetLayoutCreateInfo layoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = u32(std::size(bindings)),
+		.pBindings = bindings,
+	};
+	vkRes = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &vt.setLayout);
+	vk::assertRes(vkRes);
+
+	const VkDescriptorPoolSize poolSizes[] = {
+		{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 2 },
+		{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, .descriptorCount = 1 },
+	};
+	vt.descPool = vk::createDescriptorPool(device, 1, poolSizes);
+	vk::allocDescSets(device, vt.descPool, { &vt.setLayout, 1 }, { &vt.descSet, 1 });
+	vk::writeTextureDescriptor(device, vt.descSet, 0, vt.pageTableView, pageTableSampler);
+	vk::writeTextureDescriptor(device, vt.descSet, 1, vt.cacheView, cacheSampler);
+	const VkDescriptorBufferInfo feedbackDescInfo = {
+		.buffer = vt.feedbackBuffer,
+		.offset = 0,
+		.range = vt.feedbackFrameSize,
+	};
+	const VkWriteDescriptorSet feedbackWrite = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = vt.descSet,
+		.dstBinding = 2,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+		.pBufferInfo = &feedbackDescInfo,
+	};
+	vkUpdateDescriptorSets(device, 1, &feedbackWrite, 0, nullptr);
+	return true;
+}
+
+// the GPU must not be using it
+void destroy(VirtualTexture& vt)
+{
+	if (!vt.file)
+		return;
+	fclose(vt.file);
+	vkDestroyDescriptorPool(vt.device, vt.descPool, nullptr);
+	vkDestroyDescriptorSetLayout(vt.device, vt.setLayout, nullptr);
+	vmaDestroyBuffer(vt.allocator, vt.stagingBuffer, vt.stagingAlloc);
+	vmaDestroyBuffer(vt.allocator, vt.feedbackBuffer, vt.feedbackAlloc);
+	vkDestroyImageView(vt.device, vt.pageTableView, nullptr);
+	vmaDestroyImage(vt.allocator, vt.pageTableImg, vt.pageTableAlloc);
+	vkDestroyImageView(vt.device, vt.cacheView, nullptr);
+	vmaDestroyImage(vt.allocator, vt.cacheImg, vt.cacheAlloc);
+	vt = {};
+}
+
+void pageCoords(const VirtualTexture& vt, u32 page, u32& level, u32& x, u32& y)
+{
+	level = vt.header.numLevels - 1;
+	while (page < vt.levelFirstPage[level])
+		level--;
+	const u32 side = levelPagesPerSide(vt, level);
+	x = (page - vt.levelFirstPage[level]) % side;
+	y = (page - vt.levelFirstPage[level]) / side;
+}
+
+// stages the write of a page table entry. Returns the updated staging offset
+u64 stageEntry(VirtualTexture& vt, u64 stagingOffset, u32 page, const Entry& entry)
+{
+	u32 level, x, y;
+	pageCoords(vt, page, level, x, y);
+	memcpy(vt.stagingData + stagingOffset, &entry, sizeof(entry));
+	vt.pageTableCopies.push_back({
+		.bufferOffset = stagingOffset,
+		.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+		.imageOffset = { i32(x), i32(y), 0 },
+		.imageExtent = { 1, 1, 1 },
+	});
+	return stagingOffset + sizeof(entry);
+}
+
+// call it once per frame, after waiting for the previous use of the frame slot (so its feedback is ready)
+// reads the feedback of the last time the frame slot was rendered and loads the missing pages. The copies are recorded with cmdUpdate()
+void update(VirtualTexture& vt, u32 frameInd)
+{
+	if (!vt.file)
+		return;
+	vt.frame++;
+	vt.cacheCopies.clear();
+	vt.pageTableCopies.clear();
+	vt.numPagesLoaded = 0;
+	const texc::VtHeader& header = vt.header;
+
+	// the ancestors of the requested pages are requested too: they are the fallbacks while the page loads, and keep the
+	// coarse levels resident. The single page of the last level is always requested, so there is always something to sample
+	vmaInvalidateAllocation(vt.allocator, vt.feedbackAlloc, frameInd * vt.feedbackFrameSize, vt.feedbackFrameSize);
+	const u32* feedback = vt.feedbackData + frameInd * vt.feedbackFrameSize / sizeof(u32);
+	for (u32 i = 0; i < vt.numVirtualPages; i++)
+		vt.requested[i] = feedback[i] != 0;
+	vt.requested[vt.numVirtualPages - 1] = 1;
+	for (u32 level = 0; level + 1 < header.numLevels; level++) {
+		const u32 side = levelPagesPerSide(vt, level);
+		for (u32 y = 0; y < side; y++)
+		for (u32 x = 0; x < side; x++) {
+			if (vt.requested[vt.levelFirstPage[level] + y * side + x])
+				vt.requested[vt.levelFirstPage[level + 1] + (y / 2) * (side / 2) + x / 2] = 1;
+		}
+	}
+
+	vt.loads.clear();
+	vt.numRequestedPages = 0;
+	for (u32 level = 0; level < header.numLevels; level++) {
+		const u32 side = levelPagesPerSide(vt, level);
+		const u32 storedX = texc::vtLevelPagesX(header, level), storedY = texc::vtLevelPagesY(header, level);
+		for (u32 y = 0; y < side; y++)
+		for (u32 x = 0; x < side; x++) {
+			const u32 page = vt.levelFirstPage[level] + y * side + x;
+			if (!vt.requested[page] || x >= storedX || y >= storedY)
+				continue;
+			vt.numRequestedPages++;
+			if (vt.pageSlots[page] != INVALID)
+				vt.slots[vt.pageSlots[page]].lastRequestedFrame = vt.frame;
+			else
+				vt.loads.push_back({ page, level });
+		}
+	}
+	// coarser levels first: they cover more of the screen, and the finer ones fall back to them
+	std::stable_sort(vt.loads.begin(), vt.loads.end(), [](const PageLoad& a, const PageLoad& b) { return a.level > b.level; });
+
+	// free slots first, then the least recently requested ones. The pages requested in this frame are never replaced
+	std::vector<u32> candidates;
+	for (u32 i = 0; i < u32(vt.slots.size()); i++) {
+		const Slot& slot = vt.slots[i];
+		if (!slot.pinned && (slot.page == INVALID || slot.lastRequestedFrame < vt.frame))
+			candidates.push_back(i);
+	}
+	std::sort(candidates.begin(), candidates.end(), [&](u32 a, u32 b) {
+		const Slot& sa = vt.slots[a];
+		const Slot& sb = vt.slots[b];
+		if ((sa.page == INVALID) != (sb.page == INVALID))
+			return sa.page == INVALID;
+		return sa.lastRequestedFrame < sb.lastRequestedFrame;
+	});
+
+	u8* staging = vt.stagingData + frameInd * vt.stagingFrameSize;
+	u64 stagingOffset = frameInd * vt.stagingFrameSize;
+	u64 entriesOffset = stagingOffset + MAX_PAGE_LOADS_PER_FRAME * vt.pageBytes;
+	const u32 numLoads = glm::min(u32(vt.loads.size()), glm::min(u32(candidates.size()), MAX_PAGE_LOADS_PER_FRAME));
+	for (u32 i = 0; i < numLoads; i++) {
+		const PageLoad& load = vt.loads[i];
+		const u32 slotInd = candidates[i];
+		Slot& slot = vt.slots[slotInd];
+		if (slot.page != INVALID) {
+			vt.pageSlots[slot.page] = INVALID;
+			entriesOffset = stageEntry(vt, entriesOffset, slot.page, {});
+			vt.numResidentPages--;
+		}
+
+		u32 level, x, y;
+		pageCoords(vt, load.page, level, x, y);
+		[[maybe_unused]] const bool ok = texc::seek(vt.file, texc::vtPageOffset(vt.header, level, x, y)) &&
+			fread(staging + i * vt.pageBytes, 1, vt.pageBytes, vt.file) == vt.pageBytes;
+		assert(ok);
+		vt.bytesRead += vt.pageBytes;
+
+		const u32 slotX = slotInd % CACHE_PAGES_PER_SIDE, slotY = slotInd / CACHE_PAGES_PER_SIDE;
+		vt.cacheCopies.push_back({
+			.bufferOffset = stagingOffset + i * vt.pageBytes,
+			.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+			.imageOffset = { i32(slotX * header.pageSize), i32(slotY * header.pageSize), 0 },
+			.imageExtent = { header.pageSize, header.pageSize, 1 },
+		});
+		entriesOffset = stageEntry(vt, entriesOffset, load.page, { u8(slotX), u8(slotY), u8(level), 1 });
+
+		slot.page = load.page;
+		slot.lastRequestedFrame = vt.frame;
+		slot.pinned = level == header.numLevels - 1;
+		vt.pageSlots[load.page] = slotInd;
+		vt.numResidentPages++;
+		vt.numPagesLoaded++;
+	}
+	if (numLoads)
+		vmaFlushAllocation(vt.allocator, vt.stagingAlloc, stagingOffset, vt.stagingFrameSize);
+}
+
+// records the copies staged by update(), and clears the feedback region of the frame. Must be recorded before the render pass
+void cmdUpdate(VirtualTexture& vt, VkCommandBuffer cmdBuffer, u32 frameInd)
+{
+	if (!vt.file)
+		return;
+	const VkImageSubresourceRange cacheRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	const VkImageSubresourceRange pageTableRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, vt.header.numLevels, 0, 1 };
+	if (!vt.imagesInitialized) { // all the page table entries start as not resident
+		vk::cmdImageBarrier(cmdBuffer, vt.cacheImg, cacheRange,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		vk::cmdImageBarrier(cmdBuffer, vt.pageTableImg, pageTableRange,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		const VkClearColorValue zero = {};
+		vkCmdClearColorImage(cmdBuffer, vt.pageTableImg, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &zero, 1, &pageTableRange);
+		// the clear and the entry copies write the same texels
+		vk::cmdImageBarrier(cmdBuffer, vt.pageTableImg, pageTableRange,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	}
+	else if (!vt.cacheCopies.empty()) { // after the sampling of the previous frames
+		vk::cmdImageBarrier(cmdBuffer, vt.cacheImg, cacheRange,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		vk::cmdImageBarrier(cmdBuffer, vt.pageTableImg, pageTableRange,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	}
+
+	if (!vt.cacheCopies.empty()) {
+		vkCmdCopyBufferToImage(cmdBuffer, vt.stagingBuffer, vt.cacheImg, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			u32(vt.cacheCopies.size()), vt.cacheCopies.data());
+		vkCmdCopyBufferToImage(cmdBuffer, vt.stagingBuffer, vt.pageTableImg, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			u32(vt.pageTableCopies.size()), vt.pageTableCopies.data());
+	}
+	if (!vt.imagesInitialized || !vt.cacheCopies.empty()) {
+		vk::cmdImageBarrier(cmdBuffer, vt.cacheImg, cacheRange,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		vk::cmdImageBarrier(cmdBuffer, vt.pageTableImg, pageTableRange,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+	vt.imagesInitialized = true;
+
+	vkCmdFillBuffer(cmdBuffer, vt.feedbackBuffer, frameInd * vt.feedbackFrameSize, vt.feedbackFrameSize, 0);
+	const VkBufferMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = vt.feedbackBuffer,
+		.offset = frameInd * vt.feedbackFrameSize,
+		.size = vt.feedbackFrameSize,
+	};
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// binds the descriptor set, with the feedback region of the frame, and pushes the constants. The pipeline layout must have the set
+// of the virtual texture in setInd, and PushConstants in the fragment stage
+void cmdBind(const VirtualTexture& vt, VkCommandBuffer cmdBuffer, VkPipelineLayout pipelineLayout, u32 frameInd,
+	glm::vec2 uvOffset, glm::vec2 uvScale, u32 setInd = 0)
+{
+	const u32 dynamicOffset = u32(frameInd * vt.feedbackFrameSize);
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setInd, 1, &vt.descSet, 1, &dynamicOffset);
+	const u32 pixel = u32(vt.frame * 7) % (FEEDBACK_BLOCK_SIZE * FEEDBACK_BLOCK_SIZE); // 7 is coprime with 16: all the pixels, scattered
+	const PushConstants pushConstants = {
+		.uvOffset = uvOffset,
+		.uvScale = uvScale,
+		.pagesPerSide = vt.header.pagesPerSide,
+		.numLevels = vt.header.numLevels,
+		.pageSize = vt.header.pageSize,
+		.border = vt.header.border,
+		.feedbackPixel = pixel,
+	};
+	vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
+}
+
+// makes the feedback written in the render pass visible to the host, once the frame has finished. Must be recorded after the render pass
+void cmdFeedbackBarrier(const VirtualTexture& vt, VkCommandBuffer cmdBuffer, u32 frameInd)
+{
+	if (!vt.file)
+		return;
+	const VkBufferMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = vt.feedbackBuffer,
+		.offset = frameInd * vt.feedbackFrameSize,
+		.size = vt.feedbackFrameSize,
+	};
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+		0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+} // namespace vt
+
+}
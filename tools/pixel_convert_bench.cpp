@@ -0,0 +1,105 @@
+// microbenchmark of the pixel conversion kernels (src/pixel_convert.hpp)
+// runs every kernel with every instruction set supported by the CPU, checks that the output matches the scalar version, and prints the throughput
+// usage: pixel_convert_bench [megapixels]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "../src/pixel_convert.hpp"
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+
+static constexpr u32 NUM_RUNS = 10;
+
+// runs the conversion NUM_RUNS times and returns the best time in ms
+template <typename F>
+static double bestTimeMs(F&& f)
+{
+	double best = 1e30;
+	for (u32 i = 0; i < NUM_RUNS; i++) {
+		const auto t0 = std::chrono::high_resolution_clock::now();
+		f();
+		const auto t1 = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+	}
+	return best;
+}
+
+static void report(const char* kernelName, pixconv::Isa isa, u32 numPixels, double ms, bool matches)
+{
+	printf("%-18s %-7s %8.3f ms %8.1f Mpix/s%s\n", kernelName, pixconv::ISA_NAMES[u32(isa)], ms, numPixels / (ms * 1000.0),
+		matches ? "" : "   MISMATCH");
+}
+
+int main(int argc, char** argv)
+{
+	// odd number of pixels, so the scalar tails of the SIMD loops are exercised too
+	const u32 numPixels = (argc > 1 ? u32(atof(argv[1]) * 1e6) : 4 << 20) | 1;
+
+	std::vector<u8> rgb(size_t(numPixels) * 3);
+	std::vector<u8> rgba(size_t(numPixels) * 4);
+	std::vector<float> linear(size_t(numPixels) * 4);
+	u32 seed = 1;
+	for (u8& x : rgb) {
+		seed = seed * 1664525u + 1013904223u;
+		x = u8(seed >> 24);
+	}
+	for (u8& x : rgba) {
+		seed = seed * 1664525u + 1013904223u;
+		x = u8(seed >> 24);
+	}
+	for (float& x : linear) {
+		seed = seed * 1664525u + 1013904223u;
+		x = float(seed >> 8) / float(1 << 24) * 1.2f - 0.1f; // slightly out of [0, 1], to test the clamping
+	}
+
+	const pixconv::Kernels& scalar = *pixconv::kernelsForIsa(pixconv::Isa::SCALAR);
+	std::vector<u8> expected8(size_t(numPixels) * 4), out8(size_t(numPixels) * 4);
+	std::vector<float> expectedF(size_t(numPixels) * 4), outF(size_t(numPixels) * 4);
+
+	bool allMatch = true;
+	printf("%u pixels, best of %u runs. Best instruction set for this CPU: %s\n", numPixels, NUM_RUNS,
+		pixconv::ISA_NAMES[u32(pixconv::kernels().isa)]);
+	for (u32 i = 0; i < u32(pixconv::Isa::COUNT); i++) {
+		const pixconv::Isa isa = pixconv::Isa(i);
+		const pixconv::Kernels* k = pixconv::kernelsForIsa(isa);
+		if (!k || !pixconv::isaIsSupported(isa))
+			continue;
+
+		auto check8 = [&](void (*scalarKernel)(u8*, const u8*, u32), const u8* src) {
+			scalarKernel(expected8.data(), src, numPixels);
+			return memcmp(expected8.data(), out8.data(), out8.size()) == 0;
+		};
+
+		double ms = bestTimeMs([&] { k->rgbToRgba(out8.data(), rgb.data(), numPixels); });
+		bool matches = check8(scalar.rgbToRgba, rgb.data());
+		report("rgbToRgba", isa, numPixels, ms, matches);
+		allMatch &= matches;
+
+		ms = bestTimeMs([&] { k->swapRedBlue(out8.data(), rgba.data(), numPixels); });
+		matches = check8(scalar.swapRedBlue, rgba.data());
+		report("swapRedBlue", isa, numPixels, ms, matches);
+		allMatch &= matches;
+
+		ms = bestTimeMs([&] { k->premultiplyAlpha(out8.data(), rgba.data(), numPixels); });
+		matches = check8(scalar.premultiplyAlpha, rgba.data());
+		report("premultiplyAlpha", isa, numPixels, ms, matches);
+		allMatch &= matches;
+
+		ms = bestTimeMs([&] { k->srgbToLinear(outF.data(), rgba.data(), numPixels); });
+		scalar.srgbToLinear(expectedF.data(), rgba.data(), numPixels);
+		matches = memcmp(expectedF.data(), outF.data(), outF.size() * sizeof(float)) == 0;
+		report("srgbToLinear", isa, numPixels, ms, matches);
+		allMatch &= matches;
+
+		ms = bestTimeMs([&] { k->linearToSrgb(out8.data(), linear.data(), numPixels); });
+		scalar.linearToSrgb(expected8.data(), linear.data(), numPixels);
+		matches = memcmp(expected8.data(), out8.data(), out8.size()) == 0;
+		report("linearToSrgb", isa, numPixels, ms, matches);
+		allMatch &= matches;
+	}
+	return allMatch ? 0 : 1;
+}
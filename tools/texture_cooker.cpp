@@ -0,0 +1,454 @@
+// offline texture cooker: converts a source image (anything stb_image can load) into a texture container (see src/texture_container.hpp)
+// with the whole mip chain precomputed and, optionally, block compressed. So at runtime there is no decoding nor mip generation
+// usage: texture_cooker <input image> <output file> [--format bc1|rgba8]
+// with --vt, it writes a virtual texture instead: the levels are cut in pages (see the VT format in src/texture_container.hpp)
+//   texture_cooker <input image> <output file> --vt [--page-size N] [--format bc1|rgba8]
+//   texture_cooker --procedural <size> <output file> --vt ...: a procedural image of size x size texels, generated page by page,
+//   for testing gigapixel virtual textures without a source image (nor the memory to hold it)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <stb_image.h>
+#include "../src/texture_container.hpp"
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+struct Level {
+	u32 width, height;
+	std::vector<u8> rgba;
+};
+
+static float srgbToLinearTable[256];
+
+static void initSrgbToLinearTable()
+{
+	for (u32 i = 0; i < 256; i++) {
+		const float c = i / 255.f;
+		srgbToLinearTable[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+}
+
+static u8 linearToSrgb(float c)
+{
+	c = std::clamp(c, 0.f, 1.f);
+	const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+	return u8(s * 255.f + 0.5f);
+}
+
+// 2x2 box filter in linear space. Odd sizes clamp the last column/row
+static Level downsample(const Level& src)
+{
+	Level dst;
+	dst.width = std::max(src.width / 2, 1u);
+	dst.height = std::max(src.height / 2, 1u);
+	dst.rgba.resize(size_t(dst.width) * dst.height * 4);
+	for (u32 y = 0; y < dst.height; y++)
+	for (u32 x = 0; x < dst.width; x++) {
+		const u32 x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+		const u32 y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+		const u8* p[4] = {
+			&src.rgba[(size_t(y0) * src.width + x0) * 4], &src.rgba[(size_t(y0) * src.width + x1) * 4],
+			&src.rgba[(size_t(y1) * src.width + x0) * 4], &src.rgba[(size_t(y1) * src.width + x1) * 4],
+		};
+		u8* out = &dst.rgba[(size_t(y) * dst.width + x) * 4];
+		for (u32 c = 0; c < 3; c++) {
+			const float sum = srgbToLinearTable[p[0][c]] + srgbToLinearTable[p[1][c]] + srgbToLinearTable[p[2][c]] + srgbToLinearTable[p[3][c]];
+			out[c] = linearToSrgb(0.25f * sum);
+		}
+		out[3] = u8((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+	}
+	return dst;
+}
+
+static u16 to565(const int c[3])
+{
+	return u16(((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+}
+
+static void from565(u16 c, int out[3])
+{
+	const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	out[0] = (r << 3) | (r >> 2);
+	out[1] = (g << 2) | (g >> 4);
+	out[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 in 4-color mode. The endpoints are the corners of the (inset) bounding box, along the diagonal that follows the colors
+static void encodeBc1Block(const u8 (&block)[16][4], u8* out)
+{
+	int mean[3] = {}, minC[3] = {255, 255, 255}, maxC[3] = {};
+	for (u32 i = 0; i < 16; i++)
+	for (u32 c = 0; c < 3; c++) {
+		mean[c] += block[i][c];
+		minC[c] = std::min(minC[c], int(block[i][c]));
+		maxC[c] = std::max(maxC[c], int(block[i][c]));
+	}
+	for (u32 c = 0; c < 3; c++)
+		mean[c] /= 16;
+
+	// pick the diagonal: green and blue are flipped if they are anti-correlated with red
+	int covRG = 0, covRB = 0;
+	for (u32 i = 0; i < 16; i++) {
+		const int r = block[i][0] - mean[0];
+		covRG += r * (block[i][1] - mean[1]);
+		covRB += r * (block[i][2] - mean[2]);
+	}
+	if (covRG < 0)
+		std::swap(minC[1], maxC[1]);
+	if (covRB < 0)
+		std::swap(minC[2], maxC[2]);
+
+	// inset the box a bit, it reduces the error of the interpolated colors
+	for (u32 c = 0; c < 3; c++) {
+		const int inset = (maxC[c] - minC[c]) / 16;
+		maxC[c] -= inset;
+		minC[c] += inset;
+	}
+
+	u16 c0 = to565(maxC), c1 = to565(minC);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	u32 indices = 0;
+	if (c0 != c1) { // otherwise the block is a solid color, and all the indices are 0
+		int palette[4][3];
+		from565(c0, palette[0]);
+		from565(c1, palette[1]);
+		for (u32 c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (u32 i = 0; i < 16; i++) {
+			u32 best = 0;
+			int bestDist = INT32_MAX;
+			for (u32 p = 0; p < 4; p++) {
+				int dist = 0;
+				for (u32 c = 0; c < 3; c++) {
+					const int d = block[i][c] - palette[p][c];
+					dist += d * d;
+				}
+				if (dist < bestDist) {
+					bestDist = dist;
+					best = p;
+				}
+			}
+			indices |= best << (2 * i);
+		}
+	}
+
+	out[0] = u8(c0);
+	out[1] = u8(c0 >> 8);
+	out[2] = u8(c1);
+	out[3] = u8(c1 >> 8);
+	memcpy(out + 4, &indices, 4); // little endian
+}
+
+static std::vector<u8> encodeBc1(const Level& level)
+{
+	const u32 blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+	std::vector<u8> data(size_t(blocksX) * blocksY * 8);
+	for (u32 by = 0; by < blocksY; by++)
+	for (u32 bx = 0; bx < blocksX; bx++) {
+		u8 block[16][4];
+		for (u32 y = 0; y < 4; y++)
+		for (u32 x = 0; x < 4; x++) {
+			// the pixels outside of the image replicate the border
+			const u32 px = std::min(4 * bx + x, level.width - 1);
+			const u32 py = std::min(4 * by + y, level.height - 1);
+			memcpy(block[4 * y + x], &level.rgba[(size_t(py) * level.width + px) * 4], 4);
+		}
+		encodeBc1Block(block, &data[(size_t(by) * blocksX + bx) * 8]);
+	}
+	return data;
+}
+
+// ---- virtual textures ----
+
+static constexpr u32 VT_BORDER = 4; // a multiple of 4, so the payload of the BC1 pages starts at a block boundary
+static constexpr u32 PROCEDURAL_OCTAVES = 14;
+static constexpr double PI = 3.14159265358979323846;
+
+// fills size x size RGBA8 texels of a level, starting at (x0, y0). The coordinates can be out of the image
+typedef std::function<void(u32 level, int x0, int y0, u32 size, u8* rgba)> FillPageFn;
+
+static void parallelFor(u32 count, const std::function<void(u32)>& f)
+{
+	const u32 numThreads = std::max(1u, std::min(count, std::thread::hardware_concurrency()));
+	std::atomic<u32> next = 0;
+	std::vector<std::thread> threads;
+	for (u32 t = 0; t < numThreads; t++) {
+		threads.emplace_back([&]() {
+			for (u32 i; (i = next++) < count; )
+				f(i);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+// band limited procedural image: a sum of octaves of products of sines
+// the octaves that would alias in a level (wavelength under 8 of its texels) are faded out, so each level is a filtered version of the
+// previous one, like a real mip chain. Each page is computed on its own, so the image can be arbitrarily big
+static void fillProceduralPage(u32 level, int x0, int y0, u32 size, u8* rgba)
+{
+	const double texelSize = double(1u << level); // in texels of level 0
+	std::vector<float> sx(PROCEDURAL_OCTAVES * 3 * size), sy(PROCEDURAL_OCTAVES * 3 * size);
+	float weights[PROCEDURAL_OCTAVES];
+	double wavelength = 16384;
+	float amplitude = 0.3f;
+	for (u32 o = 0; o < PROCEDURAL_OCTAVES; o++) {
+		weights[o] = amplitude * std::clamp(float(wavelength / texelSize - 4) / 4.f, 0.f, 1.f);
+		for (u32 c = 0; c < 3; c++)
+		for (u32 i = 0; i < size; i++) {
+			const double x = (x0 + int(i) + 0.5) * texelSize;
+			const double y = (y0 + int(i) + 0.5) * texelSize;
+			sx[(o * 3 + c) * size + i] = float(sin(2 * PI * x / wavelength + 1.7 * o + 2.1 * c));
+			sy[(o * 3 + c) * size + i] = float(sin(2 * PI * y / (1.3 * wavelength) + 0.9 * o + 1.3 * c));
+		}
+		wavelength *= 0.5;
+		amplitude *= 0.75f;
+	}
+	for (u32 y = 0; y < size; y++)
+	for (u32 x = 0; x < size; x++) {
+		u8* out = rgba + (size_t(y) * size + x) * 4;
+		for (u32 c = 0; c < 3; c++) {
+			float v = 0.5f;
+			for (u32 o = 0; o < PROCEDURAL_OCTAVES; o++)
+				v += weights[o] * sx[(o * 3 + c) * size + x] * sy[(o * 3 + c) * size + y];
+			out[c] = u8(std::clamp(v, 0.f, 1.f) * 255.f + 0.5f);
+		}
+		out[3] = 255;
+	}
+}
+
+static u32 nextPowerOf2(u32 x)
+{
+	u32 p = 1;
+	while (p < x)
+		p *= 2;
+	return p;
+}
+
+static texc::VtHeader makeVtHeader(u32 width, u32 height, VkFormat format, u32 pageSize)
+{
+	const u32 payload = pageSize - 2 * VT_BORDER;
+	const u32 pagesPerSide = nextPowerOf2(std::max((width + payload - 1) / payload, (height + payload - 1) / payload));
+	u32 numLevels = 1;
+	while ((1u << (numLevels - 1)) < pagesPerSide)
+		numLevels++;
+	return {
+		.magic = texc::VT_MAGIC,
+		.version = texc::VT_VERSION,
+		.format = u32(format),
+		.width = width,
+		.height = height,
+		.pageSize = pageSize,
+		.border = VT_BORDER,
+		.numLevels = numLevels,
+		.pagesPerSide = pagesPerSide,
+	};
+}
+
+// the mip chain of the source image, padded (replicating the edges) to a multiple of pagesPerSide so every level halves exactly
+// and the image covers the same part of the virtual texture in all the levels
+static FillPageFn imagePageFiller(Level& level0, const texc::VtHeader& header, std::vector<Level>& levels)
+{
+	const u32 p = header.pagesPerSide;
+	Level padded;
+	padded.width = (level0.width + p - 1) / p * p;
+	padded.height = (level0.height + p - 1) / p * p;
+	padded.rgba.resize(size_t(padded.width) * padded.height * 4);
+	for (u32 y = 0; y < padded.height; y++)
+	for (u32 x = 0; x < padded.width; x++) {
+		const u32 sx = std::min(x, level0.width - 1), sy = std::min(y, level0.height - 1);
+		memcpy(&padded.rgba[(size_t(y) * padded.width + x) * 4], &level0.rgba[(size_t(sy) * level0.width + sx) * 4], 4);
+	}
+	level0 = {};
+	levels.clear();
+	levels.push_back(std::move(padded));
+	while (levels.size() < header.numLevels)
+		levels.push_back(downsample(levels.back()));
+
+	return [&levels](u32 levelInd, int x0, int y0, u32 size, u8* rgba) {
+		const Level& level = levels[levelInd];
+		for (u32 y = 0; y < size; y++)
+		for (u32 x = 0; x < size; x++) {
+			const u32 sx = u32(std::clamp(x0 + int(x), 0, int(level.width) - 1));
+			const u32 sy = u32(std::clamp(y0 + int(y), 0, int(level.height) - 1));
+			memcpy(rgba + (size_t(y) * size + x) * 4, &level.rgba[(size_t(sy) * level.width + sx) * 4], 4);
+		}
+	};
+}
+
+// the pages are written in the order they are stored, a row of pages at a time
+static bool writeVirtualTexture(const char* outputFileName, const texc::VtHeader& header, const FillPageFn& fillPage)
+{
+	FILE* file = fopen(outputFileName, "wb");
+	if (!file) {
+		fprintf(stderr, "could not open %s for writing\n", outputFileName);
+		return false;
+	}
+	u8 headerData[texc::VT_DATA_OFFSET] = {};
+	memcpy(headerData, &header, sizeof(header));
+	fwrite(headerData, 1, sizeof(headerData), file);
+
+	const VkFormat format = VkFormat(header.format);
+	const u32 payload = texc::vtPayloadSize(header);
+	const u64 pageBytes = texc::vtPageBytes(header);
+	for (u32 level = 0; level < header.numLevels; level++) {
+		const u32 pagesX = texc::vtLevelPagesX(header, level), pagesY = texc::vtLevelPagesY(header, level);
+		std::vector<u8> rowData(pagesX * pageBytes);
+		for (u32 py = 0; py < pagesY; py++) {
+			parallelFor(pagesX, [&](u32 px) {
+				Level page;
+				page.width = page.height = header.pageSize;
+				page.rgba.resize(size_t(header.pageSize) * header.pageSize * 4);
+				fillPage(level, int(px * payload) - int(header.border), int(py * payload) - int(header.border), header.pageSize, page.rgba.data());
+				if (format == VK_FORMAT_R8G8B8A8_SRGB)
+					memcpy(&rowData[px * pageBytes], page.rgba.data(), pageBytes);
+				else
+					memcpy(&rowData[px * pageBytes], encodeBc1(page).data(), pageBytes);
+			});
+			fwrite(rowData.data(), 1, rowData.size(), file);
+		}
+		printf("level %u: %ux%u pages\n", level, pagesX, pagesY);
+	}
+	const bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	const char* inputFileName = nullptr;
+	const char* outputFileName = nullptr;
+	VkFormat format = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+	bool virtualTexture = false;
+	u32 pageSize = 128;
+	u32 proceduralSize = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--vt") == 0) {
+			virtualTexture = true;
+		}
+		else if (strcmp(argv[i], "--page-size") == 0 && i + 1 < argc) {
+			pageSize = u32(atoi(argv[++i]));
+			if (pageSize % 4 != 0 || pageSize <= 2 * VT_BORDER) {
+				fprintf(stderr, "the page size must be a multiple of 4, bigger than %u\n", 2 * VT_BORDER);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--procedural") == 0 && i + 1 < argc) {
+			proceduralSize = u32(atoi(argv[++i]));
+			inputFileName = "procedural";
+		}
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "bc1") == 0)
+				format = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+			else if (strcmp(argv[i], "rgba8") == 0)
+				format = VK_FORMAT_R8G8B8A8_SRGB;
+			else {
+				fprintf(stderr, "unknown format: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!inputFileName)
+			inputFileName = argv[i];
+		else if (!outputFileName)
+			outputFileName = argv[i];
+	}
+	if (!inputFileName || !outputFileName || (proceduralSize && !virtualTexture)) {
+		fprintf(stderr, "usage: texture_cooker <input image> <output file> [--format bc1|rgba8]\n"
+			"       texture_cooker <input image> <output file> --vt [--page-size N] [--format bc1|rgba8]\n"
+			"       texture_cooker --procedural <size> <output file> --vt [--page-size N] [--format bc1|rgba8]\n");
+		return 1;
+	}
+
+	if (proceduralSize) {
+		const texc::VtHeader header = makeVtHeader(proceduralSize, proceduralSize, format, pageSize);
+		if (!writeVirtualTexture(outputFileName, header, fillProceduralPage))
+			return 1;
+		printf("procedural %ux%u -> %s: %u levels of %ux%u pages\n", proceduralSize, proceduralSize, outputFileName,
+			header.numLevels, pageSize, pageSize);
+		return 0;
+	}
+
+	int w, h, nc;
+	u8* pixels = stbi_load(inputFileName, &w, &h, &nc, 4);
+	if (!pixels) {
+		fprintf(stderr, "could not load %s: %s\n", inputFileName, stbi_failure_reason());
+		return 1;
+	}
+
+	initSrgbToLinearTable();
+	std::vector<Level> levels(1);
+	levels[0].width = u32(w);
+	levels[0].height = u32(h);
+	levels[0].rgba.assign(pixels, pixels + size_t(w) * size_t(h) * 4);
+	stbi_image_free(pixels);
+
+	if (virtualTexture) {
+		const texc::VtHeader header = makeVtHeader(u32(w), u32(h), format, pageSize);
+		Level level0 = std::move(levels[0]);
+		const FillPageFn fillPage = imagePageFiller(level0, header, levels);
+		if (!writeVirtualTexture(outputFileName, header, fillPage))
+			return 1;
+		printf("%s -> %s: %ux%u, %u levels of %ux%u pages\n", inputFileName, outputFileName, w, h, header.numLevels, pageSize, pageSize);
+		return 0;
+	}
+	while ((levels.back().width > 1 || levels.back().height > 1) && levels.size() < texc::MAX_LEVELS)
+		levels.push_back(downsample(levels.back()));
+
+	const u32 numLevels = u32(levels.size());
+	std::vector<std::vector<u8>> levelData(numLevels);
+	for (u32 i = 0; i < numLevels; i++)
+		levelData[i] = format == VK_FORMAT_R8G8B8A8_SRGB ? levels[i].rgba : encodeBc1(levels[i]);
+
+	const texc::FileHeader header = {
+		.magic = texc::MAGIC,
+		.version = texc::VERSION,
+		.format = u32(format),
+		.width = u32(w),
+		.height = u32(h),
+		.numLevels = numLevels,
+	};
+	texc::LevelIndex index[texc::MAX_LEVELS] = {};
+	u64 offset = sizeof(header) + numLevels * sizeof(texc::LevelIndex);
+	for (u32 i = numLevels; i-- > 0; ) { // the smallest levels go first
+		offset = (offset + texc::LEVEL_ALIGNMENT - 1) / texc::LEVEL_ALIGNMENT * texc::LEVEL_ALIGNMENT;
+		index[i] = {
+			.offset = offset,
+			.size = levelData[i].size(),
+			.width = levels[i].width,
+			.height = levels[i].height,
+		};
+		offset += levelData[i].size();
+	}
+
+	FILE* file = fopen(outputFileName, "wb");
+	if (!file) {
+		fprintf(stderr, "could not open %s for writing\n", outputFileName);
+		return 1;
+	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(index, sizeof(texc::LevelIndex), numLevels, file);
+	for (u32 i = numLevels; i-- > 0; ) {
+		fseek(file, long(index[i].offset), SEEK_SET);
+		fwrite(levelData[i].data(), 1, levelData[i].size(), file);
+	}
+	fclose(file);
+
+	const u64 rawSize = u64(w) * u64(h) * 4;
+	printf("%s -> %s: %ux%u, %u levels, %llu bytes (level 0 uncompressed: %llu bytes)\n",
+		inputFileName, outputFileName, w, h, numLevels, (unsigned long long)offset, (unsigned long long)rawSize);
+	return 0;
+}